@@ -19,50 +19,193 @@ Copyright (c) Intel Corporation (2009-2017).
 #pragma once
 
 #include "opencl_clang.h"
-#include "llvm/ADT/SmallVector.h"
+#include "diagnostics.h"
+#include "host_allocator.h"
+#include <atomic>
+#include <future>
+#include <mutex>
 #include <string>
+#include <utility>
+#include <vector>
 
 // The following #define is taken from
 // https://github.com/KhronosGroup/OpenCL-Headers/blob/master/CL/cl.h
 #define CL_SUCCESS 0
 
-class OCLFEBinaryResult : public Intel::OpenCL::ClangFE::IOCLFEBinaryResult {
+// Names of the outputs of a compile, see IOCLFEBinaryResult2::GetOutputName
+static const char LLVMBitcodeOutputName[] = "llvm-bc";
+static const char SPIRVOutputName[] = "spirv";
+static const char PreprocessedOutputName[] = "preprocessed";
+
+class OCLFEBinaryResult : public Intel::OpenCL::ClangFE::IOCLFEBinaryResult2 {
   // IOCLFEBinaryResult
 public:
   size_t GetIRSize() const override { return m_IRBuffer.size(); }
 
-  const void *GetIR() const override { return m_IRBuffer.data(); }
+  // an empty IR is still a valid pointer
+  const void *GetIR() const override {
+    return m_IRBuffer.data() ? m_IRBuffer.data() : "";
+  }
 
   const char *GetIRName() const override { return m_IRName.c_str(); }
 
   Intel::OpenCL::ClangFE::IR_TYPE GetIRType() const override { return m_type; }
 
-  const char *GetErrorLog() const override { return m_log.c_str(); }
-
-  void Release() override { delete this; }
+  const char *GetErrorLog() const override {
+    // the translation to SPIR-V in the background might add to the log
+    waitForSPIRV();
+    // the diagnostics are rendered only if someone reads the log
+    std::call_once(m_renderOnce, [this]() {
+      RenderDiagnostics(m_diagnostics.getDiagnostics(),
+                        m_diagnostics.getCount(), m_diagnostics.getStrings(),
+                        m_diagnostics.showColumn(),
+                        m_diagnostics.showCarets(), m_renderedLog);
+      m_renderedLog += m_log;
+    });
+    return m_renderedLog.c_str();
+  }
+
+  void Release() override {
+    if (m_refCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+      delete this;
+  }
+  // IOCLFEBinaryResult2
+public:
+  size_t GetPeakAllocatedBytes() const override { return m_peakAllocatedBytes; }
+
+  unsigned int GetDiagnosticCount() const override {
+    return m_diagnostics.getCount();
+  }
+
+  const Intel::OpenCL::ClangFE::OCLFEDiagnostic *GetDiagnostics() const override {
+    return m_diagnostics.getDiagnostics();
+  }
+
+  const Intel::OpenCL::ClangFE::OCLFEFixIt *GetFixIts() const override {
+    return m_diagnostics.getFixIts();
+  }
+
+  const char *GetDiagnosticStrings() const override {
+    return m_diagnostics.getStrings();
+  }
+
+  void Retain() override { m_refCount.fetch_add(1, std::memory_order_relaxed); }
+
+  unsigned int GetOutputCount() const override {
+    return m_SPIRVTranslation.valid() ? 2 : 1;
+  }
+
+  const char *GetOutputName(unsigned int uiIndex) const override {
+    if (uiIndex == 0)
+      return m_IRFormat;
+    return uiIndex < GetOutputCount() ? SPIRVOutputName : nullptr;
+  }
+
+  const void *GetOutput(unsigned int uiIndex) const override {
+    if (uiIndex == 0)
+      return GetIR();
+    if (uiIndex >= GetOutputCount() || !waitForSPIRV())
+      return nullptr;
+    return m_SPIRVBuffer.data();
+  }
+
+  size_t GetOutputSize(unsigned int uiIndex) const override {
+    if (uiIndex == 0)
+      return GetIRSize();
+    if (uiIndex >= GetOutputCount() || !waitForSPIRV())
+      return 0;
+    return m_SPIRVBuffer.size();
+  }
+
+  unsigned int GetDependencyCount() const override {
+    return static_cast<unsigned int>(m_dependencies.size());
+  }
+
+  const char *GetDependencyName(unsigned int uiIndex) const override {
+    return uiIndex < m_dependencies.size()
+               ? m_dependencies[uiIndex].first.c_str()
+               : nullptr;
+  }
+
+  unsigned long long GetDependencyHash(unsigned int uiIndex) const override {
+    return uiIndex < m_dependencies.size() ? m_dependencies[uiIndex].second
+                                           : 0;
+  }
   // OCLFEBinaryResult
 public:
-  OCLFEBinaryResult()
-      : m_type(Intel::OpenCL::ClangFE::IR_TYPE_UNKNOWN), m_result(CL_SUCCESS) {}
+  // The IR is written to the caller's output buffer if one is given
+  explicit OCLFEBinaryResult(
+      Intel::OpenCL::ClangFE::IOCLFEOutputBuffer *pOutput = nullptr)
+      : m_IRBuffer(pOutput), m_type(Intel::OpenCL::ClangFE::IR_TYPE_UNKNOWN),
+        m_result(CL_SUCCESS), m_peakAllocatedBytes(0) {}
+
+  ~OCLFEBinaryResult() {
+    // the translation writes to the result
+    waitForSPIRV();
+  }
 
-  llvm::SmallVectorImpl<char> &getIRBufferRef() { return m_IRBuffer; }
+  HostBuffer &getIRBufferRef() { return m_IRBuffer; }
 
+  // The text of the log not coming from the diagnostics
   std::string &getLogRef() { return m_log; }
 
+  const std::string &getLog() const {
+    waitForSPIRV();
+    return m_log;
+  }
+
+  DiagnosticArena &getDiagnosticsRef() { return m_diagnostics; }
+
+  const DiagnosticArena &getDiagnosticsRef() const { return m_diagnostics; }
+
   void setLog(const std::string &log) { m_log = log; }
 
   void setIRName(const std::string &name) { m_IRName = name; }
 
   void setIRType(Intel::OpenCL::ClangFE::IR_TYPE type) { m_type = type; }
 
+  // Sets the name of the first output, LLVMBitcodeOutputName by default
+  void setIRFormat(const char *format) { m_IRFormat = format; }
+
+  // The SPIR-V kept next to the LLVM IR with -emit-bitcode-and-spirv
+  HostBuffer &getSPIRVBufferRef() { return m_SPIRVBuffer; }
+
+  // Sets the translation to SPIR-V running in the background, which writes
+  // the SPIR-V buffer and appends its errors to the log, and tells if it
+  // succeeded
+  void setSPIRVTranslation(std::shared_future<bool> translation) {
+    m_SPIRVTranslation = std::move(translation);
+  }
+
+  // Records a file read by the compile along with the hash of its content
+  void addDependency(std::string name, uint64_t hash) {
+    m_dependencies.emplace_back(std::move(name), hash);
+  }
+
   void setResult(int result) { m_result = result; }
 
   int getResult(void) const { return m_result; }
 
+  void setPeakAllocatedBytes(size_t bytes) { m_peakAllocatedBytes = bytes; }
+
 private:
-  llvm::SmallVector<char, 4096> m_IRBuffer;
+  // Returns false if the translation to SPIR-V failed or there is none
+  bool waitForSPIRV() const {
+    return m_SPIRVTranslation.valid() && m_SPIRVTranslation.get();
+  }
+
+  HostBuffer m_IRBuffer;
   std::string m_log;
+  DiagnosticArena m_diagnostics;
+  mutable std::once_flag m_renderOnce;
+  mutable std::string m_renderedLog;
   std::string m_IRName;
   Intel::OpenCL::ClangFE::IR_TYPE m_type;
   int m_result;
+  size_t m_peakAllocatedBytes;
+  const char *m_IRFormat = LLVMBitcodeOutputName;
+  HostBuffer m_SPIRVBuffer;
+  std::shared_future<bool> m_SPIRVTranslation;
+  std::vector<std::pair<std::string, uint64_t>> m_dependencies;
+  std::atomic<unsigned> m_refCount{1};
 };
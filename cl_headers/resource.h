@@ -37,6 +37,38 @@ Copyright (c) Intel Corporation (2009-2017).
 #define OPENCL_C_20_SPIR64_FP64_PCM    "OPENCL_C_20_SPIR64_FP64_PCM"
 #define OPENCL_C_30_SPIR64_FP64_PCM    "OPENCL_C_30_SPIR64_FP64_PCM"
 #define OPENCL_C_31_SPIR64_FP64_PCM    "OPENCL_C_31_SPIR64_FP64_PCM"
+#define OPENCL_C_12_SPIRV32_PCM        "OPENCL_C_12_SPIRV32_PCM"
+#define OPENCL_C_12_SPIRV32_FP64_PCM   "OPENCL_C_12_SPIRV32_FP64_PCM"
+#define OPENCL_C_20_SPIRV32_PCM        "OPENCL_C_20_SPIRV32_PCM"
+#define OPENCL_C_20_SPIRV32_FP64_PCM   "OPENCL_C_20_SPIRV32_FP64_PCM"
+#define OPENCL_C_30_SPIRV32_PCM        "OPENCL_C_30_SPIRV32_PCM"
+#define OPENCL_C_30_SPIRV32_FP64_PCM   "OPENCL_C_30_SPIRV32_FP64_PCM"
+#define OPENCL_C_31_SPIRV32_PCM        "OPENCL_C_31_SPIRV32_PCM"
+#define OPENCL_C_31_SPIRV32_FP64_PCM   "OPENCL_C_31_SPIRV32_FP64_PCM"
+#define OPENCL_C_12_SPIRV64_PCM        "OPENCL_C_12_SPIRV64_PCM"
+#define OPENCL_C_12_SPIRV64_FP64_PCM   "OPENCL_C_12_SPIRV64_FP64_PCM"
+#define OPENCL_C_20_SPIRV64_PCM        "OPENCL_C_20_SPIRV64_PCM"
+#define OPENCL_C_20_SPIRV64_FP64_PCM   "OPENCL_C_20_SPIRV64_FP64_PCM"
+#define OPENCL_C_30_SPIRV64_PCM        "OPENCL_C_30_SPIRV64_PCM"
+#define OPENCL_C_30_SPIRV64_FP64_PCM   "OPENCL_C_30_SPIRV64_FP64_PCM"
+#define OPENCL_C_31_SPIRV64_PCM        "OPENCL_C_31_SPIRV64_PCM"
+#define OPENCL_C_31_SPIRV64_FP64_PCM   "OPENCL_C_31_SPIRV64_FP64_PCM"
+#define OPENCL_CPP_10_SPIR_PCM         "OPENCL_CPP_10_SPIR_PCM"
+#define OPENCL_CPP_10_SPIR_FP64_PCM    "OPENCL_CPP_10_SPIR_FP64_PCM"
+#define OPENCL_CPP_2021_SPIR_PCM       "OPENCL_CPP_2021_SPIR_PCM"
+#define OPENCL_CPP_2021_SPIR_FP64_PCM  "OPENCL_CPP_2021_SPIR_FP64_PCM"
+#define OPENCL_CPP_10_SPIR64_PCM       "OPENCL_CPP_10_SPIR64_PCM"
+#define OPENCL_CPP_10_SPIR64_FP64_PCM  "OPENCL_CPP_10_SPIR64_FP64_PCM"
+#define OPENCL_CPP_2021_SPIR64_PCM     "OPENCL_CPP_2021_SPIR64_PCM"
+#define OPENCL_CPP_2021_SPIR64_FP64_PCM "OPENCL_CPP_2021_SPIR64_FP64_PCM"
+#define OPENCL_CPP_10_SPIRV32_PCM      "OPENCL_CPP_10_SPIRV32_PCM"
+#define OPENCL_CPP_10_SPIRV32_FP64_PCM "OPENCL_CPP_10_SPIRV32_FP64_PCM"
+#define OPENCL_CPP_2021_SPIRV32_PCM    "OPENCL_CPP_2021_SPIRV32_PCM"
+#define OPENCL_CPP_2021_SPIRV32_FP64_PCM "OPENCL_CPP_2021_SPIRV32_FP64_PCM"
+#define OPENCL_CPP_10_SPIRV64_PCM      "OPENCL_CPP_10_SPIRV64_PCM"
+#define OPENCL_CPP_10_SPIRV64_FP64_PCM "OPENCL_CPP_10_SPIRV64_FP64_PCM"
+#define OPENCL_CPP_2021_SPIRV64_PCM    "OPENCL_CPP_2021_SPIRV64_PCM"
+#define OPENCL_CPP_2021_SPIRV64_FP64_PCM "OPENCL_CPP_2021_SPIRV64_FP64_PCM"
 #define OPENCL_C_MODULE_MAP            "OPENCL_C_MODULE_MAP"
 
 #endif /* __RESOURCE__ */
@@ -0,0 +1,228 @@
+/*****************************************************************************\
+
+Copyright (c) Intel Corporation (2009-2017).
+
+    INTEL MAKES NO WARRANTY OF ANY KIND REGARDING THE CODE.  THIS CODE IS
+    LICENSED ON AN "AS IS" BASIS AND INTEL WILL NOT PROVIDE ANY SUPPORT,
+    ASSISTANCE, INSTALLATION, TRAINING OR OTHER SERVICES.  INTEL DOES NOT
+    PROVIDE ANY UPDATES, ENHANCEMENTS OR EXTENSIONS.  INTEL SPECIFICALLY
+    DISCLAIMS ANY WARRANTY OF MERCHANTABILITY, NONINFRINGEMENT, FITNESS FOR ANY
+    PARTICULAR PURPOSE, OR ANY OTHER WARRANTY.  Intel disclaims all liability,
+    including liability for infringement of any proprietary rights, relating to
+    use of the code. No license, express or implied, by estoppel or otherwise,
+    to any intellectual property rights is granted herein.
+
+  \file compile_capture.cpp
+
+\*****************************************************************************/
+
+#include "compile_capture.h"
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace {
+
+const char CaptureMagic[] = "OCLCAP1\n";
+const uint32_t NullString = 0xFFFFFFFF;
+
+// Records are dropped rather than queued past this size, so a slow disk
+// can't make the capture eat up the memory
+const size_t MaxPendingBytes = 256 * 1024 * 1024;
+
+struct CaptureRecord {
+  CaptureRecord *next = nullptr;
+  std::string data;
+};
+
+void appendU32(std::string &out, uint32_t value) {
+  for (int i = 0; i < 4; ++i)
+    out += static_cast<char>((value >> (8 * i)) & 0xFF);
+}
+
+void appendU64(std::string &out, uint64_t value) {
+  for (int i = 0; i < 8; ++i)
+    out += static_cast<char>((value >> (8 * i)) & 0xFF);
+}
+
+void appendString(std::string &out, const char *str) {
+  if (!str) {
+    appendU32(out, NullString);
+    return;
+  }
+  size_t len = strlen(str);
+  appendU32(out, static_cast<uint32_t>(len));
+  out.append(str, len);
+}
+
+//
+// Capture log file fed by a lock-free multi-producer queue. The compiling
+// threads push the records onto an atomic list, the writer thread takes the
+// whole list at once and writes it out in the order of the capture.
+//
+// The compile workers inherit the log file and capture the compiles forwarded
+// to them, so several processes append to the same file. Every record goes
+// out in a single write to the file opened for appending, so the records of
+// the processes don't interleave.
+//
+class CaptureLog {
+public:
+  // Returns the capture log, or nullptr if the capture is disabled
+  static CaptureLog *get() {
+    static CaptureLog *log = create();
+    return log;
+  }
+
+  void push(CaptureRecord *record) {
+    size_t size = record->data.size();
+    if (m_pendingBytes.fetch_add(size) + size > MaxPendingBytes) {
+      m_pendingBytes.fetch_sub(size);
+      ++m_dropped;
+      delete record;
+      return;
+    }
+
+    record->next = m_head.load(std::memory_order_relaxed);
+    while (!m_head.compare_exchange_weak(record->next, record,
+                                         std::memory_order_release,
+                                         std::memory_order_relaxed))
+      ;
+    m_wake.notify_one();
+  }
+
+private:
+  explicit CaptureLog(int fd)
+      : m_out(fd, /*shouldClose=*/true, /*unbuffered=*/true) {
+    m_writer = std::thread([this]() { run(); });
+  }
+
+  static CaptureLog *create() {
+    const char *path = getenv("CCLANG_CAPTURE_FILE");
+    if (!path || !*path)
+      return nullptr;
+
+    int fd;
+    if (llvm::sys::fs::openFileForWrite(path, fd,
+                                        llvm::sys::fs::CD_OpenAlways,
+                                        llvm::sys::fs::OF_Append))
+      return nullptr;
+    // A new log starts with the magic, an existing one is appended to. The
+    // lock makes sure a single process finds the log empty and writes it.
+    if (llvm::sys::fs::lockFile(fd)) {
+      llvm::sys::Process::SafelyCloseFileDescriptor(fd);
+      return nullptr;
+    }
+    llvm::sys::fs::file_status status;
+    bool empty = !llvm::sys::fs::status(fd, status) && status.getSize() == 0;
+    CaptureLog *log = new CaptureLog(fd);
+    if (empty)
+      log->m_out.write(CaptureMagic, sizeof(CaptureMagic) - 1);
+    llvm::sys::fs::unlockFile(fd);
+
+    // The queued records are written out when the process exits
+    atexit([]() { get()->stop(); });
+    return log;
+  }
+
+  void run() {
+    while (!m_stopped.load()) {
+      drain();
+      std::unique_lock<std::mutex> lock(m_lock);
+      // the pushes don't take the lock, so a wake up could be missed and
+      // the timeout bounds the delay then
+      m_wake.wait_for(lock, std::chrono::milliseconds(100));
+    }
+    drain();
+  }
+
+  void drain() {
+    CaptureRecord *list = m_head.exchange(nullptr, std::memory_order_acquire);
+    if (!list)
+      return;
+
+    // the list is in the reverse order of the pushes
+    CaptureRecord *ordered = nullptr;
+    while (list) {
+      CaptureRecord *next = list->next;
+      list->next = ordered;
+      ordered = list;
+      list = next;
+    }
+
+    while (ordered) {
+      CaptureRecord *next = ordered->next;
+      m_out.write(ordered->data.data(), ordered->data.size());
+      m_pendingBytes.fetch_sub(ordered->data.size());
+      delete ordered;
+      ordered = next;
+    }
+  }
+
+  void stop() {
+    m_stopped.store(true);
+    m_wake.notify_one();
+    if (m_writer.joinable())
+      m_writer.join();
+    m_out.close();
+    // a failed write is not worth a fatal error at exit
+    m_out.clear_error();
+    if (m_dropped)
+      fprintf(stderr, "opencl-clang: %zu compile captures were dropped\n",
+              m_dropped.load());
+  }
+
+  llvm::raw_fd_ostream m_out;
+  std::atomic<CaptureRecord *> m_head{nullptr};
+  std::atomic<size_t> m_pendingBytes{0};
+  std::atomic<size_t> m_dropped{0};
+  std::atomic<bool> m_stopped{false};
+  std::mutex m_lock;
+  std::condition_variable m_wake;
+  std::thread m_writer;
+};
+
+} // namespace
+
+void CaptureCompile(const char *pszProgramSource, const char **pInputHeaders,
+                    unsigned int uiNumInputHeaders,
+                    const char **pInputHeadersNames, const char *pszOptions,
+                    const char *pszOptionsEx, const char *pszOpenCLVer) {
+  CaptureLog *log = CaptureLog::get();
+  if (!log)
+    return;
+
+  CaptureRecord *record = new CaptureRecord();
+  std::string &data = record->data;
+  // the payload size is patched in once the payload is complete
+  appendU32(data, 0);
+  appendU64(data, std::chrono::duration_cast<std::chrono::microseconds>(
+                      std::chrono::system_clock::now().time_since_epoch())
+                      .count());
+  appendString(data, pszOpenCLVer);
+  appendString(data, pszOptions);
+  appendString(data, pszOptionsEx);
+  appendString(data, pszProgramSource);
+  appendU32(data, uiNumInputHeaders);
+  for (unsigned int i = 0; i < uiNumInputHeaders; ++i) {
+    appendString(data, pInputHeadersNames[i]);
+    appendString(data, pInputHeaders[i]);
+  }
+
+  std::string size;
+  appendU32(size, static_cast<uint32_t>(data.size() - 4));
+  data.replace(0, 4, size);
+  log->push(record);
+}
@@ -0,0 +1,47 @@
+/*****************************************************************************\
+
+Copyright (c) Intel Corporation (2009-2017).
+
+    INTEL MAKES NO WARRANTY OF ANY KIND REGARDING THE CODE.  THIS CODE IS
+    LICENSED ON AN "AS IS" BASIS AND INTEL WILL NOT PROVIDE ANY SUPPORT,
+    ASSISTANCE, INSTALLATION, TRAINING OR OTHER SERVICES.  INTEL DOES NOT
+    PROVIDE ANY UPDATES, ENHANCEMENTS OR EXTENSIONS.  INTEL SPECIFICALLY
+    DISCLAIMS ANY WARRANTY OF MERCHANTABILITY, NONINFRINGEMENT, FITNESS FOR ANY
+    PARTICULAR PURPOSE, OR ANY OTHER WARRANTY.  Intel disclaims all liability,
+    including liability for infringement of any proprietary rights, relating to
+    use of the code. No license, express or implied, by estoppel or otherwise,
+    to any intellectual property rights is granted herein.
+
+  \file compile_capture.h
+
+  \brief Capture of the Compile inputs for replaying them later
+
+\*****************************************************************************/
+
+#pragma once
+
+#include <cstddef>
+
+//
+// Records the inputs of the compile to the capture log, if the capture is
+// enabled by the CCLANG_CAPTURE_FILE environment variable. The record is
+// queued and written to the file by a background thread, so the compile is
+// not delayed by the file I/O.
+//
+// The capture log is appendable: it starts with the "OCLCAP1\n" magic, which
+// is followed by the records. A record is its payload size as uint32_t and the
+// payload:
+//    uint64_t - time of the capture, in microseconds since the epoch
+//    string   - OpenCL version
+//    string   - options
+//    string   - extra options
+//    string   - program source
+//    uint32_t - number of the input headers, followed by the name and the
+//               content string of every header
+// A string is its length as uint32_t followed by the characters, a NULL
+// string has the length of 0xFFFFFFFF. All the integers are little-endian.
+//
+void CaptureCompile(const char *pszProgramSource, const char **pInputHeaders,
+                    unsigned int uiNumInputHeaders,
+                    const char **pInputHeadersNames, const char *pszOptions,
+                    const char *pszOptionsEx, const char *pszOpenCLVer);
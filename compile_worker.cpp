@@ -0,0 +1,891 @@
+/*****************************************************************************\
+
+Copyright (c) Intel Corporation (2009-2017).
+
+    INTEL MAKES NO WARRANTY OF ANY KIND REGARDING THE CODE.  THIS CODE IS
+    LICENSED ON AN "AS IS" BASIS AND INTEL WILL NOT PROVIDE ANY SUPPORT,
+    ASSISTANCE, INSTALLATION, TRAINING OR OTHER SERVICES.  INTEL DOES NOT
+    PROVIDE ANY UPDATES, ENHANCEMENTS OR EXTENSIONS.  INTEL SPECIFICALLY
+    DISCLAIMS ANY WARRANTY OF MERCHANTABILITY, NONINFRINGEMENT, FITNESS FOR ANY
+    PARTICULAR PURPOSE, OR ANY OTHER WARRANTY.  Intel disclaims all liability,
+    including liability for infringement of any proprietary rights, relating to
+    use of the code. No license, express or implied, by estoppel or otherwise,
+    to any intellectual property rights is granted herein.
+
+  \file compile_worker.cpp
+
+\*****************************************************************************/
+
+#include "compile_worker.h"
+#include "binary_result.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+#endif
+
+// The following #defines are used as return value of Compile() API and defined
+// in https://github.com/KhronosGroup/OpenCL-Headers/blob/master/CL/cl.h
+#define CL_COMPILE_PROGRAM_FAILURE -15
+#define CL_OUT_OF_HOST_MEMORY -6
+
+using namespace Intel::OpenCL::ClangFE;
+
+#if defined(__linux__)
+
+namespace {
+
+const char *const DefaultWorkerName = "opencl-clang-worker";
+
+// The worker gets its end of the socket as this file descriptor.
+const int WorkerSocketFd = 3;
+
+const uint32_t MessageMagic = 0x57434f4f; // "OOCW"
+const uint64_t NullBlob = ~uint64_t(0);
+
+//
+// The header of every message sent over the socket. The payload itself is
+// passed in a shared memory file whose descriptor is attached to the message,
+// so neither the sources nor the results are copied through the socket.
+//
+struct MessageHeader {
+  uint32_t magic;
+  uint32_t reserved;
+  uint64_t size;
+};
+
+//
+// Serializes the message payload. Constructed without a buffer it only
+// computes the size of the payload.
+//
+class MessageWriter {
+public:
+  explicit MessageWriter(char *data = nullptr) : m_data(data), m_size(0) {}
+
+  void writeU64(uint64_t value) { write(&value, sizeof(value)); }
+
+  // Blobs are padded, so every field and blob data stays 8 bytes aligned
+  void writeBlob(const void *data, size_t size) {
+    if (!data) {
+      writeU64(NullBlob);
+      return;
+    }
+    static const char padding[8] = {};
+    writeU64(size);
+    write(data, size);
+    write(padding, (8 - size % 8) % 8);
+  }
+
+  // Strings are written along with the terminating null
+  void writeString(const char *str) {
+    writeBlob(str, str ? strlen(str) + 1 : 0);
+  }
+
+  size_t size() const { return m_size; }
+
+private:
+  void write(const void *data, size_t size) {
+    if (m_data && size)
+      memcpy(m_data + m_size, data, size);
+    m_size += size;
+  }
+
+  char *m_data;
+  size_t m_size;
+};
+
+//
+// Parses the message payload in place, the blobs point into the message
+//
+class MessageReader {
+public:
+  MessageReader(const char *data, size_t size)
+      : m_data(data), m_size(size), m_pos(0), m_failed(false) {}
+
+  uint64_t readU64() {
+    uint64_t value = 0;
+    if (m_size - m_pos < sizeof(value)) {
+      m_failed = true;
+      return 0;
+    }
+    memcpy(&value, m_data + m_pos, sizeof(value));
+    m_pos += sizeof(value);
+    return value;
+  }
+
+  // Returns nullptr for a null blob
+  const char *readBlob(size_t &size) {
+    size = 0;
+    uint64_t blobSize = readU64();
+    if (m_failed || blobSize == NullBlob)
+      return nullptr;
+    if (blobSize > m_size - m_pos ||
+        blobSize + (8 - blobSize % 8) % 8 > m_size - m_pos) {
+      m_failed = true;
+      return nullptr;
+    }
+    const char *blob = m_data + m_pos;
+    m_pos += blobSize + (8 - blobSize % 8) % 8;
+    size = blobSize;
+    return blob;
+  }
+
+  const char *readString() {
+    size_t size;
+    const char *str = readBlob(size);
+    if (str && (size == 0 || str[size - 1] != '\0')) {
+      m_failed = true;
+      return nullptr;
+    }
+    return str;
+  }
+
+  bool failed() const { return m_failed; }
+
+private:
+  const char *m_data;
+  size_t m_size;
+  size_t m_pos;
+  bool m_failed;
+};
+
+//
+// Mapping of a shared memory file holding a message payload
+//
+class SharedMemory {
+public:
+  SharedMemory() = default;
+  SharedMemory(const SharedMemory &) = delete;
+  SharedMemory &operator=(const SharedMemory &) = delete;
+  ~SharedMemory() { reset(); }
+
+  // Creates a new shared memory file mapped for writing
+  bool create(size_t size) {
+    reset();
+    m_fd = memfd_create("opencl-clang", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (m_fd < 0 || ftruncate(m_fd, size) != 0)
+      return false;
+    // The receiver maps the file, so it mustn't be shrunk under its feet
+    if (fcntl(m_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) !=
+        0)
+      return false;
+    return map(size, PROT_READ | PROT_WRITE);
+  }
+
+  // Maps the shared memory file received from the peer for reading, takes the
+  // ownership of the file descriptor
+  bool open(int fd, uint64_t size) {
+    reset();
+    m_fd = fd;
+    struct stat st;
+    int seals = fcntl(fd, F_GET_SEALS);
+    if (fstat(fd, &st) != 0 || static_cast<uint64_t>(st.st_size) < size ||
+        seals < 0 || (seals & F_SEAL_SHRINK) == 0)
+      return false;
+    return map(size, PROT_READ);
+  }
+
+  void reset() {
+    if (m_data)
+      munmap(m_data, m_size);
+    if (m_fd >= 0)
+      close(m_fd);
+    m_fd = -1;
+    m_data = nullptr;
+    m_size = 0;
+  }
+
+  int fd() const { return m_fd; }
+  char *data() const { return m_data; }
+  size_t size() const { return m_size; }
+
+private:
+  bool map(size_t size, int prot) {
+    void *data = mmap(nullptr, size, prot, MAP_SHARED, m_fd, 0);
+    if (data == MAP_FAILED)
+      return false;
+    m_data = static_cast<char *>(data);
+    m_size = size;
+    return true;
+  }
+
+  int m_fd = -1;
+  char *m_data = nullptr;
+  size_t m_size = 0;
+};
+
+// Creates a shared memory file holding the payload serialized by 'write'
+template <class WriteFn>
+bool createMessage(SharedMemory &message, WriteFn write) {
+  MessageWriter sizer;
+  write(sizer);
+  if (!message.create(sizer.size()))
+    return false;
+  MessageWriter writer(message.data());
+  write(writer);
+  return true;
+}
+
+bool sendMessage(int sock, const SharedMemory &message) {
+  MessageHeader header = {MessageMagic, 0, message.size()};
+  iovec iov = {&header, sizeof(header)};
+  union {
+    char buf[CMSG_SPACE(sizeof(int))];
+    cmsghdr align;
+  } control;
+  memset(&control, 0, sizeof(control));
+
+  msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+  cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  int fd = message.fd();
+  memcpy(CMSG_DATA(cmsg), &fd, sizeof(fd));
+
+  ssize_t sent;
+  do {
+    sent = sendmsg(sock, &msg, MSG_NOSIGNAL);
+  } while (sent < 0 && errno == EINTR);
+  return sent == static_cast<ssize_t>(sizeof(header));
+}
+
+// Returns the descriptor of the shared memory file attached to the received
+// message, or -1 if the peer has closed the connection or the message is
+// malformed
+int recvMessage(int sock, uint64_t &size) {
+  MessageHeader header;
+  iovec iov = {&header, sizeof(header)};
+  union {
+    char buf[CMSG_SPACE(sizeof(int))];
+    cmsghdr align;
+  } control;
+
+  msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+
+  ssize_t received;
+  do {
+    received = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+  } while (received < 0 && errno == EINTR);
+  if (received <= 0)
+    return -1;
+
+  int fd = -1;
+  cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  if (cmsg && cmsg->cmsg_level == SOL_SOCKET &&
+      cmsg->cmsg_type == SCM_RIGHTS && cmsg->cmsg_len == CMSG_LEN(sizeof(int)))
+    memcpy(&fd, CMSG_DATA(cmsg), sizeof(fd));
+
+  if (received != static_cast<ssize_t>(sizeof(header)) ||
+      header.magic != MessageMagic || (msg.msg_flags & MSG_CTRUNC)) {
+    if (fd >= 0)
+      close(fd);
+    return -1;
+  }
+  size = header.size;
+  return fd;
+}
+
+//
+// Compilation results received from a worker. The IR, the name and the
+// diagnostics are referenced in place in the shared memory of the response,
+// the log is rendered from the diagnostics on demand.
+//
+class WorkerBinaryResult : public IOCLFEBinaryResult2 {
+  // IOCLFEBinaryResult
+public:
+  size_t GetIRSize() const override { return m_IRSize; }
+
+  const void *GetIR() const override { return m_IR; }
+
+  const char *GetIRName() const override { return m_IRName; }
+
+  IR_TYPE GetIRType() const override { return m_type; }
+
+  const char *GetErrorLog() const override {
+    std::call_once(m_renderOnce, [this]() {
+      RenderDiagnostics(m_diagnostics, m_numDiagnostics, m_strings,
+                        m_showColumn, m_showCarets, m_renderedLog);
+      m_renderedLog += m_log;
+    });
+    return m_renderedLog.c_str();
+  }
+
+  void Release() override {
+    if (m_refCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+      delete this;
+  }
+  // IOCLFEBinaryResult2
+public:
+  size_t GetPeakAllocatedBytes() const override { return m_peakAllocatedBytes; }
+
+  unsigned int GetDiagnosticCount() const override { return m_numDiagnostics; }
+
+  const OCLFEDiagnostic *GetDiagnostics() const override {
+    return m_diagnostics;
+  }
+
+  const OCLFEFixIt *GetFixIts() const override { return m_fixIts; }
+
+  const char *GetDiagnosticStrings() const override { return m_strings; }
+
+  void Retain() override { m_refCount.fetch_add(1, std::memory_order_relaxed); }
+
+  unsigned int GetOutputCount() const override {
+    return static_cast<unsigned int>(m_outputs.size()) + 1;
+  }
+
+  const char *GetOutputName(unsigned int uiIndex) const override {
+    if (uiIndex == 0)
+      return m_IRFormat;
+    return uiIndex <= m_outputs.size() ? m_outputs[uiIndex - 1].name : nullptr;
+  }
+
+  const void *GetOutput(unsigned int uiIndex) const override {
+    if (uiIndex == 0)
+      return m_IR;
+    return uiIndex <= m_outputs.size() ? m_outputs[uiIndex - 1].data : nullptr;
+  }
+
+  size_t GetOutputSize(unsigned int uiIndex) const override {
+    if (uiIndex == 0)
+      return m_IRSize;
+    return uiIndex <= m_outputs.size() ? m_outputs[uiIndex - 1].size : 0;
+  }
+
+  unsigned int GetDependencyCount() const override {
+    return static_cast<unsigned int>(m_dependencies.size());
+  }
+
+  const char *GetDependencyName(unsigned int uiIndex) const override {
+    return uiIndex < m_dependencies.size() ? m_dependencies[uiIndex].name
+                                           : nullptr;
+  }
+
+  unsigned long long GetDependencyHash(unsigned int uiIndex) const override {
+    return uiIndex < m_dependencies.size() ? m_dependencies[uiIndex].hash : 0;
+  }
+  // WorkerBinaryResult
+public:
+  // Maps and parses the response, takes the ownership of the descriptor
+  bool parse(int fd, uint64_t size, int &result, bool &hasResult) {
+    if (!m_response.open(fd, size))
+      return false;
+    MessageReader reader(m_response.data(), m_response.size());
+    result = static_cast<int>(static_cast<int64_t>(reader.readU64()));
+    hasResult = reader.readU64() != 0;
+    if (!hasResult)
+      return !reader.failed();
+
+    uint64_t type = reader.readU64();
+    m_type = type <= IR_TYPE_COMPILED_OBJECT ? static_cast<IR_TYPE>(type)
+                                             : IR_TYPE_UNKNOWN;
+    m_peakAllocatedBytes = reader.readU64();
+    m_IR = reader.readBlob(m_IRSize);
+    const char *format = reader.readString();
+    m_IRFormat = format ? format : LLVMBitcodeOutputName;
+    uint64_t numOutputs = reader.readU64();
+    for (uint64_t i = 0; i < numOutputs && !reader.failed(); ++i) {
+      Output output;
+      const char *outputName = reader.readString();
+      output.name = outputName ? outputName : "";
+      output.data = reader.readBlob(output.size);
+      m_outputs.push_back(output);
+    }
+    const char *name = reader.readString();
+    const char *log = reader.readString();
+    m_IRName = name ? name : "";
+    m_log = log ? log : "";
+    uint64_t numDependencies = reader.readU64();
+    for (uint64_t i = 0; i < numDependencies && !reader.failed(); ++i) {
+      Dependency dependency;
+      const char *dependencyName = reader.readString();
+      dependency.name = dependencyName ? dependencyName : "";
+      dependency.hash = reader.readU64();
+      m_dependencies.push_back(dependency);
+    }
+
+    // The diagnostics arena is relocatable, as it refers to the strings by
+    // offsets
+    uint64_t numDiagnostics = reader.readU64();
+    uint64_t numFixIts = reader.readU64();
+    m_showColumn = reader.readU64() != 0;
+    m_showCarets = reader.readU64() != 0;
+    size_t arenaSize;
+    const char *arena = reader.readBlob(arenaSize);
+    if (reader.failed())
+      return false;
+    if (numDiagnostics == 0)
+      return true;
+    uint64_t stringsOffset = numDiagnostics * sizeof(OCLFEDiagnostic) +
+                             numFixIts * sizeof(OCLFEFixIt);
+    if (!arena || numDiagnostics > arenaSize || numFixIts > arenaSize ||
+        stringsOffset >= arenaSize || arena[arenaSize - 1] != '\0')
+      return false;
+    m_numDiagnostics = static_cast<unsigned int>(numDiagnostics);
+    m_diagnostics = reinterpret_cast<const OCLFEDiagnostic *>(arena);
+    m_fixIts = reinterpret_cast<const OCLFEFixIt *>(
+        arena + numDiagnostics * sizeof(OCLFEDiagnostic));
+    m_strings = arena + stringsOffset;
+    return true;
+  }
+
+  // Copies the IR to the caller's output buffer, which it's then referenced
+  // in, returns false if the buffer fails to grow
+  bool copyIR(IOCLFEOutputBuffer *pOutput) {
+    if (m_IRSize == 0)
+      return true;
+    void *data = pOutput->Grow(m_IRSize);
+    if (!data)
+      return false;
+    memcpy(data, m_IR, m_IRSize);
+    m_IR = static_cast<const char *>(data);
+    return true;
+  }
+
+private:
+  // Output past the first one, referenced in the response
+  struct Output {
+    const char *name;
+    const char *data;
+    size_t size;
+  };
+
+  // File read by the compile, the name is referenced in the response
+  struct Dependency {
+    const char *name;
+    uint64_t hash;
+  };
+
+  SharedMemory m_response;
+  const char *m_IR = nullptr;
+  size_t m_IRSize = 0;
+  const char *m_IRFormat = LLVMBitcodeOutputName;
+  std::vector<Output> m_outputs;
+  std::vector<Dependency> m_dependencies;
+  const char *m_IRName = "";
+  const char *m_log = "";
+  IR_TYPE m_type = IR_TYPE_UNKNOWN;
+  size_t m_peakAllocatedBytes = 0;
+  unsigned int m_numDiagnostics = 0;
+  const OCLFEDiagnostic *m_diagnostics = nullptr;
+  const OCLFEFixIt *m_fixIts = nullptr;
+  const char *m_strings = nullptr;
+  bool m_showColumn = true;
+  bool m_showCarets = true;
+  mutable std::once_flag m_renderOnce;
+  mutable std::string m_renderedLog;
+  std::atomic<unsigned> m_refCount{1};
+};
+
+struct Worker {
+  pid_t pid = -1;
+  int socket = -1;
+  bool busy = false;
+};
+
+//
+// Pool of the worker processes. A worker is restarted as soon as it crashes or
+// exceeds the time limit, so the next request finds it ready.
+//
+class CompileWorkerPool {
+public:
+  CompileWorkerPool(const std::string &path, unsigned timeoutMs)
+      : m_path(path), m_timeoutMs(timeoutMs) {}
+
+  ~CompileWorkerPool() {
+    for (auto &worker : m_workers)
+      terminate(worker, /*force=*/false);
+  }
+
+  bool start(unsigned numWorkers) {
+    m_workers.resize(numWorkers);
+    for (auto &worker : m_workers)
+      if (!spawn(worker))
+        return false;
+    return true;
+  }
+
+  int compile(const SharedMemory &request, IOCLFEOutputBuffer *pOutput,
+              IOCLFEBinaryResult **pBinaryResult);
+
+private:
+  bool spawn(Worker &worker);
+  int terminate(Worker &worker, bool force);
+  int transact(Worker &worker, const SharedMemory &request,
+               uint64_t &responseSize, std::string &error,
+               bool &undelivered);
+  Worker &acquire();
+  void release(Worker &worker);
+
+  std::string m_path;
+  unsigned m_timeoutMs;
+  std::mutex m_lock;
+  std::condition_variable m_available;
+  // Not resized after start, so the references to the workers stay valid
+  std::vector<Worker> m_workers;
+};
+
+bool CompileWorkerPool::spawn(Worker &worker) {
+  int sockets[2];
+  if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sockets) != 0)
+    return false;
+
+  // dup2 clears the close-on-exec flag of the worker end, unless it already
+  // is the descriptor the worker expects
+  int workerEnd = sockets[1];
+  if (workerEnd == WorkerSocketFd) {
+    workerEnd = fcntl(sockets[1], F_DUPFD_CLOEXEC, WorkerSocketFd + 1);
+    close(sockets[1]);
+    if (workerEnd < 0) {
+      close(sockets[0]);
+      return false;
+    }
+  }
+
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_adddup2(&actions, workerEnd, WorkerSocketFd);
+
+  std::string fdArg = "--fd=" + std::to_string(WorkerSocketFd);
+  char *argv[] = {const_cast<char *>(m_path.c_str()),
+                  const_cast<char *>(fdArg.c_str()), nullptr};
+  pid_t pid;
+  int err = posix_spawnp(&pid, m_path.c_str(), &actions, nullptr, argv, environ);
+  posix_spawn_file_actions_destroy(&actions);
+  close(workerEnd);
+  if (err != 0) {
+    close(sockets[0]);
+    return false;
+  }
+
+  worker.pid = pid;
+  worker.socket = sockets[0];
+  return true;
+}
+
+// Returns the wait status of the worker
+int CompileWorkerPool::terminate(Worker &worker, bool force) {
+  if (worker.pid < 0)
+    return 0;
+  if (force)
+    kill(worker.pid, SIGKILL);
+  // The worker exits once its socket is closed
+  close(worker.socket);
+  int status = 0;
+  while (waitpid(worker.pid, &status, 0) < 0 && errno == EINTR)
+    ;
+  worker.pid = -1;
+  worker.socket = -1;
+  return status;
+}
+
+// Sends the request and waits for the response. Returns the descriptor of the
+// response, or -1 and the reason of the failure in 'error'. 'undelivered' is
+// set if the request couldn't be sent, the worker was gone before it got it.
+int CompileWorkerPool::transact(Worker &worker, const SharedMemory &request,
+                                uint64_t &responseSize, std::string &error,
+                                bool &undelivered) {
+  undelivered = false;
+  if (worker.pid < 0 && !spawn(worker)) {
+    error = "failed to start " + m_path;
+    return -1;
+  }
+
+  bool sent = sendMessage(worker.socket, request);
+  if (sent) {
+    pollfd pfd = {worker.socket, POLLIN, 0};
+    int ready;
+    do {
+      ready = poll(&pfd, 1, m_timeoutMs ? static_cast<int>(m_timeoutMs) : -1);
+    } while (ready < 0 && errno == EINTR);
+
+    if (ready == 0) {
+      terminate(worker, /*force=*/true);
+      error = "compile worker timed out after " +
+              std::to_string(m_timeoutMs) + " ms";
+      return -1;
+    }
+
+    int fd = recvMessage(worker.socket, responseSize);
+    if (fd >= 0)
+      return fd;
+  }
+
+  undelivered = !sent;
+  int status = terminate(worker, /*force=*/true);
+  if (WIFSIGNALED(status))
+    error = "compile worker terminated by signal " +
+            std::to_string(WTERMSIG(status));
+  else
+    error = "compile worker exited unexpectedly";
+  return -1;
+}
+
+Worker &CompileWorkerPool::acquire() {
+  std::unique_lock<std::mutex> lock(m_lock);
+  for (;;) {
+    for (auto &worker : m_workers) {
+      if (!worker.busy) {
+        worker.busy = true;
+        return worker;
+      }
+    }
+    m_available.wait(lock);
+  }
+}
+
+void CompileWorkerPool::release(Worker &worker) {
+  {
+    std::lock_guard<std::mutex> lock(m_lock);
+    worker.busy = false;
+  }
+  m_available.notify_one();
+}
+
+int CompileWorkerPool::compile(const SharedMemory &request,
+                               IOCLFEOutputBuffer *pOutput,
+                               IOCLFEBinaryResult **pBinaryResult) {
+  Worker &worker = acquire();
+  std::string error;
+  uint64_t responseSize = 0;
+  bool undelivered = false;
+  int fd = transact(worker, request, responseSize, error, undelivered);
+  // The worker could have died while idle, killed by the OOM killer for
+  // instance, then the request never reached it and is sent once more to a
+  // fresh worker. A worker that died on the request isn't given another one:
+  // the compile would most likely take the fresh worker down too.
+  if (fd < 0 && undelivered)
+    fd = transact(worker, request, responseSize, error, undelivered);
+  if (fd < 0) {
+    // Restart the worker right away rather than on the next request
+    spawn(worker);
+    release(worker);
+
+    std::unique_ptr<OCLFEBinaryResult> pResult(new OCLFEBinaryResult());
+    pResult->setLog("error: " + error + "\n");
+    pResult->setResult(CL_COMPILE_PROGRAM_FAILURE);
+    if (pBinaryResult)
+      *pBinaryResult = pResult.release();
+    return CL_COMPILE_PROGRAM_FAILURE;
+  }
+  release(worker);
+
+  std::unique_ptr<WorkerBinaryResult> pResult(new WorkerBinaryResult());
+  int result = CL_COMPILE_PROGRAM_FAILURE;
+  bool hasResult = false;
+  if (!pResult->parse(fd, responseSize, result, hasResult)) {
+    if (pBinaryResult)
+      *pBinaryResult = nullptr;
+    return CL_COMPILE_PROGRAM_FAILURE;
+  }
+  if (hasResult && pOutput && !pResult->copyIR(pOutput)) {
+    if (pBinaryResult)
+      *pBinaryResult = nullptr;
+    return CL_OUT_OF_HOST_MEMORY;
+  }
+
+  if (pBinaryResult)
+    *pBinaryResult = hasResult ? pResult.release() : nullptr;
+  return result;
+}
+
+std::mutex g_poolLock;
+std::shared_ptr<CompileWorkerPool> g_pool;
+
+struct ResultReleaser {
+  void operator()(IOCLFEBinaryResult *pResult) const { pResult->Release(); }
+};
+
+} // namespace
+
+bool CompileInWorker(const char *pszProgramSource, const char **pInputHeaders,
+                     unsigned int uiNumInputHeaders,
+                     const char **pInputHeadersNames, const char *pPCHBuffer,
+                     size_t uiPCHBufferSize, const char *pszOptions,
+                     const char *pszOptionsEx, const char *pszOpenCLVer,
+                     IOCLFEOutputBuffer *pOutput,
+                     IOCLFEBinaryResult **pBinaryResult, int &result) {
+  std::shared_ptr<CompileWorkerPool> pool;
+  {
+    std::lock_guard<std::mutex> lock(g_poolLock);
+    pool = g_pool;
+  }
+  if (!pool)
+    return false;
+
+  SharedMemory request;
+  bool created = createMessage(request, [&](MessageWriter &writer) {
+    writer.writeString(pszProgramSource);
+    writer.writeString(pszOptions);
+    writer.writeString(pszOptionsEx);
+    writer.writeString(pszOpenCLVer);
+    writer.writeBlob(pPCHBuffer, uiPCHBufferSize);
+    writer.writeU64(uiNumInputHeaders);
+    for (unsigned int i = 0; i < uiNumInputHeaders; ++i) {
+      writer.writeString(pInputHeaders[i]);
+      writer.writeString(pInputHeadersNames[i]);
+    }
+  });
+  if (!created) {
+    if (pBinaryResult)
+      *pBinaryResult = nullptr;
+    result = CL_OUT_OF_HOST_MEMORY;
+    return true;
+  }
+
+  result = pool->compile(request, pOutput, pBinaryResult);
+  return true;
+}
+
+extern "C" CC_DLL_EXPORT bool StartCompileWorkers(const char *pszWorkerPath,
+                                                  unsigned int uiNumWorkers,
+                                                  unsigned int uiTimeoutMs) {
+  if (uiNumWorkers == 0)
+    return false;
+
+  std::shared_ptr<CompileWorkerPool> pool(new CompileWorkerPool(
+      pszWorkerPath ? pszWorkerPath : DefaultWorkerName, uiTimeoutMs));
+  if (!pool->start(uiNumWorkers))
+    return false;
+
+  std::lock_guard<std::mutex> lock(g_poolLock);
+  g_pool = std::move(pool);
+  return true;
+}
+
+extern "C" CC_DLL_EXPORT void StopCompileWorkers() {
+  std::shared_ptr<CompileWorkerPool> pool;
+  {
+    std::lock_guard<std::mutex> lock(g_poolLock);
+    pool.swap(g_pool);
+  }
+  // The workers are stopped once the compiles still using them are done
+}
+
+extern "C" CC_DLL_EXPORT int RunCompileWorker(int iSocket) {
+  // Warm up first, so the first request doesn't pay for the lazy
+  // initialization of the library
+  OpenCLClangPreload(nullptr, nullptr, 0);
+
+  for (;;) {
+    uint64_t size = 0;
+    int fd = recvMessage(iSocket, size);
+    if (fd < 0)
+      return 0; // the client has closed the connection
+
+    SharedMemory request;
+    if (!request.open(fd, size))
+      return 1;
+
+    MessageReader reader(request.data(), request.size());
+    const char *source = reader.readString();
+    const char *options = reader.readString();
+    const char *optionsEx = reader.readString();
+    const char *version = reader.readString();
+    size_t pchSize;
+    const char *pch = reader.readBlob(pchSize);
+    uint64_t numHeaders = reader.readU64();
+    std::vector<const char *> headers, headerNames;
+    for (uint64_t i = 0; i < numHeaders && !reader.failed(); ++i) {
+      headers.push_back(reader.readString());
+      headerNames.push_back(reader.readString());
+    }
+    if (reader.failed() || !source)
+      return 1;
+
+    IOCLFEBinaryResult *pCompileResult = nullptr;
+    int result = Compile(source, headers.data(),
+                         static_cast<unsigned int>(headers.size()),
+                         headerNames.data(), pch, pchSize, options, optionsEx,
+                         version, &pCompileResult);
+    std::unique_ptr<IOCLFEBinaryResult, ResultReleaser> pResult(
+        pCompileResult);
+
+    SharedMemory response;
+    bool created = createMessage(response, [&](MessageWriter &writer) {
+      writer.writeU64(static_cast<uint64_t>(static_cast<int64_t>(result)));
+      writer.writeU64(pResult ? 1 : 0);
+      if (!pResult)
+        return;
+      IOCLFEBinaryResult2 *pResult2 =
+          static_cast<IOCLFEBinaryResult2 *>(pResult.get());
+      writer.writeU64(pResult->GetIRType());
+      writer.writeU64(pResult2->GetPeakAllocatedBytes());
+      writer.writeBlob(pResult->GetIR(), pResult->GetIRSize());
+      writer.writeString(pResult2->GetOutputName(0));
+      // the outputs past the first one, waiting for the SPIR-V translation
+      writer.writeU64(pResult2->GetOutputCount() - 1);
+      for (unsigned int i = 1; i < pResult2->GetOutputCount(); ++i) {
+        writer.writeString(pResult2->GetOutputName(i));
+        writer.writeBlob(pResult2->GetOutput(i), pResult2->GetOutputSize(i));
+      }
+      writer.writeString(pResult->GetIRName());
+      // The diagnostics are sent as is and the client renders the log, the
+      // results of an in-process compile are always OCLFEBinaryResult
+      const OCLFEBinaryResult *pLocalResult =
+          static_cast<const OCLFEBinaryResult *>(pResult.get());
+      const DiagnosticArena &diagnostics = pLocalResult->getDiagnosticsRef();
+      writer.writeString(pLocalResult->getLog().c_str());
+      writer.writeU64(pResult2->GetDependencyCount());
+      for (unsigned int i = 0; i < pResult2->GetDependencyCount(); ++i) {
+        writer.writeString(pResult2->GetDependencyName(i));
+        writer.writeU64(pResult2->GetDependencyHash(i));
+      }
+      writer.writeU64(diagnostics.getCount());
+      writer.writeU64(diagnostics.getFixItCount());
+      writer.writeU64(diagnostics.showColumn());
+      writer.writeU64(diagnostics.showCarets());
+      writer.writeBlob(diagnostics.data(), diagnostics.size());
+    });
+    if (!created || !sendMessage(iSocket, response))
+      return 1;
+  }
+}
+
+#else // __linux__
+
+bool CompileInWorker(const char *, const char **, unsigned int, const char **,
+                     const char *, size_t, const char *, const char *,
+                     const char *, IOCLFEOutputBuffer *,
+                     IOCLFEBinaryResult **, int &) {
+  return false;
+}
+
+extern "C" CC_DLL_EXPORT bool StartCompileWorkers(const char *, unsigned int,
+                                                  unsigned int) {
+  return false;
+}
+
+extern "C" CC_DLL_EXPORT void StopCompileWorkers() {}
+
+extern "C" CC_DLL_EXPORT int RunCompileWorker(int) { return 1; }
+
+#endif // __linux__
@@ -0,0 +1,39 @@
+/*****************************************************************************\
+
+Copyright (c) Intel Corporation (2009-2017).
+
+    INTEL MAKES NO WARRANTY OF ANY KIND REGARDING THE CODE.  THIS CODE IS
+    LICENSED ON AN "AS IS" BASIS AND INTEL WILL NOT PROVIDE ANY SUPPORT,
+    ASSISTANCE, INSTALLATION, TRAINING OR OTHER SERVICES.  INTEL DOES NOT
+    PROVIDE ANY UPDATES, ENHANCEMENTS OR EXTENSIONS.  INTEL SPECIFICALLY
+    DISCLAIMS ANY WARRANTY OF MERCHANTABILITY, NONINFRINGEMENT, FITNESS FOR ANY
+    PARTICULAR PURPOSE, OR ANY OTHER WARRANTY.  Intel disclaims all liability,
+    including liability for infringement of any proprietary rights, relating to
+    use of the code. No license, express or implied, by estoppel or otherwise,
+    to any intellectual property rights is granted herein.
+
+  \file compile_worker.h
+
+  \brief Forwarding of the compile requests to the out-of-process workers
+
+\*****************************************************************************/
+
+#pragma once
+
+#include "opencl_clang.h"
+
+//
+// Forwards the compile request to one of the workers started with
+// StartCompileWorkers. Returns false if no workers are running, so the
+// request should be compiled in-process, true otherwise. In the latter case
+// the compile result is stored to 'result'. The IR is copied to pOutput if
+// it's given.
+//
+bool CompileInWorker(const char *pszProgramSource, const char **pInputHeaders,
+                     unsigned int uiNumInputHeaders,
+                     const char **pInputHeadersNames, const char *pPCHBuffer,
+                     size_t uiPCHBufferSize, const char *pszOptions,
+                     const char *pszOptionsEx, const char *pszOpenCLVer,
+                     Intel::OpenCL::ClangFE::IOCLFEOutputBuffer *pOutput,
+                     Intel::OpenCL::ClangFE::IOCLFEBinaryResult **pBinaryResult,
+                     int &result);
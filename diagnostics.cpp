@@ -0,0 +1,252 @@
+/*****************************************************************************\
+
+Copyright (c) Intel Corporation (2009-2017).
+
+    INTEL MAKES NO WARRANTY OF ANY KIND REGARDING THE CODE.  THIS CODE IS
+    LICENSED ON AN "AS IS" BASIS AND INTEL WILL NOT PROVIDE ANY SUPPORT,
+    ASSISTANCE, INSTALLATION, TRAINING OR OTHER SERVICES.  INTEL DOES NOT
+    PROVIDE ANY UPDATES, ENHANCEMENTS OR EXTENSIONS.  INTEL SPECIFICALLY
+    DISCLAIMS ANY WARRANTY OF MERCHANTABILITY, NONINFRINGEMENT, FITNESS FOR ANY
+    PARTICULAR PURPOSE, OR ANY OTHER WARRANTY.  Intel disclaims all liability,
+    including liability for infringement of any proprietary rights, relating to
+    use of the code. No license, express or implied, by estoppel or otherwise,
+    to any intellectual property rights is granted herein.
+
+  \file diagnostics.cpp
+
+\*****************************************************************************/
+
+#include "diagnostics.h"
+
+#include "clang/Basic/DiagnosticOptions.h"
+#include "clang/Basic/LangOptions.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Lex/Lexer.h"
+#include "llvm/ADT/SmallString.h"
+
+#include <cstring>
+
+using namespace Intel::OpenCL::ClangFE;
+
+static DIAG_SEVERITY getSeverity(clang::DiagnosticsEngine::Level Level) {
+  switch (Level) {
+  case clang::DiagnosticsEngine::Remark:
+    return DIAG_REMARK;
+  case clang::DiagnosticsEngine::Warning:
+    return DIAG_WARNING;
+  case clang::DiagnosticsEngine::Error:
+    return DIAG_ERROR;
+  case clang::DiagnosticsEngine::Fatal:
+    return DIAG_FATAL;
+  default:
+    return DIAG_NOTE;
+  }
+}
+
+static const char *getSeverityName(DIAG_SEVERITY Severity) {
+  switch (Severity) {
+  case DIAG_REMARK:
+    return "remark";
+  case DIAG_WARNING:
+    return "warning";
+  case DIAG_ERROR:
+    return "error";
+  case DIAG_FATAL:
+    return "fatal error";
+  default:
+    return "note";
+  }
+}
+
+void RenderDiagnostics(const OCLFEDiagnostic *pDiags, unsigned int uiNumDiags,
+                       const char *pszStrings, bool ShowColumn,
+                       bool ShowCarets, std::string &Out) {
+  for (unsigned int i = 0; i < uiNumDiags; ++i) {
+    const OCLFEDiagnostic &Diag = pDiags[i];
+    if (Diag.uiFileOffset != DIAG_NO_STRING) {
+      Out += pszStrings + Diag.uiFileOffset;
+      Out += ':' + std::to_string(Diag.uiLine);
+      if (ShowColumn && Diag.uiColumn)
+        Out += ':' + std::to_string(Diag.uiColumn);
+      Out += ": ";
+    }
+    Out += getSeverityName(Diag.severity);
+    Out += ": ";
+    Out += pszStrings + Diag.uiMessageOffset;
+    Out += '\n';
+
+    if (!ShowCarets || Diag.uiSourceLineOffset == DIAG_NO_STRING ||
+        Diag.uiColumn == 0)
+      continue;
+    llvm::StringRef Line(pszStrings + Diag.uiSourceLineOffset);
+    Out += Line;
+    Out += '\n';
+    // keep the tabs, so the caret lines up with the source line
+    for (unsigned int Col = 1; Col < Diag.uiColumn; ++Col)
+      Out += Col <= Line.size() && Line[Col - 1] == '\t' ? '\t' : ' ';
+    Out += "^\n";
+  }
+}
+
+void DiagnosticRecorder::BeginSourceFile(const clang::LangOptions &LangOpts,
+                                         const clang::Preprocessor *) {
+  m_langOpts = &LangOpts;
+}
+
+void DiagnosticRecorder::EndSourceFile() { m_langOpts = nullptr; }
+
+void DiagnosticRecorder::setRenderOptions(
+    const clang::DiagnosticOptions &Opts) {
+  m_showColumn = Opts.ShowColumn;
+  m_showCarets = Opts.ShowCarets;
+}
+
+unsigned int DiagnosticRecorder::addString(llvm::StringRef Str) {
+  unsigned int Offset = static_cast<unsigned int>(m_strings.size());
+  m_strings.append(Str.data(), Str.size());
+  m_strings.push_back('\0');
+  return Offset;
+}
+
+unsigned int DiagnosticRecorder::addSourceLine(const clang::SourceManager &SM,
+                                               clang::SourceLocation Loc) {
+  std::pair<clang::FileID, unsigned> Decomposed =
+      SM.getDecomposedLoc(SM.getExpansionLoc(Loc));
+  bool Invalid = false;
+  llvm::StringRef Buffer = SM.getBufferData(Decomposed.first, &Invalid);
+  if (Invalid || Decomposed.second > Buffer.size())
+    return DIAG_NO_STRING;
+
+  size_t Begin = Buffer.take_front(Decomposed.second).find_last_of("\n\r");
+  Begin = Begin == llvm::StringRef::npos ? 0 : Begin + 1;
+  size_t End = Buffer.find_first_of("\n\r", Decomposed.second);
+  return addString(Buffer.slice(Begin, End));
+}
+
+bool DiagnosticRecorder::getRange(const clang::SourceManager &SM,
+                                  const clang::CharSourceRange &Range,
+                                  OCLFEFixIt &FixIt) const {
+  clang::SourceLocation Begin = SM.getExpansionLoc(Range.getBegin());
+  clang::SourceLocation End = SM.getExpansionLoc(Range.getEnd());
+  clang::PresumedLoc PBegin = SM.getPresumedLoc(Begin);
+  clang::PresumedLoc PEnd = SM.getPresumedLoc(End);
+  if (PBegin.isInvalid() || PEnd.isInvalid())
+    return false;
+
+  FixIt.uiLine = PBegin.getLine();
+  FixIt.uiColumn = PBegin.getColumn();
+  FixIt.uiEndLine = PEnd.getLine();
+  FixIt.uiEndColumn = PEnd.getColumn();
+  // a token range ends at the beginning of its last token
+  if (Range.isTokenRange() && m_langOpts)
+    FixIt.uiEndColumn += clang::Lexer::MeasureTokenLength(End, SM, *m_langOpts);
+  return true;
+}
+
+bool DiagnosticRecorder::isFull() const {
+  return (m_maxDiagnostics && m_diagnostics.size() >= m_maxDiagnostics) ||
+         isOverByteLimit();
+}
+
+void DiagnosticRecorder::HandleDiagnostic(clang::DiagnosticsEngine::Level Level,
+                                          const clang::Diagnostic &Info) {
+  // Updates the error and warning counters
+  DiagnosticConsumer::HandleDiagnostic(Level, Info);
+
+  // Once the log is full, the diagnostics other than errors are dropped
+  // before anything is formatted, along with their notes. The errors are
+  // bounded by the error limit of the engine, which only follows the count
+  // of the diagnostics, so past the byte limit the errors are dropped too.
+  // The first error is kept, the log has to tell why the compile failed.
+  if (Level == clang::DiagnosticsEngine::Note) {
+    if (m_droppingNotes)
+      return;
+  } else if ((Level < clang::DiagnosticsEngine::Error && isFull()) ||
+             (Level == clang::DiagnosticsEngine::Error && m_recordedError &&
+              isOverByteLimit())) {
+    ++m_numDropped;
+    m_droppingNotes = true;
+    return;
+  } else {
+    m_droppingNotes = false;
+  }
+  if (Level >= clang::DiagnosticsEngine::Error)
+    m_recordedError = true;
+
+  OCLFEDiagnostic Diag;
+  Diag.severity = getSeverity(Level);
+  Diag.uiID = Info.getID();
+  Diag.uiFileOffset = DIAG_NO_STRING;
+  Diag.uiLine = 0;
+  Diag.uiColumn = 0;
+  Diag.uiSourceLineOffset = DIAG_NO_STRING;
+  Diag.uiFirstFixIt = static_cast<unsigned int>(m_fixIts.size());
+  Diag.uiNumFixIts = 0;
+
+  llvm::SmallString<128> Message;
+  Info.FormatDiagnostic(Message);
+  Diag.uiMessageOffset = addString(Message);
+
+  if (Info.getLocation().isValid() && Info.hasSourceManager()) {
+    const clang::SourceManager &SM = Info.getSourceManager();
+    clang::PresumedLoc PLoc = SM.getPresumedLoc(Info.getLocation());
+    if (PLoc.isValid()) {
+      Diag.uiFileOffset = addString(PLoc.getFilename());
+      Diag.uiLine = PLoc.getLine();
+      Diag.uiColumn = PLoc.getColumn();
+      Diag.uiSourceLineOffset = addSourceLine(SM, Info.getLocation());
+    }
+
+    for (const clang::FixItHint &Hint : Info.getFixItHints()) {
+      OCLFEFixIt FixIt;
+      if (!getRange(SM, Hint.RemoveRange, FixIt))
+        continue;
+      FixIt.uiCodeOffset = addString(Hint.CodeToInsert);
+      m_fixIts.push_back(FixIt);
+      ++Diag.uiNumFixIts;
+    }
+  }
+
+  // The rendered log holds the location, the message and, if the carets are
+  // shown, the source line and the caret line
+  m_logBytes += Message.size() + 32;
+  if (Diag.uiFileOffset != DIAG_NO_STRING)
+    m_logBytes += strlen(m_strings.data() + Diag.uiFileOffset);
+  if (m_showCarets && Diag.uiSourceLineOffset != DIAG_NO_STRING)
+    m_logBytes += 2 * strlen(m_strings.data() + Diag.uiSourceLineOffset);
+  m_diagnostics.push_back(Diag);
+}
+
+void DiagnosticRecorder::finish(DiagnosticArena &Arena) {
+  if (m_numDropped) {
+    std::string Limit =
+        m_maxDiagnostics && m_diagnostics.size() >= m_maxDiagnostics
+            ? std::to_string(m_maxDiagnostics) + " diagnostics"
+            : std::to_string(m_maxLogBytes) + " bytes";
+    OCLFEDiagnostic Summary = {};
+    Summary.severity = DIAG_NOTE;
+    Summary.uiFileOffset = DIAG_NO_STRING;
+    Summary.uiSourceLineOffset = DIAG_NO_STRING;
+    Summary.uiFirstFixIt = static_cast<unsigned int>(m_fixIts.size());
+    Summary.uiMessageOffset =
+        addString(std::to_string(m_numDropped) +
+                  " diagnostics were dropped, the log is limited to " + Limit);
+    m_diagnostics.push_back(Summary);
+    m_numDropped = 0;
+  }
+
+  size_t DiagsSize = m_diagnostics.size() * sizeof(OCLFEDiagnostic);
+  size_t FixItsSize = m_fixIts.size() * sizeof(OCLFEFixIt);
+
+  Arena.m_buffer.clear();
+  Arena.m_buffer.reserve(DiagsSize + FixItsSize + m_strings.size());
+  Arena.m_buffer.append(reinterpret_cast<const char *>(m_diagnostics.data()),
+                        DiagsSize);
+  Arena.m_buffer.append(reinterpret_cast<const char *>(m_fixIts.data()),
+                        FixItsSize);
+  Arena.m_buffer.append(m_strings.data(), m_strings.size());
+  Arena.m_numDiagnostics = static_cast<unsigned int>(m_diagnostics.size());
+  Arena.m_numFixIts = static_cast<unsigned int>(m_fixIts.size());
+  Arena.m_showColumn = m_showColumn;
+  Arena.m_showCarets = m_showCarets;
+}
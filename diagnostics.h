@@ -0,0 +1,145 @@
+/*****************************************************************************\
+
+Copyright (c) Intel Corporation (2009-2017).
+
+    INTEL MAKES NO WARRANTY OF ANY KIND REGARDING THE CODE.  THIS CODE IS
+    LICENSED ON AN "AS IS" BASIS AND INTEL WILL NOT PROVIDE ANY SUPPORT,
+    ASSISTANCE, INSTALLATION, TRAINING OR OTHER SERVICES.  INTEL DOES NOT
+    PROVIDE ANY UPDATES, ENHANCEMENTS OR EXTENSIONS.  INTEL SPECIFICALLY
+    DISCLAIMS ANY WARRANTY OF MERCHANTABILITY, NONINFRINGEMENT, FITNESS FOR ANY
+    PARTICULAR PURPOSE, OR ANY OTHER WARRANTY.  Intel disclaims all liability,
+    including liability for infringement of any proprietary rights, relating to
+    use of the code. No license, express or implied, by estoppel or otherwise,
+    to any intellectual property rights is granted herein.
+
+  \file diagnostics.h
+
+  \brief Structured diagnostics recorded during compilation
+
+\*****************************************************************************/
+
+#pragma once
+
+#include "opencl_clang.h"
+#include "host_allocator.h"
+
+#include "clang/Basic/Diagnostic.h"
+
+#include <string>
+#include <vector>
+
+namespace clang {
+class DiagnosticOptions;
+class LangOptions;
+class SourceManager;
+} // namespace clang
+
+//
+// Renders the diagnostics in the clang text format: the location, the
+// severity and the message, followed by the source line and the caret if
+// ShowCarets is set. The column is part of the location if ShowColumn is set.
+//
+void RenderDiagnostics(const Intel::OpenCL::ClangFE::OCLFEDiagnostic *pDiags,
+                       unsigned int uiNumDiags, const char *pszStrings,
+                       bool ShowColumn, bool ShowCarets, std::string &Out);
+
+//
+// The diagnostics of a compilation, packed in a single buffer: the
+// diagnostics array, followed by the fix-its array and the strings
+//
+class DiagnosticArena {
+public:
+  unsigned int getCount() const { return m_numDiagnostics; }
+
+  unsigned int getFixItCount() const { return m_numFixIts; }
+
+  const Intel::OpenCL::ClangFE::OCLFEDiagnostic *getDiagnostics() const {
+    return reinterpret_cast<const Intel::OpenCL::ClangFE::OCLFEDiagnostic *>(
+        m_buffer.data());
+  }
+
+  const Intel::OpenCL::ClangFE::OCLFEFixIt *getFixIts() const {
+    return reinterpret_cast<const Intel::OpenCL::ClangFE::OCLFEFixIt *>(
+        m_buffer.data() + m_numDiagnostics * sizeof(*getDiagnostics()));
+  }
+
+  const char *getStrings() const {
+    return m_buffer.data() + m_numDiagnostics * sizeof(*getDiagnostics()) +
+           m_numFixIts * sizeof(*getFixIts());
+  }
+
+  // The whole buffer
+  const char *data() const { return m_buffer.data(); }
+  size_t size() const { return m_buffer.size(); }
+
+  // How the log is rendered, as the compile's diagnostic options tell
+  bool showColumn() const { return m_showColumn; }
+  bool showCarets() const { return m_showCarets; }
+
+private:
+  friend class DiagnosticRecorder;
+
+  HostBuffer m_buffer;
+  unsigned int m_numDiagnostics = 0;
+  unsigned int m_numFixIts = 0;
+  bool m_showColumn = true;
+  bool m_showCarets = true;
+};
+
+//
+// Diagnostic consumer recording the diagnostics as compact structs. No text
+// is formatted besides the messages, the log is rendered on demand.
+//
+class DiagnosticRecorder : public clang::DiagnosticConsumer {
+public:
+  // Past either limit only the errors are recorded, and past the byte limit
+  // only the first error. 0 means no limit.
+  DiagnosticRecorder(unsigned MaxDiagnostics = 0, size_t MaxLogBytes = 0)
+      : m_maxDiagnostics(MaxDiagnostics), m_maxLogBytes(MaxLogBytes) {}
+
+  void BeginSourceFile(const clang::LangOptions &LangOpts,
+                       const clang::Preprocessor *PP) override;
+
+  void EndSourceFile() override;
+
+  // Takes how the log is rendered from the options of the invocation
+  void setRenderOptions(const clang::DiagnosticOptions &Opts);
+
+  void HandleDiagnostic(clang::DiagnosticsEngine::Level Level,
+                        const clang::Diagnostic &Info) override;
+
+  // Packs the recorded diagnostics into the arena, along with the summary of
+  // the dropped ones
+  void finish(DiagnosticArena &Arena);
+
+private:
+  unsigned int addString(llvm::StringRef Str);
+
+  unsigned int addSourceLine(const clang::SourceManager &SM,
+                             clang::SourceLocation Loc);
+
+  bool getRange(const clang::SourceManager &SM,
+                const clang::CharSourceRange &Range,
+                Intel::OpenCL::ClangFE::OCLFEFixIt &FixIt) const;
+
+  bool isFull() const;
+
+  bool isOverByteLimit() const {
+    return m_maxLogBytes && m_logBytes >= m_maxLogBytes;
+  }
+
+  unsigned m_maxDiagnostics;
+  size_t m_maxLogBytes;
+  // approximate size of the log rendered from the recorded diagnostics
+  size_t m_logBytes = 0;
+  unsigned m_numDropped = 0;
+  // set while dropping the notes attached to a dropped diagnostic
+  bool m_droppingNotes = false;
+  bool m_recordedError = false;
+  bool m_showColumn = true;
+  bool m_showCarets = true;
+  const clang::LangOptions *m_langOpts = nullptr;
+  std::vector<Intel::OpenCL::ClangFE::OCLFEDiagnostic> m_diagnostics;
+  std::vector<Intel::OpenCL::ClangFE::OCLFEFixIt> m_fixIts;
+  std::string m_strings;
+};
@@ -0,0 +1,358 @@
+/*****************************************************************************\
+
+Copyright (c) Intel Corporation (2009-2017).
+
+    INTEL MAKES NO WARRANTY OF ANY KIND REGARDING THE CODE.  THIS CODE IS
+    LICENSED ON AN "AS IS" BASIS AND INTEL WILL NOT PROVIDE ANY SUPPORT,
+    ASSISTANCE, INSTALLATION, TRAINING OR OTHER SERVICES.  INTEL DOES NOT
+    PROVIDE ANY UPDATES, ENHANCEMENTS OR EXTENSIONS.  INTEL SPECIFICALLY
+    DISCLAIMS ANY WARRANTY OF MERCHANTABILITY, NONINFRINGEMENT, FITNESS FOR ANY
+    PARTICULAR PURPOSE, OR ANY OTHER WARRANTY.  Intel disclaims all liability,
+    including liability for infringement of any proprietary rights, relating to
+    use of the code. No license, express or implied, by estoppel or otherwise,
+    to any intellectual property rights is granted herein.
+
+
+  \file external_pcm.cpp
+
+\*****************************************************************************/
+
+#include "external_pcm.h"
+#include "pch_mgr.h"
+
+#include "clang/Basic/FileManager.h"
+#include "clang/Basic/FileSystemOptions.h"
+#include "clang/Basic/LangOptions.h"
+#include "clang/Basic/TargetOptions.h"
+#include "clang/Basic/Version.h"
+#include "clang/Serialization/ASTBitCodes.h"
+#include "clang/Serialization/ASTReader.h"
+#include "clang/Serialization/ModuleCache.h"
+#include "clang/Serialization/PCHContainerOperations.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Bitstream/BitCodes.h"
+#include "llvm/Bitstream/BitstreamReader.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/VirtualFileSystem.h"
+#include "llvm/TargetParser/Triple.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// What a PCM was built for, as far as the compiles loading it can tell: the
+// control block holds the language options and the target, the AST block the
+// OpenCL extensions
+struct PCMTraits {
+  bool OpenCL = false;
+  bool OpenCLCPlusPlus = false;
+  unsigned OpenCLVersion = 0;
+  unsigned OpenCLCPlusPlusVersion = 0;
+  std::string Triple;
+  // the fields of the OPENCL_EXTENSIONS record by extension
+  std::map<std::string, std::vector<uint64_t>> Extensions;
+};
+
+// The fields of an extension in the OPENCL_EXTENSIONS record
+enum ExtensionField {
+  EXT_SUPPORTED,
+  EXT_ENABLED,
+  EXT_WITH_PRAGMA,
+  EXT_AVAIL,
+  EXT_CORE,
+  EXT_OPT,
+  EXT_FIELD_COUNT
+};
+
+// Collects the traits from the control block of a PCM, and rejects the PCMs
+// built by another clang
+class PCMTraitsReader : public clang::ASTReaderListener {
+public:
+  explicit PCMTraitsReader(PCMTraits &Traits) : m_traits(Traits) {}
+
+  bool ReadFullVersionInformation(llvm::StringRef FullVersion) override {
+    return FullVersion != clang::getClangFullRepositoryVersion();
+  }
+
+  bool ReadLanguageOptions(const clang::LangOptions &LangOpts,
+                           llvm::StringRef ModuleFilename, bool Complain,
+                           bool AllowCompatibleDifferences) override {
+    m_traits.OpenCL = LangOpts.OpenCL;
+    m_traits.OpenCLCPlusPlus = LangOpts.OpenCLCPlusPlus;
+    m_traits.OpenCLVersion = LangOpts.OpenCLVersion;
+    m_traits.OpenCLCPlusPlusVersion = LangOpts.OpenCLCPlusPlusVersion;
+    return false;
+  }
+
+  bool ReadTargetOptions(const clang::TargetOptions &TargetOpts,
+                         llvm::StringRef ModuleFilename, bool Complain,
+                         bool AllowCompatibleDifferences) override {
+    m_traits.Triple = TargetOpts.Triple;
+    return false;
+  }
+
+private:
+  PCMTraits &m_traits;
+};
+
+// Reads the OPENCL_EXTENSIONS record from the AST block of a PCM. The record
+// holds the name of each extension followed by its fields, as written by
+// ASTWriter::WriteOpenCLExtensions.
+bool ReadOpenCLExtensions(const llvm::MemoryBuffer &Buffer,
+                          PCMTraits &Traits) {
+  llvm::BitstreamCursor Stream(Buffer.getMemBufferRef());
+  for (char C : {'C', 'P', 'C', 'H'}) {
+    llvm::Expected<llvm::SimpleBitstreamCursor::word_t> Magic = Stream.Read(8);
+    if (!Magic) {
+      llvm::consumeError(Magic.takeError());
+      return false;
+    }
+    if (*Magic != (unsigned char)C)
+      return false;
+  }
+
+  llvm::BitstreamBlockInfo BlockInfo;
+  bool InASTBlock = false;
+  llvm::SmallVector<uint64_t, 256> Record;
+  while (!Stream.AtEndOfStream()) {
+    llvm::Expected<llvm::BitstreamEntry> Entry = Stream.advance();
+    if (!Entry) {
+      llvm::consumeError(Entry.takeError());
+      return false;
+    }
+
+    switch (Entry->Kind) {
+    case llvm::BitstreamEntry::SubBlock: {
+      if (Entry->ID == llvm::bitc::BLOCKINFO_BLOCK_ID) {
+        // the abbreviations of the records are defined there
+        auto Info = Stream.ReadBlockInfoBlock();
+        if (!Info) {
+          llvm::consumeError(Info.takeError());
+          return false;
+        }
+        if (*Info) {
+          BlockInfo = std::move(**Info);
+          Stream.setBlockInfo(&BlockInfo);
+        }
+        break;
+      }
+
+      bool Enter =
+          !InASTBlock && Entry->ID == clang::serialization::AST_BLOCK_ID;
+      if (llvm::Error Err = Enter ? Stream.EnterSubBlock(Entry->ID)
+                                  : Stream.SkipBlock()) {
+        llvm::consumeError(std::move(Err));
+        return false;
+      }
+      InASTBlock |= Enter;
+      break;
+    }
+
+    case llvm::BitstreamEntry::Record: {
+      Record.clear();
+      llvm::Expected<unsigned> Code = Stream.readRecord(Entry->ID, Record);
+      if (!Code) {
+        llvm::consumeError(Code.takeError());
+        return false;
+      }
+      if (!InASTBlock || *Code != clang::serialization::OPENCL_EXTENSIONS)
+        break;
+
+      for (size_t I = 0; I < Record.size();) {
+        size_t Length = Record[I++];
+        if (Length > Record.size() - I ||
+            EXT_FIELD_COUNT > Record.size() - I - Length)
+          return false;
+        std::string Extension;
+        for (size_t End = I + Length; I < End; ++I)
+          Extension.push_back(static_cast<char>(Record[I]));
+        auto Fields = Record.begin() + I;
+        Traits.Extensions[Extension].assign(Fields, Fields + EXT_FIELD_COUNT);
+        I += EXT_FIELD_COUNT;
+      }
+      return true;
+    }
+
+    case llvm::BitstreamEntry::EndBlock:
+      // the AST block has no extensions record: not an OpenCL module
+      return false;
+
+    case llvm::BitstreamEntry::Error:
+      return false;
+    }
+  }
+  return false;
+}
+
+bool ReadPCMTraits(const llvm::MemoryBuffer &Buffer, llvm::StringRef Name,
+                   PCMTraits &Traits) {
+  // The reader gets the file through an in-memory file system, so what is
+  // checked is exactly what the compiles will see
+  llvm::IntrusiveRefCntPtr<llvm::vfs::InMemoryFileSystem> MemFS(
+      new llvm::vfs::InMemoryFileSystem);
+  MemFS->addFile(Name, (time_t)0,
+                 llvm::MemoryBuffer::getMemBuffer(Buffer.getMemBufferRef(),
+                                                  false));
+  clang::FileManager FileMgr(clang::FileSystemOptions(), MemFS);
+  auto ModCache = clang::createCrossProcessModuleCache();
+  clang::RawPCHContainerReader ContainerReader;
+  PCMTraitsReader Reader(Traits);
+
+  bool Failed = clang::ASTReader::readASTFileControlBlock(
+      Name, FileMgr, *ModCache, ContainerReader,
+      /*FindModuleFileExtensions=*/false, Reader,
+      /*ValidateDiagnosticOptions=*/false);
+  return !Failed && ReadOpenCLExtensions(Buffer, Traits);
+}
+
+// Returns true if the PCM was built for the signature. The compiles run with
+// -fno-validate-pch, so a PCM built for anything else has to be rejected here.
+bool IsBuiltFor(const PCMTraits &Traits, const PCMSignature &Signature) {
+  unsigned Version = Signature.CPlusPlus ? Traits.OpenCLCPlusPlusVersion
+                                         : Traits.OpenCLVersion;
+  if (!Traits.OpenCL || Traits.OpenCLCPlusPlus != Signature.CPlusPlus ||
+      Version != Signature.Version ||
+      llvm::Triple::normalize(Traits.Triple) !=
+          llvm::Triple::normalize(Signature.Triple))
+    return false;
+
+  // The target supports the extensions as the -cl-ext options leave them, and
+  // drops cl_khr_fp64 and __opencl_c_fp64 both if either one is disabled
+  auto IsEnabled = [&Signature](const std::string &Name) {
+    auto It = Signature.Extensions.find(Name);
+    return It == Signature.Extensions.end() ? Signature.AllExtensions
+                                            : It->second;
+  };
+  bool Fp64 = IsEnabled("cl_khr_fp64") && IsEnabled("__opencl_c_fp64");
+
+  // Sema supports those of them the language version has, see
+  // LangOptions::getOpenCLCompatibleVersion
+  unsigned CompatibleVersion = Traits.OpenCLVersion;
+  if (Traits.OpenCLCPlusPlus)
+    CompatibleVersion = Traits.OpenCLCPlusPlusVersion == 100 ? 200 : 300;
+  for (const auto &Extension : Traits.Extensions) {
+    const std::string &Name = Extension.first;
+    bool Enabled = Name == "cl_khr_fp64" || Name == "__opencl_c_fp64"
+                       ? Fp64
+                       : IsEnabled(Name);
+    bool Supported =
+        Enabled && CompatibleVersion >= Extension.second[EXT_AVAIL];
+    if (Supported != (Extension.second[EXT_SUPPORTED] != 0))
+      return false;
+  }
+  return true;
+}
+
+const std::string &GetPCMDir() {
+  static const std::string Dir = []() -> std::string {
+    const char *Env = getenv("CCLANG_PCM_DIR");
+    if (Env)
+      return Env;
+#ifdef OPENCL_CLANG_PCM_DIR
+    return OPENCL_CLANG_PCM_DIR;
+#else
+    return "";
+#endif
+  }();
+  return Dir;
+}
+
+// Returns the names of the files of the directory named <Prefix>.pcm or
+// <Prefix>-<suffix>.pcm, in name order
+std::vector<std::string> ListPCMs(const std::string &Dir,
+                                  llvm::StringRef Prefix) {
+  std::vector<std::string> Names;
+  std::error_code EC;
+  for (llvm::sys::fs::directory_iterator It(Dir, EC), End; It != End && !EC;
+       It.increment(EC)) {
+    llvm::StringRef Name = llvm::sys::path::filename(It->path());
+    llvm::StringRef Suffix = Name;
+    if (Suffix.consume_front(Prefix) && Suffix.consume_back(".pcm") &&
+        (Suffix.empty() || Suffix.starts_with("-")))
+      Names.push_back(Name.str());
+  }
+  llvm::sort(Names);
+  return Names;
+}
+
+// Loads a PCM of the directory, sets Path to its path and Traits to its
+// traits, which are null if it isn't an OpenCL PCM built by this clang. The
+// traits are read again only once the file has changed, the ResourceManager
+// hands out the same buffer until then. The buffers the traits were read from
+// are kept referenced, so a new one can't reuse their address.
+std::shared_ptr<const llvm::MemoryBuffer>
+LoadPCM(const std::string &Dir, llvm::StringRef Name, std::string &Path,
+        std::shared_ptr<const PCMTraits> &Traits, std::string &Error) {
+  llvm::SmallString<256> FullPath(Dir);
+  llvm::sys::path::append(FullPath, Name);
+  Path = std::string(FullPath.str());
+  auto File = ResourceManager::instance().get_file(
+      Path.c_str(), /*binary=*/true, /*requireNullTerminate=*/true);
+  if (!File) {
+    // a file removed since the directory was listed is not an error
+    if (File.getError() != std::errc::no_such_file_or_directory)
+      Error =
+          "can't read the PCM '" + Path + "': " + File.getError().message();
+    return nullptr;
+  }
+  std::shared_ptr<const llvm::MemoryBuffer> Buffer = std::move(*File);
+
+  static std::mutex Lock;
+  static std::map<std::string,
+                  std::pair<std::shared_ptr<const llvm::MemoryBuffer>,
+                            std::shared_ptr<const PCMTraits>>>
+      Loaded;
+
+  std::lock_guard<std::mutex> Guard(Lock);
+  auto &Entry = Loaded[Path];
+  if (Entry.first != Buffer) {
+    auto Read = std::make_shared<PCMTraits>();
+    Entry.first = Buffer;
+    Entry.second = ReadPCMTraits(*Buffer, Name, *Read) ? std::move(Read)
+                                                       : nullptr;
+  }
+  Traits = Entry.second;
+  return Buffer;
+}
+
+} // namespace
+
+std::shared_ptr<const llvm::MemoryBuffer>
+FindExternalPCM(llvm::StringRef Prefix, llvm::StringRef Preferred,
+                const PCMSignature &Signature, std::string &Path,
+                std::string &Error) {
+  Path.clear();
+  Error.clear();
+  const std::string &Dir = GetPCMDir();
+  if (Dir.empty())
+    return nullptr;
+
+  std::vector<std::string> Candidates = ListPCMs(Dir, Prefix);
+  auto It = llvm::find(Candidates, Preferred);
+  if (It != Candidates.end())
+    std::rotate(Candidates.begin(), It, It + 1);
+
+  for (const std::string &Candidate : Candidates) {
+    std::string CandidatePath;
+    std::shared_ptr<const PCMTraits> Traits;
+    auto Buffer = LoadPCM(Dir, Candidate, CandidatePath, Traits, Error);
+    if (!Error.empty())
+      return nullptr;
+    if (Buffer && Traits && IsBuiltFor(*Traits, Signature)) {
+      Path = std::move(CandidatePath);
+      return Buffer;
+    }
+  }
+  return nullptr;
+}
@@ -0,0 +1,68 @@
+/*****************************************************************************\
+
+Copyright (c) Intel Corporation (2009-2017).
+
+    INTEL MAKES NO WARRANTY OF ANY KIND REGARDING THE CODE.  THIS CODE IS
+    LICENSED ON AN "AS IS" BASIS AND INTEL WILL NOT PROVIDE ANY SUPPORT,
+    ASSISTANCE, INSTALLATION, TRAINING OR OTHER SERVICES.  INTEL DOES NOT
+    PROVIDE ANY UPDATES, ENHANCEMENTS OR EXTENSIONS.  INTEL SPECIFICALLY
+    DISCLAIMS ANY WARRANTY OF MERCHANTABILITY, NONINFRINGEMENT, FITNESS FOR ANY
+    PARTICULAR PURPOSE, OR ANY OTHER WARRANTY.  Intel disclaims all liability,
+    including liability for infringement of any proprietary rights, relating to
+    use of the code. No license, express or implied, by estoppel or otherwise,
+    to any intellectual property rights is granted herein.
+
+
+  \file external_pcm.h
+
+  \brief PCMs loaded from a directory instead of the library resources
+
+\*****************************************************************************/
+
+#pragma once
+
+#include "llvm/ADT/StringRef.h"
+
+#include <map>
+#include <memory>
+#include <string>
+
+namespace llvm {
+class MemoryBuffer;
+}
+
+//
+// What a compile needs a PCM to be built for: the triple, the language and the
+// OpenCL extensions its -cl-ext options leave supported
+//
+struct PCMSignature {
+  std::string Triple;
+  bool CPlusPlus = false;
+  // the OpenCL C version of the PCM, 120 also for the OpenCL C 1.0 and 1.1
+  // compiles, which use that PCM, or the C++ for OpenCL one: 100 or 202100
+  unsigned Version = 0;
+  // the support of the extensions the -cl-ext options don't name after their
+  // last "all", the spir targets support all of them by default
+  bool AllExtensions = true;
+  std::map<std::string, bool> Extensions;
+};
+
+//
+// Returns the PCM of the external PCM directory built by this clang for the
+// signature, or null if no directory is set or no PCM of the directory was.
+// The candidates are the files named <Prefix>.pcm or <Prefix>-<suffix>.pcm,
+// Preferred first and the others in name order, so the directory can hold
+// PCMs for the extension sets no embedded PCM is built with. Path is set to
+// the path of the file returned, which the compile maps it under, so it never
+// shadows an embedded PCM of the same name.
+// The directory is taken from the CCLANG_PCM_DIR environment variable and
+// defaults to the one the library was configured with. The files are loaded
+// by the ResourceManager, and a file replaced in the directory is checked
+// again before it is used.
+// A candidate that exists but can't be read is an error: null is returned
+// with Error set, rather than another PCM being used silently.
+//
+std::shared_ptr<const llvm::MemoryBuffer>
+FindExternalPCM(llvm::StringRef Prefix, llvm::StringRef Preferred,
+                const PCMSignature &Signature, std::string &Path,
+                std::string &Error);
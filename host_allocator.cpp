@@ -0,0 +1,174 @@
+/*****************************************************************************\
+
+Copyright (c) Intel Corporation (2009-2017).
+
+    INTEL MAKES NO WARRANTY OF ANY KIND REGARDING THE CODE.  THIS CODE IS
+    LICENSED ON AN "AS IS" BASIS AND INTEL WILL NOT PROVIDE ANY SUPPORT,
+    ASSISTANCE, INSTALLATION, TRAINING OR OTHER SERVICES.  INTEL DOES NOT
+    PROVIDE ANY UPDATES, ENHANCEMENTS OR EXTENSIONS.  INTEL SPECIFICALLY
+    DISCLAIMS ANY WARRANTY OF MERCHANTABILITY, NONINFRINGEMENT, FITNESS FOR ANY
+    PARTICULAR PURPOSE, OR ANY OTHER WARRANTY.  Intel disclaims all liability,
+    including liability for infringement of any proprietary rights, relating to
+    use of the code. No license, express or implied, by estoppel or otherwise,
+    to any intellectual property rights is granted herein.
+
+  \file host_allocator.cpp
+
+\*****************************************************************************/
+
+#include "opencl_clang.h"
+#include "host_allocator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+namespace {
+
+void *DefaultAlloc(size_t size, void *) { return malloc(size); }
+
+void *DefaultRealloc(void *ptr, size_t size, void *) {
+  return realloc(ptr, size);
+}
+
+void DefaultFree(void *ptr, void *) { free(ptr); }
+
+struct HostAllocatorCallbacks {
+  OCLFE_ALLOC_FN pfnAlloc = DefaultAlloc;
+  OCLFE_REALLOC_FN pfnRealloc = DefaultRealloc;
+  OCLFE_FREE_FN pfnFree = DefaultFree;
+  void *pUserData = nullptr;
+};
+
+const HostAllocatorCallbacks g_defaultCallbacks;
+// Written only while the allocator is being set, no allocation reads it then
+HostAllocatorCallbacks g_userCallbacks;
+std::atomic<const HostAllocatorCallbacks *> g_callbacks{&g_defaultCallbacks};
+
+// The callbacks can be set until the first allocation is made, they can't be
+// changed after that, as the memory would be freed with the wrong callback
+enum AllocatorState { ALLOCATOR_UNUSED, ALLOCATOR_SETTING, ALLOCATOR_IN_USE };
+std::atomic<int> g_state{ALLOCATOR_UNUSED};
+
+const HostAllocatorCallbacks &UseCallbacks() {
+  int state = g_state.load(std::memory_order_acquire);
+  // the first allocation waits for SetHostAllocator to publish the callbacks
+  while (state != ALLOCATOR_IN_USE) {
+    if (state == ALLOCATOR_UNUSED &&
+        g_state.compare_exchange_weak(state, ALLOCATOR_IN_USE,
+                                      std::memory_order_acq_rel))
+      break;
+    if (state == ALLOCATOR_SETTING) {
+      std::this_thread::yield();
+      state = g_state.load(std::memory_order_acquire);
+    }
+  }
+  return *g_callbacks.load(std::memory_order_acquire);
+}
+
+} // namespace
+
+void *HostAlloc(size_t size) {
+  const HostAllocatorCallbacks &callbacks = UseCallbacks();
+  void *ptr = callbacks.pfnAlloc(size ? size : 1, callbacks.pUserData);
+  if (!ptr)
+    throw std::bad_alloc();
+  return ptr;
+}
+
+void *HostRealloc(void *ptr, size_t size) {
+  const HostAllocatorCallbacks &callbacks = UseCallbacks();
+  void *newPtr =
+      callbacks.pfnRealloc(ptr, size ? size : 1, callbacks.pUserData);
+  if (!newPtr)
+    throw std::bad_alloc();
+  return newPtr;
+}
+
+void HostFree(void *ptr) {
+  // the memory was allocated, so the callbacks are final
+  if (ptr) {
+    const HostAllocatorCallbacks &callbacks =
+        *g_callbacks.load(std::memory_order_acquire);
+    callbacks.pfnFree(ptr, callbacks.pUserData);
+  }
+}
+
+void HostBuffer::reserve(size_t capacity) {
+  if (!tryReserve(capacity))
+    throw std::bad_alloc();
+}
+
+void HostBuffer::append(const char *data, size_t size) {
+  if (!tryAppend(data, size))
+    throw std::bad_alloc();
+}
+
+bool HostBuffer::tryReserve(size_t capacity) {
+  if (capacity <= m_capacity)
+    return true;
+  if (m_output) {
+    void *data = m_output->Grow(capacity);
+    if (!data)
+      return false;
+    m_data = static_cast<char *>(data);
+  } else {
+    try {
+      m_data = static_cast<char *>(HostRealloc(m_data, capacity));
+    } catch (const std::bad_alloc &) {
+      return false;
+    }
+  }
+  m_capacity = capacity;
+  return true;
+}
+
+bool HostBuffer::tryAppend(const char *data, size_t size) {
+  if (m_size + size > m_capacity &&
+      !tryReserve(std::max(m_size + size, m_capacity * 2))) {
+    m_failed = true;
+    return false;
+  }
+  memcpy(m_data + m_size, data, size);
+  m_size += size;
+  return true;
+}
+
+void raw_host_buffer_ostream::write_impl(const char *ptr, size_t size) {
+  if (!m_buffer.failed())
+    m_buffer.tryAppend(ptr, size);
+}
+
+void raw_host_buffer_ostream::pwrite_impl(const char *ptr, size_t size,
+                                          uint64_t offset) {
+  if (!m_buffer.failed())
+    memcpy(m_buffer.data() + offset, ptr, size);
+}
+
+extern "C" CC_DLL_EXPORT bool SetHostAllocator(OCLFE_ALLOC_FN pfnAlloc,
+                                               OCLFE_REALLOC_FN pfnRealloc,
+                                               OCLFE_FREE_FN pfnFree,
+                                               void *pUserData) {
+  // either all the callbacks are provided or none of them
+  if (!pfnAlloc != !pfnRealloc || !pfnAlloc != !pfnFree)
+    return false;
+
+  int state = ALLOCATOR_UNUSED;
+  if (!g_state.compare_exchange_strong(state, ALLOCATOR_SETTING,
+                                       std::memory_order_acq_rel))
+    return false;
+
+  if (pfnAlloc) {
+    g_userCallbacks.pfnAlloc = pfnAlloc;
+    g_userCallbacks.pfnRealloc = pfnRealloc;
+    g_userCallbacks.pfnFree = pfnFree;
+    g_userCallbacks.pUserData = pUserData;
+    g_callbacks.store(&g_userCallbacks, std::memory_order_release);
+  } else {
+    g_callbacks.store(&g_defaultCallbacks, std::memory_order_release);
+  }
+  g_state.store(ALLOCATOR_UNUSED, std::memory_order_release);
+  return true;
+}
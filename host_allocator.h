@@ -0,0 +1,136 @@
+/*****************************************************************************\
+
+Copyright (c) Intel Corporation (2009-2017).
+
+    INTEL MAKES NO WARRANTY OF ANY KIND REGARDING THE CODE.  THIS CODE IS
+    LICENSED ON AN "AS IS" BASIS AND INTEL WILL NOT PROVIDE ANY SUPPORT,
+    ASSISTANCE, INSTALLATION, TRAINING OR OTHER SERVICES.  INTEL DOES NOT
+    PROVIDE ANY UPDATES, ENHANCEMENTS OR EXTENSIONS.  INTEL SPECIFICALLY
+    DISCLAIMS ANY WARRANTY OF MERCHANTABILITY, NONINFRINGEMENT, FITNESS FOR ANY
+    PARTICULAR PURPOSE, OR ANY OTHER WARRANTY.  Intel disclaims all liability,
+    including liability for infringement of any proprietary rights, relating to
+    use of the code. No license, express or implied, by estoppel or otherwise,
+    to any intellectual property rights is granted herein.
+
+  \file host_allocator.h
+
+  \brief Memory owned by the library, allocated through the host callbacks
+
+\*****************************************************************************/
+
+#pragma once
+
+#include "opencl_clang.h"
+
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+//
+// Allocation routines forwarding to the callbacks registered with
+// SetHostAllocator, or to malloc/realloc/free if none were registered.
+// HostAlloc and HostRealloc throw std::bad_alloc on failure.
+//
+void *HostAlloc(size_t size);
+void *HostRealloc(void *ptr, size_t size);
+void HostFree(void *ptr);
+
+//
+// std compatible allocator on top of the host allocation routines
+//
+template <class T> struct HostStdAllocator {
+  typedef T value_type;
+
+  HostStdAllocator() = default;
+  template <class U> HostStdAllocator(const HostStdAllocator<U> &) {}
+
+  T *allocate(size_t n) { return static_cast<T *>(HostAlloc(n * sizeof(T))); }
+
+  void deallocate(T *p, size_t) { HostFree(p); }
+};
+
+template <class T, class U>
+bool operator==(const HostStdAllocator<T> &, const HostStdAllocator<U> &) {
+  return true;
+}
+
+template <class T, class U>
+bool operator!=(const HostStdAllocator<T> &, const HostStdAllocator<U> &) {
+  return false;
+}
+
+//
+// Growable byte buffer allocated through the host allocation routines, or
+// through the caller's output buffer if one is given
+//
+class HostBuffer {
+public:
+  explicit HostBuffer(
+      Intel::OpenCL::ClangFE::IOCLFEOutputBuffer *output = nullptr)
+      : m_data(nullptr), m_size(0), m_capacity(0), m_failed(false),
+        m_output(output) {}
+  HostBuffer(const HostBuffer &) = delete;
+  HostBuffer &operator=(const HostBuffer &) = delete;
+  ~HostBuffer() {
+    // the memory of the output buffer belongs to the caller
+    if (!m_output)
+      HostFree(m_data);
+  }
+
+  const char *data() const { return m_data; }
+  char *data() { return m_data; }
+
+  size_t size() const { return m_size; }
+
+  bool empty() const { return m_size == 0; }
+
+  // Keeps the allocated memory for reuse
+  void clear() {
+    m_size = 0;
+    m_failed = false;
+  }
+
+  // Throw std::bad_alloc if the memory can't be allocated
+  void reserve(size_t capacity);
+
+  void append(const char *data, size_t size);
+
+  // Return false if the memory can't be allocated, for the writers called
+  // back from code that can't unwind an exception (LLVM, the translator).
+  // A failed append marks the buffer as failed.
+  bool tryReserve(size_t capacity);
+
+  bool tryAppend(const char *data, size_t size);
+
+  // True if an append couldn't grow the buffer, the data is truncated then
+  bool failed() const { return m_failed; }
+
+private:
+  char *m_data;
+  size_t m_size;
+  size_t m_capacity;
+  bool m_failed;
+  Intel::OpenCL::ClangFE::IOCLFEOutputBuffer *m_output;
+};
+
+//
+// Output stream writing directly into a HostBuffer. A write the buffer can't
+// grow for doesn't throw through the LLVM writers, it fails the buffer and the
+// stream drops the writes from then on.
+//
+class raw_host_buffer_ostream : public llvm::raw_pwrite_stream {
+  HostBuffer &m_buffer;
+
+  void write_impl(const char *ptr, size_t size) override;
+
+  void pwrite_impl(const char *ptr, size_t size, uint64_t offset) override;
+
+  uint64_t current_pos() const override { return m_buffer.size(); }
+
+public:
+  explicit raw_host_buffer_ostream(HostBuffer &buffer) : m_buffer(buffer) {
+    SetUnbuffered();
+  }
+};
@@ -0,0 +1,83 @@
+/*****************************************************************************\
+
+Copyright (c) Intel Corporation (2009-2017).
+
+    INTEL MAKES NO WARRANTY OF ANY KIND REGARDING THE CODE.  THIS CODE IS
+    LICENSED ON AN "AS IS" BASIS AND INTEL WILL NOT PROVIDE ANY SUPPORT,
+    ASSISTANCE, INSTALLATION, TRAINING OR OTHER SERVICES.  INTEL DOES NOT
+    PROVIDE ANY UPDATES, ENHANCEMENTS OR EXTENSIONS.  INTEL SPECIFICALLY
+    DISCLAIMS ANY WARRANTY OF MERCHANTABILITY, NONINFRINGEMENT, FITNESS FOR ANY
+    PARTICULAR PURPOSE, OR ANY OTHER WARRANTY.  Intel disclaims all liability,
+    including liability for infringement of any proprietary rights, relating to
+    use of the code. No license, express or implied, by estoppel or otherwise,
+    to any intellectual property rights is granted herein.
+
+  \file invocation_cache.cpp
+
+\*****************************************************************************/
+
+#include "invocation_cache.h"
+
+#include "clang/Frontend/FrontendOptions.h"
+
+InvocationCache &InvocationCache::instance() {
+  static InvocationCache Cache;
+  return Cache;
+}
+
+std::string InvocationCache::getKey(llvm::ArrayRef<const char *> Args) {
+  std::string Key;
+  // the source name is the last one
+  for (size_t i = 0; i + 1 < Args.size(); ++i) {
+    Key += Args[i];
+    Key += '\0';
+    if (llvm::StringRef(Args[i]) == "-main-file-name")
+      ++i;
+  }
+  return Key;
+}
+
+bool InvocationCache::get(const std::string &Key,
+                          clang::CompilerInvocation &Invocation) {
+  InvocationPtr Template;
+  {
+    std::lock_guard<std::mutex> Lock(m_lock);
+    auto It = m_index.find(Key);
+    if (It == m_index.end())
+      return false;
+    m_entries.splice(m_entries.begin(), m_entries, It->second);
+    Template = It->second->second;
+  }
+  // the deep copy is done outside of the lock, the template is immutable
+  Invocation = *Template;
+  return true;
+}
+
+void InvocationCache::put(const std::string &Key,
+                          const clang::CompilerInvocation &Invocation) {
+  InvocationPtr Template =
+      std::make_shared<clang::CompilerInvocation>(Invocation);
+  std::lock_guard<std::mutex> Lock(m_lock);
+  if (m_index.count(Key))
+    return;
+  m_entries.emplace_front(Key, std::move(Template));
+  m_index[Key] = m_entries.begin();
+  if (m_entries.size() > MaxEntries) {
+    m_index.erase(m_entries.back().first);
+    m_entries.pop_back();
+  }
+}
+
+void InvocationCache::patchInput(clang::CompilerInvocation &Invocation,
+                                 llvm::ArrayRef<const char *> Args) {
+  if (Args.empty())
+    return;
+
+  for (size_t i = 0; i + 1 < Args.size(); ++i)
+    if (llvm::StringRef(Args[i]) == "-main-file-name")
+      Invocation.getCodeGenOpts().MainFileName = Args[i + 1];
+
+  for (auto &Input : Invocation.getFrontendOpts().Inputs)
+    Input = clang::FrontendInputFile(Args.back(), Input.getKind(),
+                                     Input.isSystem());
+}
@@ -0,0 +1,65 @@
+/*****************************************************************************\
+
+Copyright (c) Intel Corporation (2009-2017).
+
+    INTEL MAKES NO WARRANTY OF ANY KIND REGARDING THE CODE.  THIS CODE IS
+    LICENSED ON AN "AS IS" BASIS AND INTEL WILL NOT PROVIDE ANY SUPPORT,
+    ASSISTANCE, INSTALLATION, TRAINING OR OTHER SERVICES.  INTEL DOES NOT
+    PROVIDE ANY UPDATES, ENHANCEMENTS OR EXTENSIONS.  INTEL SPECIFICALLY
+    DISCLAIMS ANY WARRANTY OF MERCHANTABILITY, NONINFRINGEMENT, FITNESS FOR ANY
+    PARTICULAR PURPOSE, OR ANY OTHER WARRANTY.  Intel disclaims all liability,
+    including liability for infringement of any proprietary rights, relating to
+    use of the code. No license, express or implied, by estoppel or otherwise,
+    to any intellectual property rights is granted herein.
+
+  \file invocation_cache.h
+
+  \brief Cache of the compiler invocations built from the compile options
+
+\*****************************************************************************/
+
+#pragma once
+
+#include "clang/Frontend/CompilerInvocation.h"
+#include "llvm/ADT/ArrayRef.h"
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+//
+// Bounded cache of the CompilerInvocations built from the effective options.
+// A compile with the options seen before copies the cached invocation and
+// patches in its input instead of running the cc1 options parser again.
+//
+class InvocationCache {
+public:
+  static InvocationCache &instance();
+
+  // Returns the cache key of the effective options: the options without the
+  // source name and the main file name, which are patched in after the copy
+  static std::string getKey(llvm::ArrayRef<const char *> Args);
+
+  // Copies the invocation cached for the key, returns false if there is none
+  bool get(const std::string &Key, clang::CompilerInvocation &Invocation);
+
+  void put(const std::string &Key, const clang::CompilerInvocation &Invocation);
+
+  // Sets the input and the main file name of the effective options on the
+  // copied invocation
+  static void patchInput(clang::CompilerInvocation &Invocation,
+                         llvm::ArrayRef<const char *> Args);
+
+private:
+  static const size_t MaxEntries = 16;
+
+  typedef std::shared_ptr<const clang::CompilerInvocation> InvocationPtr;
+  typedef std::list<std::pair<std::string, InvocationPtr>> EntryList;
+
+  std::mutex m_lock;
+  // the most recently used entry goes first
+  EntryList m_entries;
+  std::unordered_map<std::string, EntryList::iterator> m_index;
+};
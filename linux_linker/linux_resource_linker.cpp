@@ -16,50 +16,176 @@ Copyright (c) Intel Corporation (2009-2017).
 
 \*****************************************************************************/
 
+#include "../resource_archive.h"
+
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
-int main(int argc, char **argv)
+static int read_file(const char *path, unsigned char **data, size_t *size)
 {
-    FILE *input;
-    FILE *output;
-
-    if (!argv[1] || !strcmp(argv[1], "-h") || !strcmp(argv[1], "--help") || !argv[2] || !argv[3])
+    FILE *input = fopen(path, "rb");
+    if (!input)
     {
-        printf("Usage: bif_linker [input file] [output file] [symbol base name]\n");
+        printf("Unable to open input file for reading (%s)\n", path);
         return 0;
     }
+    fseek(input, 0, SEEK_END);
+    *size = (size_t)ftell(input);
+    fseek(input, 0, SEEK_SET);
+    *data = (unsigned char *)malloc(*size ? *size : 1);
+    if (!*data || fread(*data, 1, *size, input) != *size)
+    {
+        printf("Unable to read input file (%s)\n", path);
+        fclose(input);
+        return 0;
+    }
+    fclose(input);
+    return 1;
+}
 
-    input = fopen(argv[1], "rb");
-    if (!input)
+static void write_array(FILE *output, const char *symbol,
+                        const unsigned char *data, size_t size,
+                        const char *attributes)
+{
+    fprintf(output, "// This file is auto generated by bo_linker, DO NOT EDIT\n\n");
+    fprintf(output, "unsigned char __attribute__((visibility(\"default\")%s)) %s[] =\n{\n    ", attributes, symbol);
+    for (size_t count = 0; count < size; ++count)
+    {
+        int is_eol = count ? !(count % 20) : 0;
+        fprintf(output, "%s0x%.2x, ", is_eol? "\n    ":"", data[count]);
+    }
+    fprintf(output, "0x00\n};\n\n");
+    fprintf(output, "unsigned int __attribute__((visibility(\"default\"))) %s_size = %zu;\n\n", symbol, size);
+}
+
+static size_t align_up(size_t offset)
+{
+    return (offset + RESOURCE_ARCHIVE_ALIGNMENT - 1) / RESOURCE_ARCHIVE_ALIGNMENT * RESOURCE_ARCHIVE_ALIGNMENT;
+}
+
+// Packs the resources into one archive, see resource_archive.h. Each resource
+// is given by its name, the file stored in the archive and the original file;
+// the stored file is the compressed original when the two differ.
+static int write_archive(int argc, char **argv)
+{
+    const char *archive_path = argv[2];
+    const char *output_path = argv[3];
+    const char *symbol = argv[4];
+    const char *producer = argv[5];
+    int count = (argc - 6) / 3;
+    char **resources = argv + 6;
+
+    ResourceArchiveHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, RESOURCE_ARCHIVE_MAGIC, sizeof(RESOURCE_ARCHIVE_MAGIC));
+    header.version = RESOURCE_ARCHIVE_VERSION;
+    header.count = count;
+    if (strlen(producer) >= sizeof(header.producer))
     {
-        printf("Unable to open input file for reading (%s)\n", argv[1]);
+        printf("Archive producer is too long (%s)\n", producer);
         return 1;
     }
+    memcpy(header.producer, producer, strlen(producer));
+
+    ResourceArchiveEntry *entries = (ResourceArchiveEntry *)calloc(count ? count : 1, sizeof(ResourceArchiveEntry));
+    unsigned char **payloads = (unsigned char **)calloc(count ? count : 1, sizeof(unsigned char *));
+
+    // the names follow the table, the payloads start at the next page
+    size_t offset = sizeof(header) + count * sizeof(ResourceArchiveEntry);
+    for (int i = 0; i < count; ++i)
+    {
+        entries[i].nameOffset = (uint32_t)offset;
+        entries[i].nameSize = (uint32_t)strlen(resources[3 * i]);
+        offset += entries[i].nameSize;
+    }
+    for (int i = 0; i < count; ++i)
+    {
+        const char *stored = resources[3 * i + 1];
+        const char *original = resources[3 * i + 2];
+        size_t size = 0;
+        if (!read_file(stored, &payloads[i], &size))
+            return 1;
+        if (strcmp(stored, original))
+        {
+            unsigned char *data = NULL;
+            size_t uncompressed_size = 0;
+            if (!read_file(original, &data, &uncompressed_size))
+                return 1;
+            free(data);
+            entries[i].uncompressedSize = uncompressed_size;
+        }
+        offset = align_up(offset);
+        entries[i].offset = offset;
+        entries[i].size = size;
+        entries[i].hash = ResourceArchiveHash(payloads[i], size);
+        offset += size + 1;
+    }
+    header.size = offset;
 
-    output = fopen(argv[2], "wb");
+    unsigned char *archive = (unsigned char *)calloc(header.size, 1);
+    memcpy(archive, &header, sizeof(header));
+    memcpy(archive + sizeof(header), entries, count * sizeof(ResourceArchiveEntry));
+    for (int i = 0; i < count; ++i)
+    {
+        memcpy(archive + entries[i].nameOffset, resources[3 * i], entries[i].nameSize);
+        memcpy(archive + entries[i].offset, payloads[i], entries[i].size);
+        free(payloads[i]);
+    }
+
+    FILE *output = fopen(archive_path, "wb");
+    if (!output || fwrite(archive, 1, header.size, output) != header.size)
+    {
+        printf("Unable to write archive file (%s)\n", archive_path);
+        return 1;
+    }
+    fclose(output);
+
+    output = fopen(output_path, "wb");
     if (!output)
     {
-        printf("Unable to open output file for writing (%s)\n", argv[2]);
+        printf("Unable to open output file for writing (%s)\n", output_path);
         return 1;
     }
+    // page aligned, so the payloads are aligned in the loaded library as well
+    char attributes[32];
+    snprintf(attributes, sizeof(attributes), ", aligned(%d)", RESOURCE_ARCHIVE_ALIGNMENT);
+    write_array(output, symbol, archive, header.size, attributes);
+    fclose(output);
 
-    fprintf(output, "// This file is auto generated by bo_linker, DO NOT EDIT\n\n");
-    fprintf(output, "unsigned char __attribute__((visibility(\"default\"))) %s[] =\n{\n    ", argv[3]);
+    free(archive);
+    free(payloads);
+    free(entries);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 5 && !strcmp(argv[1], "--archive") && (argc - 6) % 3 == 0)
+        return write_archive(argc, argv);
 
-    int count = 0;
-    int is_eol;
-    unsigned char data;
-    while(fread(&data, 1, 1, input))
+    if (!argv[1] || !strcmp(argv[1], "-h") || !strcmp(argv[1], "--help") || !argv[2] || !argv[3])
     {
-    	is_eol = count ? !(count % 20) : 0;
-        fprintf(output, "%s0x%.2x, ", is_eol? "\n    ":"", data);
-        count++;
+        printf("Usage: bif_linker [input file] [output file] [symbol base name]\n");
+        printf("       bif_linker --archive [archive file] [output file] [symbol base name] [producer]\n");
+        printf("                  ([resource name] [stored file] [original file])...\n");
+        return 0;
     }
-    fprintf(output, "0x00\n};\n\n");
 
-    fprintf(output, "unsigned int __attribute__((visibility(\"default\"))) %s_size = %d;\n\n", argv[3], count);
-    fclose(input);
-    fclose(output);
+    unsigned char *data = NULL;
+    size_t size = 0;
+    if (!read_file(argv[1], &data, &size))
+        return 1;
 
+    FILE *output = fopen(argv[2], "wb");
+    if (!output)
+    {
+        printf("Unable to open output file for writing (%s)\n", argv[2]);
+        return 1;
+    }
+
+    write_array(output, argv[3], data, size, "");
+    fclose(output);
+    free(data);
+    return 0;
 }
@@ -0,0 +1,140 @@
+/*****************************************************************************\
+
+Copyright (c) Intel Corporation (2009-2017).
+
+    INTEL MAKES NO WARRANTY OF ANY KIND REGARDING THE CODE.  THIS CODE IS
+    LICENSED ON AN "AS IS" BASIS AND INTEL WILL NOT PROVIDE ANY SUPPORT,
+    ASSISTANCE, INSTALLATION, TRAINING OR OTHER SERVICES.  INTEL DOES NOT
+    PROVIDE ANY UPDATES, ENHANCEMENTS OR EXTENSIONS.  INTEL SPECIFICALLY
+    DISCLAIMS ANY WARRANTY OF MERCHANTABILITY, NONINFRINGEMENT, FITNESS FOR ANY
+    PARTICULAR PURPOSE, OR ANY OTHER WARRANTY.  Intel disclaims all liability,
+    including liability for infringement of any proprietary rights, relating to
+    use of the code. No license, express or implied, by estoppel or otherwise,
+    to any intellectual property rights is granted herein.
+
+  \file memory_budget.cpp
+
+\*****************************************************************************/
+
+#include "memory_budget.h"
+
+#include "clang/AST/ASTConsumer.h"
+#include "clang/AST/ASTContext.h"
+#include "clang/Basic/Diagnostic.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/MultiplexConsumer.h"
+#include "clang/Lex/Preprocessor.h"
+#include "clang/Lex/Token.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Sampling on every token would be too expensive for the macro heavy OpenCL
+// headers, so only every Nth token is accounted.
+const unsigned TokensPerSample = 4096;
+
+// Samples the budget while the tokens are lexed, within the declarations too.
+// Once it is exceeded, an end of file follows the current token, so the
+// parser stops whatever it is parsing.
+class MemoryBudgetTokenWatcher {
+public:
+  MemoryBudgetTokenWatcher(clang::CompilerInstance &CI, MemoryBudget &budget)
+      : m_CI(CI), m_budget(budget), m_tokens(0) {}
+
+  void operator()(const clang::Token &Tok) {
+    if (++m_tokens % TokensPerSample != 0 || Tok.is(clang::tok::eof) ||
+        m_budget.sample(m_CI))
+      return;
+    clang::Token Eof;
+    Eof.startToken();
+    Eof.setKind(clang::tok::eof);
+    Eof.setLocation(Tok.getLocation());
+    // Reinjected, so it isn't seen by the watcher again
+    m_CI.getPreprocessor().EnterToken(Eof, /*IsReinject=*/true);
+  }
+
+private:
+  clang::CompilerInstance &m_CI;
+  MemoryBudget &m_budget;
+  unsigned m_tokens;
+};
+
+class MemoryBudgetConsumer : public clang::ASTConsumer {
+public:
+  MemoryBudgetConsumer(clang::CompilerInstance &CI, MemoryBudget &budget)
+      : m_CI(CI), m_budget(budget) {}
+
+  // Returning false stops the parser, which is how the compile is aborted
+  // once the budget is exceeded.
+  bool HandleTopLevelDecl(clang::DeclGroupRef D) override {
+    return m_budget.sample(m_CI);
+  }
+
+  void HandleTranslationUnit(clang::ASTContext &Ctx) override {
+    m_budget.sample(m_CI);
+  }
+
+private:
+  clang::CompilerInstance &m_CI;
+  MemoryBudget &m_budget;
+};
+
+} // namespace
+
+bool MemoryBudget::sample(clang::CompilerInstance &CI) {
+  if (m_exceeded)
+    return false;
+
+  size_t used = 0;
+  if (CI.hasSourceManager()) {
+    clang::SourceManager &SM = CI.getSourceManager();
+    used += SM.getContentCacheSize() + SM.getDataStructureSizes();
+  }
+  if (CI.hasPreprocessor())
+    used += CI.getPreprocessor().getTotalMemory();
+  if (CI.hasASTContext()) {
+    clang::ASTContext &Ctx = CI.getASTContext();
+    used += Ctx.getASTAllocatedMemory() + Ctx.getSideTableAllocatedMemory();
+  }
+
+  m_peak = std::max(m_peak, used);
+  if (m_budget == 0 || used <= m_budget)
+    return true;
+
+  m_exceeded = true;
+  clang::DiagnosticsEngine &Diags = CI.getDiagnostics();
+  unsigned DiagID = Diags.getCustomDiagID(
+      clang::DiagnosticsEngine::Fatal,
+      "compile memory budget of %0 bytes exceeded (%1 bytes in use)");
+  Diags.Report(DiagID) << std::to_string(m_budget) << std::to_string(used);
+  return false;
+}
+
+bool MemoryBudgetAction::BeginSourceFileAction(clang::CompilerInstance &CI) {
+  if (!clang::WrapperFrontendAction::BeginSourceFileAction(CI))
+    return false;
+
+  CI.getPreprocessor().setTokenWatcher(
+      MemoryBudgetTokenWatcher(CI, m_budget));
+  return true;
+}
+
+std::unique_ptr<clang::ASTConsumer>
+MemoryBudgetAction::CreateASTConsumer(clang::CompilerInstance &CI,
+                                      llvm::StringRef InFile) {
+  std::unique_ptr<clang::ASTConsumer> WrappedConsumer =
+      clang::WrapperFrontendAction::CreateASTConsumer(CI, InFile);
+  if (!WrappedConsumer)
+    return nullptr;
+
+  // The budget consumer goes first, so that the usage is sampled before the
+  // code generator gets to see the declaration.
+  std::vector<std::unique_ptr<clang::ASTConsumer>> Consumers;
+  Consumers.push_back(std::make_unique<MemoryBudgetConsumer>(CI, m_budget));
+  Consumers.push_back(std::move(WrappedConsumer));
+  return std::make_unique<clang::MultiplexConsumer>(std::move(Consumers));
+}
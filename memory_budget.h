@@ -0,0 +1,93 @@
+/*****************************************************************************\
+
+Copyright (c) Intel Corporation (2009-2017).
+
+    INTEL MAKES NO WARRANTY OF ANY KIND REGARDING THE CODE.  THIS CODE IS
+    LICENSED ON AN "AS IS" BASIS AND INTEL WILL NOT PROVIDE ANY SUPPORT,
+    ASSISTANCE, INSTALLATION, TRAINING OR OTHER SERVICES.  INTEL DOES NOT
+    PROVIDE ANY UPDATES, ENHANCEMENTS OR EXTENSIONS.  INTEL SPECIFICALLY
+    DISCLAIMS ANY WARRANTY OF MERCHANTABILITY, NONINFRINGEMENT, FITNESS FOR ANY
+    PARTICULAR PURPOSE, OR ANY OTHER WARRANTY.  Intel disclaims all liability,
+    including liability for infringement of any proprietary rights, relating to
+    use of the code. No license, express or implied, by estoppel or otherwise,
+    to any intellectual property rights is granted herein.
+
+  \file memory_budget.h
+
+  \brief Per-compile accounting of the memory held by the clang frontend
+
+\*****************************************************************************/
+
+#pragma once
+
+#include "clang/Frontend/FrontendAction.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <cstddef>
+#include <memory>
+
+namespace clang {
+class ASTConsumer;
+class CompilerInstance;
+}
+
+//
+// Keeps track of the memory held by the frontend during a single compile and
+// aborts the compile once it goes over the budget.
+//
+// clang doesn't provide allocator hooks, so the usage is sampled from the
+// BumpPtrAllocator slabs backing the AST, the preprocessor and the source
+// manager. Sampling happens every few thousand tokens, so a single huge
+// declaration is caught too, and after every top-level declaration. Once the
+// budget is exceeded the token stream ends, which stops the parser where it
+// is.
+//
+// The LLVM module the code generator emits while parsing isn't accounted,
+// LLVM doesn't track the memory of its IR. It stays proportional to the AST
+// that is.
+//
+class MemoryBudget {
+public:
+  // A budget of 0 means that the usage is tracked, but not limited.
+  explicit MemoryBudget(size_t budget)
+      : m_budget(budget), m_peak(0), m_exceeded(false) {}
+
+  //
+  // Samples the current usage of the compiler instance. Reports a fatal error
+  // and returns false if the budget is exceeded.
+  //
+  bool sample(clang::CompilerInstance &CI);
+
+  size_t getBudget() const { return m_budget; }
+
+  size_t getPeak() const { return m_peak; }
+
+  bool isExceeded() const { return m_exceeded; }
+
+private:
+  size_t m_budget;
+  size_t m_peak;
+  bool m_exceeded;
+};
+
+//
+// Wraps the frontend action requested by the compiler invocation and samples
+// the memory budget while it is running.
+//
+class MemoryBudgetAction : public clang::WrapperFrontendAction {
+public:
+  MemoryBudgetAction(std::unique_ptr<clang::FrontendAction> wrappedAction,
+                     MemoryBudget &budget)
+      : clang::WrapperFrontendAction(std::move(wrappedAction)),
+        m_budget(budget) {}
+
+protected:
+  bool BeginSourceFileAction(clang::CompilerInstance &CI) override;
+
+  std::unique_ptr<clang::ASTConsumer>
+  CreateASTConsumer(clang::CompilerInstance &CI,
+                    llvm::StringRef InFile) override;
+
+private:
+  MemoryBudget &m_budget;
+};
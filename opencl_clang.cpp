@@ -18,31 +18,50 @@ Copyright (c) Intel Corporation (2009-2017).
 
 #include "opencl_clang.h"
 #include "pch_mgr.h"
-#include "cl_headers/resource.h"
 #include "binary_result.h"
+#include "compile_capture.h"
+#include "compile_worker.h"
+#include "diagnostics.h"
+#include "external_pcm.h"
+#include "invocation_cache.h"
+#include "memory_budget.h"
 #include "options.h"
 
 #include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/ADT/StringExtras.h"
 #include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/Twine.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Metadata.h"
+#include "llvm/Config/llvm-config.h"
 #include "llvm/Bitcode/BitcodeWriter.h"
 #include "llvm/Bitcode/BitcodeReader.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/Casting.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Path.h"
+#include "llvm/Support/ThreadPool.h"
 #include "llvm/Support/Threading.h"
+#include "llvm/Support/xxhash.h"
 #include "llvm/Support/ManagedStatic.h"
 #include "clang/Basic/LangOptions.h"
+#include "clang/Basic/SourceManager.h"
 #include "clang/Basic/Diagnostic.h"
 #include "clang/Basic/DiagnosticIDs.h"
 #include "clang/Basic/DiagnosticOptions.h"
-#include "clang/Frontend/TextDiagnosticPrinter.h"
 #include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/FrontendAction.h"
+#include "clang/Frontend/Utils.h"
+#include "clang/Lex/HeaderSearchOptions.h"
+#include "clang/Lex/PreprocessorOptions.h"
+#include "clang/Serialization/ASTReader.h"
+#include "clang/Serialization/ModuleFile.h"
+#include "clang/Serialization/ModuleManager.h"
 #include "clang/FrontendTool/Utils.h"
 #ifdef USE_PREBUILT_LLVM
 #include "LLVMSPIRVLib/LLVMSPIRVLib.h"
@@ -53,24 +72,24 @@ Copyright (c) Intel Corporation (2009-2017).
 // The following #defines are used as return value of Compile() API and defined
 // in https://github.com/KhronosGroup/OpenCL-Headers/blob/master/CL/cl.h
 #define CL_SUCCESS 0
+#define CL_INVALID_VALUE -30
 #define CL_COMPILE_PROGRAM_FAILURE -15
 #define CL_INVALID_BUILD_OPTIONS -43
 #define CL_OUT_OF_HOST_MEMORY -6
 
 #include "assert.h"
+#include <algorithm>
+#include <cstring>
+#include <future>
 #include <iosfwd>
 #include <iterator>
+#include <map>
+#include <mutex>
+#include <optional>
 #ifdef _WIN32
 #include <ctype.h>
 #endif
 
-#if defined _DEBUG
-#include <cstdlib>
-#include <sstream>
-#include <fstream>
-#include <thread>
-#endif
-
 using namespace Intel::OpenCL::ClangFE;
 
 void OpenCLClangTerminate() { llvm::llvm_shutdown(); }
@@ -88,44 +107,72 @@ void OpenCLClangInitialize() {
   llvm::call_once(OnceFlag, []() { atexit(OpenCLClangTerminate); });
 }
 
-static bool GetHeaders(std::vector<Resource> &Result) {
-  struct {
-    const char *ID;
-    const char *Name;
-  } Headers[] = {{OPENCL_C_H, "opencl-c.h"},
-                 {OPENCL_C_BASE_H, "opencl-c-base.h"},
-                 {OPENCL_C_12_SPIR_PCM, "opencl-c-12-spir.pcm"},
-                 {OPENCL_C_20_SPIR_PCM, "opencl-c-20-spir.pcm"},
-                 {OPENCL_C_30_SPIR_PCM, "opencl-c-30-spir.pcm"},
-#ifndef OPENCL_CLANG_NO_CL31_PCM
-                 {OPENCL_C_31_SPIR_PCM, "opencl-c-31-spir.pcm"},
-#endif
-                 {OPENCL_C_12_SPIR64_PCM, "opencl-c-12-spir64.pcm"},
-                 {OPENCL_C_20_SPIR64_PCM, "opencl-c-20-spir64.pcm"},
-                 {OPENCL_C_30_SPIR64_PCM, "opencl-c-30-spir64.pcm"},
-#ifndef OPENCL_CLANG_NO_CL31_PCM
-                 {OPENCL_C_31_SPIR64_PCM, "opencl-c-31-spir64.pcm"},
-#endif
-                 {OPENCL_C_12_SPIR_FP64_PCM, "opencl-c-12-spir-fp64.pcm"},
-                 {OPENCL_C_20_SPIR_FP64_PCM, "opencl-c-20-spir-fp64.pcm"},
-                 {OPENCL_C_30_SPIR_FP64_PCM, "opencl-c-30-spir-fp64.pcm"},
-#ifndef OPENCL_CLANG_NO_CL31_PCM
-                 {OPENCL_C_31_SPIR_FP64_PCM, "opencl-c-31-spir-fp64.pcm"},
-#endif
-                 {OPENCL_C_12_SPIR64_FP64_PCM, "opencl-c-12-spir64-fp64.pcm"},
-                 {OPENCL_C_20_SPIR64_FP64_PCM, "opencl-c-20-spir64-fp64.pcm"},
-                 {OPENCL_C_30_SPIR64_FP64_PCM, "opencl-c-30-spir64-fp64.pcm"},
-#ifndef OPENCL_CLANG_NO_CL31_PCM
-                 {OPENCL_C_31_SPIR64_FP64_PCM, "opencl-c-31-spir64-fp64.pcm"},
-#endif
-                 {OPENCL_C_MODULE_MAP, "module.modulemap"}};
+// Returns the names of the PCMs the effective options load, or false if that
+// can't be told from the options
+static bool GetSelectedModules(const CompileOptionsParser &Parser,
+                               llvm::SmallVectorImpl<llvm::StringRef> &Modules) {
+  for (auto it = Parser.beginArgs(), ie = Parser.endArgs(); it != ie; ++it) {
+    llvm::StringRef Arg(*it);
+    if (Arg == "-fmodule-file")
+      return false;
+    if (Arg.consume_front("-fmodule-file=")) {
+      // -fmodule-file=[<module name>=]<path>
+      llvm::StringRef Path = Arg.rsplit('=').second;
+      Modules.push_back(Path.empty() ? Arg : Path);
+    }
+  }
+  return true;
+}
 
+// Adds the PCM of the external PCM directory the options selected, if any, to
+// the external PCMs of the compiles. Error tells why it failed: the directory
+// couldn't be searched, or the file another compile selected has been
+// replaced since.
+static bool AddExternalPCM(const CompileOptionsParser &Parser,
+                           std::vector<Resource> &ExternalPCMs,
+                           std::string &Error) {
+  if (!Parser.getExternalPCMError().empty()) {
+    Error = Parser.getExternalPCMError();
+    return false;
+  }
+  std::shared_ptr<const llvm::MemoryBuffer> PCM = Parser.getExternalPCM();
+  if (!PCM)
+    return true;
+
+  const std::string &Path = Parser.getExternalPCMPath();
+  auto It = llvm::find_if(ExternalPCMs, [&Path](const Resource &R) {
+    return R.m_name == Path;
+  });
+  if (It == ExternalPCMs.end()) {
+    ExternalPCMs.push_back(Resource(std::move(PCM), Path));
+    return true;
+  }
+  if (It->m_file != PCM) {
+    Error = "the PCM '" + Path + "' changed during the compile";
+    return false;
+  }
+  return true;
+}
+
+// Returns the headers and the PCMs to map into the file system of a compile.
+// With the modules given, the other PCMs are left out, so they don't get
+// loaded (and decompressed) for nothing. The external PCMs are mapped under
+// their path.
+static bool GetHeaders(std::vector<Resource> &Result,
+                       const llvm::SmallVectorImpl<llvm::StringRef> *Modules,
+                       llvm::ArrayRef<Resource> ExternalPCMs) {
   Result.clear();
-  Result.reserve(sizeof(Headers) / sizeof(*Headers));
+  Result.reserve(RESOURCE_COUNT + ExternalPCMs.size());
 
   ResourceManager &RM = ResourceManager::instance();
-  for (auto Header : Headers) {
-    Resource R = RM.get_resource(Header.Name, Header.ID, "PCM", true);
+  for (int i = 0; i < RESOURCE_COUNT; ++i) {
+    ResourceIndex Index = static_cast<ResourceIndex>(i);
+    const char *Name = ResourceManager::get_resource_name(Index);
+    if (Modules && llvm::StringRef(Name).ends_with(".pcm") &&
+        llvm::find(*Modules, Name) == Modules->end())
+      continue;
+
+    Resource R = RM.get_resource(Index, true);
     if (!R) {
       assert(false && "Resource not found");
       return false;
@@ -134,211 +181,522 @@ static bool GetHeaders(std::vector<Resource> &Result) {
     Result.push_back(R);
   }
 
+  Result.insert(Result.end(), ExternalPCMs.begin(), ExternalPCMs.end());
   return true;
 }
 
-static void PrintCompileOptions(const char *pszOptions, const char *pszOptionsEx,
-                                const char *pszOpenCLVer, const char * pszSource) {
-#ifdef _DEBUG
-  static int ID = 0;
+// Sets the options the cc1 parser would have set from the text arguments
+static void ApplyCompileSettings(clang::CompilerInvocation &Invocation,
+                                 const CompileSettings &Settings) {
+  clang::PreprocessorOptions &PPOpts = Invocation.getPreprocessorOpts();
+  for (const auto &Macro : Settings.macros) {
+    if (Macro.second)
+      PPOpts.addMacroUndef(Macro.first);
+    else
+      PPOpts.addMacroDef(Macro.first);
+  }
+  PPOpts.Includes.insert(PPOpts.Includes.end(), Settings.includes.begin(),
+                         Settings.includes.end());
 
-  if (!getenv("CCLANG_OPTIONS_DIR")) return;
+  clang::HeaderSearchOptions &HSOpts = Invocation.getHeaderSearchOpts();
+  for (const auto &Dir : Settings.includeDirs)
+    HSOpts.AddPath(Dir, clang::frontend::Angled, /*IsFramework=*/false,
+                   /*IgnoreSysRoot=*/true);
 
-  std::string OptionsDir = getenv("CCLANG_OPTIONS_DIR");
+  clang::FrontendOptions &FEOpts = Invocation.getFrontendOpts();
+  FEOpts.ModuleFiles.insert(FEOpts.ModuleFiles.end(),
+                            Settings.moduleFiles.begin(),
+                            Settings.moduleFiles.end());
 
-  std::stringstream logPath;
-  logPath << OptionsDir << "/log_" << std::this_thread::get_id() << "_" << ID << ".txt";
-  std::cout << logPath.str() << std::endl;
+  clang::DiagnosticOptions &DiagOpts = Invocation.getDiagnosticOpts();
+  DiagOpts.IgnoreWarnings |= Settings.ignoreWarnings;
+  DiagOpts.Warnings.insert(DiagOpts.Warnings.end(), Settings.warnings.begin(),
+                           Settings.warnings.end());
+}
 
-  // Creating log file
-  std::ofstream logFile(logPath.str(), std::ios::out);
+// Prints the preprocessed source to the output stream of the compile, the
+// action created for -E writes it to a file.
+class PrintPreprocessedToStreamAction : public clang::PreprocessorFrontendAction {
+public:
+  explicit PrintPreprocessedToStreamAction(
+      std::unique_ptr<llvm::raw_pwrite_stream> OS)
+      : OS(std::move(OS)) {}
 
-  if (!logFile.is_open()) {
-    std::cout << "[ERROR] Can't create log file" << std::endl;
-    return;
+protected:
+  void ExecuteAction() override {
+    clang::CompilerInstance &CI = getCompilerInstance();
+    clang::DoPrintPreprocessedInput(CI.getPreprocessor(), OS.get(),
+                                    CI.getPreprocessorOutputOpts());
   }
 
-  logFile << "pszOptions=" << pszOptions << std::endl;
-  logFile << "pszOptionsEx=" << pszOptionsEx << std::endl;
-  logFile << "pszOpenCLVer=" << pszOpenCLVer << std::endl;
-  logFile << pszSource;
-  ++ID;
-  logFile.close();
-#endif
+private:
+  std::unique_ptr<llvm::raw_pwrite_stream> OS;
+};
+
+// Records every file the compile opens from the memory or the disk, the
+// system headers and the module files included. The headers a module file
+// was built from aren't read by the compile, the module file stands for them.
+//
+// The files are hashed at the end of the main file, while the buffers the
+// compile read are still held: the headers by the source manager and the
+// module files by the module manager. A file changed on the disk since then
+// isn't hashed by its new content.
+class CompileDependencyCollector : public clang::DependencyCollector {
+public:
+  explicit CompileDependencyCollector(clang::CompilerInstance &CI) : m_CI(CI) {}
+
+  bool needSystemDependencies() override { return true; }
+
+  bool sawDependency(llvm::StringRef Filename, bool FromModule, bool IsSystem,
+                     bool IsModuleFile, bool IsMissing) override {
+    return (!FromModule || IsModuleFile) &&
+           clang::DependencyCollector::sawDependency(
+               Filename, FromModule, IsSystem, IsModuleFile, IsMissing);
+  }
+
+  void finishedMainFile(clang::DiagnosticsEngine &) override {
+    for (const std::string &Name : getDependencies())
+      m_hashes.push_back(hash(Name));
+  }
+
+  // Returns the hash of the content of the dependency, 0 if the compile
+  // stopped before the end of the main file
+  uint64_t getHash(size_t Index) const {
+    return Index < m_hashes.size() ? m_hashes[Index] : 0;
+  }
+
+private:
+  uint64_t hash(llvm::StringRef Name) {
+    if (llvm::IntrusiveRefCntPtr<clang::ASTReader> Reader =
+            m_CI.getASTReader())
+      if (clang::serialization::ModuleFile *MF =
+              Reader->getModuleManager().lookupByFileName(Name))
+        return hash(MF->Buffer->getBuffer());
+
+    llvm::Expected<clang::FileEntryRef> File =
+        m_CI.getFileManager().getFileRef(Name);
+    if (!File) {
+      llvm::consumeError(File.takeError());
+      return 0;
+    }
+    std::optional<llvm::MemoryBufferRef> Buffer =
+        m_CI.getSourceManager().getMemoryBufferForFileOrNone(*File);
+    return Buffer ? hash(Buffer->getBuffer()) : 0;
+  }
+
+  static uint64_t hash(llvm::StringRef Data) {
+    return llvm::xxh3_64bits(llvm::arrayRefFromStringRef(Data));
+  }
+
+  clang::CompilerInstance &m_CI;
+  std::vector<uint64_t> m_hashes;
+};
+
+// Does the same as clang::ExecuteCompilerInvocation, but runs the frontend
+// action under the memory budget of the compile.
+static bool ExecuteCompile(clang::CompilerInstance &CI, MemoryBudget &Budget) {
+  CI.LoadRequestedPlugins();
+
+  // Honor -mllvm.
+  const std::vector<std::string> &LLVMArgs = CI.getFrontendOpts().LLVMArgs;
+  if (!LLVMArgs.empty()) {
+    llvm::SmallVector<const char *, 16> Args;
+    Args.push_back("clang (LLVM option parsing)");
+    for (const auto &Arg : LLVMArgs)
+      Args.push_back(Arg.c_str());
+    Args.push_back(nullptr);
+    llvm::cl::ParseCommandLineOptions(Args.size() - 1, Args.data());
+  }
+
+  // If there were errors in processing arguments, don't do anything else.
+  if (CI.getDiagnostics().hasErrorOccurred())
+    return false;
+
+  std::unique_ptr<clang::FrontendAction> Act;
+  if (CI.getFrontendOpts().ProgramAction ==
+      clang::frontend::PrintPreprocessedInput)
+    Act = std::make_unique<PrintPreprocessedToStreamAction>(
+        CI.takeOutputStream());
+  else
+    Act = clang::CreateFrontendAction(CI);
+  if (!Act)
+    return false;
+
+  MemoryBudgetAction BudgetAct(std::move(Act), Budget);
+  return CI.ExecuteAction(BudgetAct);
 }
 
-class SmallVectorBuffer : public std::streambuf
+class HostStreamBuffer : public std::streambuf
 {
-  // All memory management is delegated to llvm::SmallVectorImpl
-  llvm::SmallVectorImpl<char> &OS;
+  // All memory management is delegated to HostBuffer
+  HostBuffer &OS;
 
   // Since we don't touch any pointer in streambuf(pbase, pptr, epptr) this is
-  // the only method we need to override.
+  // the only method we need to override. A write the buffer can't grow for
+  // is reported as a short one rather than thrown through the translator, the
+  // stream goes bad then.
   virtual std::streamsize xsputn(const char *s, std::streamsize  n) override {
-    OS.append(s, s + n);
+    if (OS.failed() || !OS.tryAppend(s, n))
+      return 0;
     return n;
   }
 
 public:
-  SmallVectorBuffer() = delete;
-  SmallVectorBuffer(const SmallVectorBuffer&) = delete;
-  SmallVectorBuffer &operator=(const SmallVectorBuffer&) = delete;
-  SmallVectorBuffer(llvm::SmallVectorImpl<char> &O) : OS(O) {}
+  HostStreamBuffer() = delete;
+  HostStreamBuffer(const HostStreamBuffer&) = delete;
+  HostStreamBuffer &operator=(const HostStreamBuffer&) = delete;
+  HostStreamBuffer(HostBuffer &O) : OS(O) {}
 };
 
-extern "C" CC_DLL_EXPORT int
-Compile(const char *pszProgramSource, const char **pInputHeaders,
-        unsigned int uiNumInputHeaders, const char **pInputHeadersNames,
-        const char *pPCHBuffer, size_t uiPCHBufferSize, const char *pszOptions,
-        const char *pszOptionsEx, const char *pszOpenCLVer,
-        IOCLFEBinaryResult **pBinaryResult) {
+// Translates the module to SPIR-V appended to the buffer. The translator
+// doesn't check the stream, so a buffer that couldn't grow (Output.failed())
+// is caught here rather than passed on as truncated SPIR-V.
+static bool TranslateToSPIRV(llvm::Module &M, const SPIRV::TranslatorOpts &Opts,
+                             HostBuffer &Output, std::string &Err) {
+  HostStreamBuffer StreamBuf(Output);
+  std::ostream OS(&StreamBuf);
+  bool Translated = llvm::writeSpirv(&M, Opts, OS, Err);
+  if (!OS.good() || Output.failed()) {
+    Err = "error: out of host memory\n";
+    return false;
+  }
+  return Translated;
+}
 
-  // Capturing cclang compile options
-  PrintCompileOptions(pszOptions, pszOptionsEx, pszOpenCLVer, pszProgramSource);
+// Translates the module to the SPIR-V output of the results, the module and
+// its context are released once done
+static bool TranslateInBackground(OCLFEBinaryResult *Result,
+                                  SPIRV::TranslatorOpts Opts,
+                                  std::unique_ptr<llvm::LLVMContext> Context,
+                                  std::unique_ptr<llvm::Module> M) {
+  std::string Err;
+  bool Translated = false;
+  try {
+    Translated =
+        TranslateToSPIRV(*M, Opts, Result->getSPIRVBufferRef(), Err);
+  } catch (const std::bad_alloc &) {
+    Err = "error: out of host memory\n";
+  }
+  M.reset();
+  Context.reset();
+  Result->getLogRef() += Err;
+  return Translated;
+}
 
-  // Lazy initialization
-  OpenCLClangInitialize();
+// The in-memory files of a compile: the source, the input headers, and the
+// embedded headers and PCMs. They are only read once mapped, so the variants
+// of CompileVariants share them.
+struct CompileFiles {
+  llvm::IntrusiveRefCntPtr<llvm::vfs::InMemoryFileSystem> MemFS{
+      new llvm::vfs::InMemoryFileSystem};
+  // keeps the memory of the resources mapped to MemFS alive
+  std::vector<Resource> Resources;
+};
 
-  try {
+// Maps the headers, the given PCMs, all of them if Modules is null, the
+// external PCMs and the input headers to the files
+static bool
+AddCompileFiles(CompileFiles &Files,
+                const llvm::SmallVectorImpl<llvm::StringRef> *Modules,
+                llvm::ArrayRef<Resource> ExternalPCMs,
+                const char **pInputHeaders, unsigned int uiNumInputHeaders,
+                const char **pInputHeadersNames) {
+  // Input header with OpenCL defines, and the PCMs
+  if (!GetHeaders(Files.Resources, Modules, ExternalPCMs))
+    return false;
+
+  for (const auto &Header : Files.Resources) {
+    auto Buf = llvm::MemoryBuffer::getMemBuffer(
+        llvm::StringRef(Header.m_data, Header.m_size), Header.m_name);
+    Files.MemFS->addFile(Header.m_name, (time_t)0, std::move(Buf));
+  }
+
+  // Input Headers
+  for (unsigned int i = 0; i < uiNumInputHeaders; ++i) {
+    auto Header = llvm::MemoryBuffer::getMemBuffer(pInputHeaders[i],
+                                                   pInputHeadersNames[i]);
+    Files.MemFS->addFile(pInputHeadersNames[i], (time_t)0, std::move(Header));
+  }
+  return true;
+}
+
+// Fails a compile whose files couldn't be mapped, with the error in the log of
+// the result
+static int FailMappingFiles(const std::string &Error,
+                            IOCLFEBinaryResult **pBinaryResult) {
+  if (pBinaryResult) {
     std::unique_ptr<OCLFEBinaryResult> pResult(new OCLFEBinaryResult());
+    if (!Error.empty())
+      pResult->setLog("error: " + Error + "\n");
+    pResult->setResult(CL_COMPILE_PROGRAM_FAILURE);
+    *pBinaryResult = pResult.release();
+  }
+  return CL_COMPILE_PROGRAM_FAILURE;
+}
 
-    // Create the clang compiler
-    std::unique_ptr<clang::CompilerInstance> compiler(
-        new clang::CompilerInstance());
+// Compiles the source mapped to the files under the source name of the
+// options, to the caller's output buffer if one is given
+static int CompileWithFiles(CompileOptionsParser &optionsParser,
+                            const CompileFiles &Files,
+                            IOCLFEOutputBuffer *pOutput,
+                            IOCLFEBinaryResult **pBinaryResult) {
+  std::unique_ptr<OCLFEBinaryResult> pResult(new OCLFEBinaryResult(pOutput));
 
-    CompileOptionsParser optionsParser(pszOpenCLVer);
+  // Create the clang compiler
+  std::unique_ptr<clang::CompilerInstance> compiler(
+      new clang::CompilerInstance());
 
-    // Prepare error log
-    llvm::raw_string_ostream err_ostream(pResult->getLogRef());
+  // Prepare error log
+  llvm::raw_string_ostream err_ostream(pResult->getLogRef());
 
-    // Parse options
-    if (optionsParser.processOptions(pszOptions, pszOptionsEx) != 0) {
-      if (pBinaryResult)
-        *pBinaryResult = nullptr;
-      return CL_INVALID_BUILD_OPTIONS;
-    }
+  // Prepare our diagnostic client.
+  llvm::IntrusiveRefCntPtr<clang::DiagnosticIDs> DiagID(
+      new clang::DiagnosticIDs());
+  clang::DiagnosticOptions DiagOpts;
+  // The diagnostics are recorded as structs, the text is rendered lazily
+  DiagnosticRecorder *DiagsRecorder = new DiagnosticRecorder(
+      optionsParser.getMaxDiagnostics(), optionsParser.getMaxLogBytes());
+  llvm::IntrusiveRefCntPtr<clang::DiagnosticsEngine> Diags(
+      new clang::DiagnosticsEngine(DiagID, DiagOpts, DiagsRecorder));
 
-    // Prepare our diagnostic client.
-    llvm::IntrusiveRefCntPtr<clang::DiagnosticIDs> DiagID(
-        new clang::DiagnosticIDs());
-    clang::DiagnosticOptions DiagOpts;
-    DiagOpts.ShowPresumedLoc = true;
-    clang::TextDiagnosticPrinter *DiagsPrinter =
-      new clang::TextDiagnosticPrinter(err_ostream, DiagOpts);
-    llvm::IntrusiveRefCntPtr<clang::DiagnosticsEngine> Diags(
-        new clang::DiagnosticsEngine(DiagID, DiagOpts, DiagsPrinter));
-
-    // Prepare output buffer
+  // Prepare output buffer. The LLVM IR translated to SPIR-V is kept apart
+  // from the caller's buffer, which only gets the SPIR-V, unless the LLVM IR
+  // is an output too.
+  HostBuffer LLVMIRBuffer;
+  HostBuffer &IRBuffer = pOutput && optionsParser.hasEmitSPIRV() &&
+                                 !optionsParser.hasEmitBitcodeAndSPIRV()
+                             ? LLVMIRBuffer
+                             : pResult->getIRBufferRef();
+  // Set buffers
+  // CompilerInstance takes ownership over output stream. There is no output
+  // with -fsyntax-only.
+  if (!optionsParser.isSyntaxOnly()) {
     std::unique_ptr<llvm::raw_pwrite_stream>
-      ir_ostream(new llvm::raw_svector_ostream(pResult->getIRBufferRef()));
-    // Set buffers
-    // CompilerInstance takes ownership over output stream
+      ir_ostream(new raw_host_buffer_ostream(IRBuffer));
     compiler->setOutputStream(std::move(ir_ostream));
+  }
 
-    compiler->setDiagnostics(&*Diags);
+  compiler->setDiagnostics(&*Diags);
 
-    llvm::IntrusiveRefCntPtr<llvm::vfs::OverlayFileSystem> OverlayFS(
-        new llvm::vfs::OverlayFileSystem(llvm::vfs::getRealFileSystem()));
-    llvm::IntrusiveRefCntPtr<llvm::vfs::InMemoryFileSystem> MemFS(
-        new llvm::vfs::InMemoryFileSystem);
-    OverlayFS->pushOverlay(MemFS);
+  llvm::IntrusiveRefCntPtr<llvm::vfs::OverlayFileSystem> OverlayFS(
+      new llvm::vfs::OverlayFileSystem(llvm::vfs::getRealFileSystem()));
+  OverlayFS->pushOverlay(Files.MemFS);
 
-    compiler->setVirtualFileSystem(std::move(OverlayFS));
-    compiler->createFileManager();
-    compiler->createSourceManager();
+  compiler->setVirtualFileSystem(std::move(OverlayFS));
+  compiler->createFileManager();
+  compiler->createSourceManager();
 
-    // Create compiler invocation from user args before trickering with it
-    clang::CompilerInvocation::CreateFromArgs(compiler->getInvocation(),
-        optionsParser.args(), *Diags);
+  // The invocation built for the same options before is copied, only the
+  // input differs
+  InvocationCache &Cache = InvocationCache::instance();
+  std::string CacheKey;
+  if (optionsParser.useInvocationCache())
+    CacheKey = InvocationCache::getKey(optionsParser.args());
+  if (!CacheKey.empty() &&
+      Cache.get(CacheKey, compiler->getInvocation())) {
+    InvocationCache::patchInput(compiler->getInvocation(),
+                                optionsParser.args());
+  } else {
+    // Create compiler invocation from user args before trickering with it.
+    // The cc1 parser only gets the core options, the rest is set directly.
+    bool Created = clang::CompilerInvocation::CreateFromArgs(
+        compiler->getInvocation(), optionsParser.coreArgs(), *Diags);
+    ApplyCompileSettings(compiler->getInvocation(),
+                         optionsParser.getSettings());
+    // The invocations whose options were diagnosed are not cached, the
+    // copies wouldn't report the diagnostics
+    if (Created && !CacheKey.empty() && !Diags->hasErrorOccurred() &&
+        Diags->getNumWarnings() == 0)
+      Cache.put(CacheKey, compiler->getInvocation());
+  }
 
-    // Configure our handling of diagnostics.
-    ProcessWarningOptions(*Diags, compiler->getDiagnosticOpts(),
-                          compiler->getFileManager().getVirtualFileSystem());
+  // Configure our handling of diagnostics.
+  ProcessWarningOptions(*Diags, compiler->getDiagnosticOpts(),
+                        compiler->getFileManager().getVirtualFileSystem());
+  DiagsRecorder->setRenderOptions(compiler->getDiagnosticOpts());
+  // Stop the compile once the errors alone fill the diagnostics limit
+  if (optionsParser.getMaxDiagnostics())
+    Diags->setErrorLimit(optionsParser.getMaxDiagnostics());
 
-    // Map memory buffers to a virtual file system
-    MemFS->addFile(
-        optionsParser.getSourceName(), (time_t)0,
-        llvm::MemoryBuffer::getMemBuffer(
-          llvm::StringRef(pszProgramSource), optionsParser.getSourceName()));
+  // Record the files read, so a cache of the results could tell which ones
+  // the result depends on
+  std::shared_ptr<CompileDependencyCollector> Dependencies;
+  if (optionsParser.recordDependencies()) {
+    Dependencies = std::make_shared<CompileDependencyCollector>(*compiler);
+    compiler->addDependencyCollector(Dependencies);
+  }
 
-    // Input header with OpenCL defines.
-    std::vector<Resource> vHeaderWithDefs;
-    if (!GetHeaders(vHeaderWithDefs)) {
-      return CL_COMPILE_PROGRAM_FAILURE;
-    }
+  // Execute the frontend actions.
+  MemoryBudget budget(optionsParser.getMemoryBudget());
+  bool success = false;
+  try {
+    success = ExecuteCompile(*compiler, budget);
+  } catch (const std::exception &) {
+  }
+  if (Dependencies) {
+    llvm::ArrayRef<std::string> Names = Dependencies->getDependencies();
+    for (size_t i = 0; i < Names.size(); ++i)
+      pResult->addDependency(Names[i], Dependencies->getHash(i));
+  }
+  if (optionsParser.isPreprocessOnly())
+    pResult->setIRFormat(PreprocessedOutputName);
+  else if (!optionsParser.isSyntaxOnly())
+    pResult->setIRType(IR_TYPE_COMPILED_OBJECT);
+  pResult->setIRName(optionsParser.getSourceName());
+  pResult->setPeakAllocatedBytes(budget.getPeak());
+  DiagsRecorder->finish(pResult->getDiagnosticsRef());
 
-    for (const auto &Header:vHeaderWithDefs) {
-      auto Buf = llvm::MemoryBuffer::getMemBuffer(
-          llvm::StringRef(Header.m_data, Header.m_size),
-          Header.m_name);
+  // Our error handler depends on the Diagnostics object, which we're
+  // potentially about to delete. Uninstall the handler now so that any
+  // later errors use the default handling behavior instead.
+  // (currently commented out since setting the llvm error handling in
+  // multi-threaded environment is unsupported)
+  // llvm::remove_fatal_error_handler();
+  err_ostream.flush();
 
-      MemFS->addFile(Header.m_name,(time_t)0, std::move(Buf));
+  if (budget.isExceeded()) {
+    // The compile was aborted, but the log tells which budget was hit.
+    if (pBinaryResult) {
+      *pBinaryResult = pResult.release();
     }
+    return CL_OUT_OF_HOST_MEMORY;
+  }
 
-    // Input Headers
-    for (unsigned int i = 0; i < uiNumInputHeaders; ++i) {
-      auto Header = llvm::MemoryBuffer::getMemBuffer(
-          pInputHeaders[i], pInputHeadersNames[i]);
-      MemFS->addFile(pInputHeadersNames[i], (time_t)0, std::move(Header));
+  if (IRBuffer.failed()) {
+    // The output couldn't grow, e.g. the caller's Grow returned null, what
+    // was written of it is truncated
+    err_ostream << "error: out of host memory\n";
+    err_ostream.flush();
+    if (pBinaryResult) {
+      *pBinaryResult = pResult.release();
     }
+    return CL_OUT_OF_HOST_MEMORY;
+  }
 
-    // Execute the frontend actions.
-    bool success = false;
-    try {
-      success = clang::ExecuteCompilerInvocation(compiler.get());
-    } catch (const std::exception &) {
-    }
-    pResult->setIRType(IR_TYPE_COMPILED_OBJECT);
-    pResult->setIRName(optionsParser.getSourceName());
-
-    // Our error handler depends on the Diagnostics object, which we're
-    // potentially about to delete. Uninstall the handler now so that any
-    // later errors use the default handling behavior instead.
-    // (currently commented out since setting the llvm error handling in
-    // multi-threaded environment is unsupported)
-    // llvm::remove_fatal_error_handler();
-    err_ostream.flush();
+  if (success && optionsParser.hasEmitSPIRV()) {
+    // Translate LLVM IR to SPIR-V.
+    llvm::StringRef LLVM_IR(IRBuffer.data(), IRBuffer.size());
+    std::unique_ptr<llvm::MemoryBuffer> MB = llvm::MemoryBuffer::getMemBuffer(LLVM_IR, pResult->GetIRName(), false);
+    std::unique_ptr<llvm::LLVMContext> Context(new llvm::LLVMContext());
+    auto E = llvm::getOwningLazyBitcodeModule(std::move(MB), *Context,
+        /*ShouldLazyLoadMetadata=*/true);
+    llvm::logAllUnhandledErrors(E.takeError(), err_ostream, "error: ");
+    std::unique_ptr<llvm::Module> M = std::move(*E);
 
-    if (success && optionsParser.hasEmitSPIRV()) {
-      // Translate LLVM IR to SPIR-V.
-      llvm::StringRef LLVM_IR(static_cast<const char*>(pResult->GetIR()),
-          pResult->GetIRSize());
-      std::unique_ptr<llvm::MemoryBuffer> MB = llvm::MemoryBuffer::getMemBuffer(LLVM_IR, pResult->GetIRName(), false);
-      llvm::LLVMContext Context;
-      auto E = llvm::getOwningLazyBitcodeModule(std::move(MB), Context,
-          /*ShouldLazyLoadMetadata=*/true);
-      llvm::logAllUnhandledErrors(E.takeError(), err_ostream, "error: ");
-      std::unique_ptr<llvm::Module> M = std::move(*E);
-
-      if (M->materializeAll()) {
-        if (pBinaryResult) {
-          *pBinaryResult = nullptr;
-        }
-        assert(false && "Failed to read just compiled LLVM IR!");
-        return CL_COMPILE_PROGRAM_FAILURE;
+    if (M->materializeAll()) {
+      if (pBinaryResult) {
+        *pBinaryResult = nullptr;
       }
+      assert(false && "Failed to read just compiled LLVM IR!");
+      return CL_COMPILE_PROGRAM_FAILURE;
+    }
+    SPIRV::TranslatorOpts SPIRVOpts(SPIRV::VersionNumber::MaximumVersion,
+                                    optionsParser.getSPIRVExtStatusMap());
+    if (!optionsParser.hasSPIRVExt())
+      SPIRVOpts.enableAllExtensions();
+    if (!optionsParser.hasOptDisable()) {
+      SPIRVOpts.setMemToRegEnabled(true);
+    }
+    SPIRVOpts.setPreserveOCLKernelArgTypeMetadataThroughString(true);
+
+    if (optionsParser.hasEmitBitcodeAndSPIRV()) {
+      // The bitcode stays the first output. The module was read to a
+      // context of its own, so it's translated in the background while the
+      // caller goes on with the bitcode.
+      err_ostream.flush();
+      OCLFEBinaryResult *Result = pResult.get();
+      Result->getSPIRVBufferRef().tryReserve(LLVM_IR.size());
+      Result->setSPIRVTranslation(
+          std::async(std::launch::async, TranslateInBackground, Result,
+                     SPIRVOpts, std::move(Context), std::move(M))
+              .share());
+    } else {
       pResult->getIRBufferRef().clear();
-      SmallVectorBuffer StreamBuf(pResult->getIRBufferRef());
-      std::ostream OS(&StreamBuf);
+      // The SPIR-V is rarely smaller than the LLVM IR, which is a cheap
+      // estimate to save the caller's buffer the first few regrowths. It's
+      // only a hint, the translation reports a buffer that can't grow.
+      pResult->getIRBufferRef().tryReserve(LLVM_IR.size());
+      pResult->setIRFormat(SPIRVOutputName);
       std::string Err;
-      SPIRV::TranslatorOpts SPIRVOpts(SPIRV::VersionNumber::MaximumVersion,
-                                      optionsParser.getSPIRVExtStatusMap());
-      if (!optionsParser.hasSPIRVExt())
-        SPIRVOpts.enableAllExtensions();
-      if (!optionsParser.hasOptDisable()) {
-        SPIRVOpts.setMemToRegEnabled(true);
-      }
-      SPIRVOpts.setPreserveOCLKernelArgTypeMetadataThroughString(true);
-      success = llvm::writeSpirv(M.get(), SPIRVOpts, OS, Err);
+      success =
+          TranslateToSPIRV(*M, SPIRVOpts, pResult->getIRBufferRef(), Err);
       err_ostream << Err.c_str();
       err_ostream.flush();
     }
+  }
 
-    if (pBinaryResult) {
-      *pBinaryResult = pResult.release();
+  int Result = success ? CL_SUCCESS : CL_COMPILE_PROGRAM_FAILURE;
+  if (pResult->getIRBufferRef().failed())
+    Result = CL_OUT_OF_HOST_MEMORY;
+
+  if (pBinaryResult) {
+    *pBinaryResult = pResult.release();
+  }
+
+  return Result;
+}
+
+// Compiles to the caller's output buffer if one is given, to the buffer of the
+// results otherwise. The internal compiles of the library, the preload one,
+// always run in the calling process, they are there to warm up its state, and
+// aren't captured.
+static int CompileImpl(const char *pszProgramSource, const char **pInputHeaders,
+                       unsigned int uiNumInputHeaders,
+                       const char **pInputHeadersNames, const char *pPCHBuffer,
+                       size_t uiPCHBufferSize, const char *pszOptions,
+                       const char *pszOptionsEx, const char *pszOpenCLVer,
+                       IOCLFEOutputBuffer *pOutput,
+                       IOCLFEBinaryResult **pBinaryResult,
+                       bool Internal = false) {
+
+  // Forward the request to the worker processes if they are running
+  int workerResult;
+  if (!Internal &&
+      CompileInWorker(pszProgramSource, pInputHeaders, uiNumInputHeaders,
+                      pInputHeadersNames, pPCHBuffer, uiPCHBufferSize,
+                      pszOptions, pszOptionsEx, pszOpenCLVer, pOutput,
+                      pBinaryResult, workerResult))
+    return workerResult;
+
+  // Capturing the compile inputs. The workers capture the forwarded compiles
+  // themselves, so this goes after the forwarding. The internal compiles
+  // aren't the application's, the replay mustn't run them.
+  if (!Internal)
+    CaptureCompile(pszProgramSource, pInputHeaders, uiNumInputHeaders,
+                   pInputHeadersNames, pszOptions, pszOptionsEx, pszOpenCLVer);
+
+  // Lazy initialization
+  OpenCLClangInitialize();
+
+  try {
+    CompileOptionsParser optionsParser(pszOpenCLVer);
+
+    // Parse options
+    if (optionsParser.processOptions(pszOptions, pszOptionsEx,
+                                     pszProgramSource) != 0) {
+      if (pBinaryResult)
+        *pBinaryResult = nullptr;
+      return CL_INVALID_BUILD_OPTIONS;
     }
 
-    return success ? CL_SUCCESS : CL_COMPILE_PROGRAM_FAILURE;
+    // Map memory buffers to a virtual file system, with only the PCMs the
+    // compile uses
+    CompileFiles Files;
+    Files.MemFS->addFile(
+        optionsParser.getSourceName(), (time_t)0,
+        llvm::MemoryBuffer::getMemBuffer(
+          llvm::StringRef(pszProgramSource), optionsParser.getSourceName()));
+    llvm::SmallVector<llvm::StringRef, 4> Modules;
+    bool KnownModules = GetSelectedModules(optionsParser, Modules);
+    std::vector<Resource> ExternalPCMs;
+    std::string Error;
+    if (!AddExternalPCM(optionsParser, ExternalPCMs, Error) ||
+        !AddCompileFiles(Files, KnownModules ? &Modules : nullptr,
+                         ExternalPCMs, pInputHeaders, uiNumInputHeaders,
+                         pInputHeadersNames))
+      return FailMappingFiles(Error, pBinaryResult);
+
+    return CompileWithFiles(optionsParser, Files, pOutput, pBinaryResult);
   } catch (std::bad_alloc &) {
     if (pBinaryResult) {
       *pBinaryResult = NULL;
@@ -346,3 +704,333 @@ Compile(const char *pszProgramSource, const char **pInputHeaders,
     return CL_OUT_OF_HOST_MEMORY;
   }
 }
+
+extern "C" CC_DLL_EXPORT int
+Compile(const char *pszProgramSource, const char **pInputHeaders,
+        unsigned int uiNumInputHeaders, const char **pInputHeadersNames,
+        const char *pPCHBuffer, size_t uiPCHBufferSize, const char *pszOptions,
+        const char *pszOptionsEx, const char *pszOpenCLVer,
+        IOCLFEBinaryResult **pBinaryResult) {
+  return CompileImpl(pszProgramSource, pInputHeaders, uiNumInputHeaders,
+                     pInputHeadersNames, pPCHBuffer, uiPCHBufferSize,
+                     pszOptions, pszOptionsEx, pszOpenCLVer, nullptr,
+                     pBinaryResult);
+}
+
+extern "C" CC_DLL_EXPORT int
+CompileToBuffer(const char *pszProgramSource, const char **pInputHeaders,
+                unsigned int uiNumInputHeaders,
+                const char **pInputHeadersNames, const char *pPCHBuffer,
+                size_t uiPCHBufferSize, const char *pszOptions,
+                const char *pszOptionsEx, const char *pszOpenCLVer,
+                IOCLFEOutputBuffer *pOutput,
+                IOCLFEBinaryResult **pBinaryResult) {
+  if (!pOutput) {
+    if (pBinaryResult)
+      *pBinaryResult = nullptr;
+    return CL_INVALID_VALUE;
+  }
+  return CompileImpl(pszProgramSource, pInputHeaders, uiNumInputHeaders,
+                     pInputHeadersNames, pPCHBuffer, uiPCHBufferSize,
+                     pszOptions, pszOptionsEx, pszOpenCLVer, pOutput,
+                     pBinaryResult);
+}
+
+// Pool of the threads compiling the variants of CompileVariants
+static llvm::ThreadPoolInterface &GetCompilePool() {
+  static llvm::DefaultThreadPool Pool(llvm::hardware_concurrency());
+  return Pool;
+}
+
+extern "C" CC_DLL_EXPORT int
+CompileVariants(const char *pszProgramSource, const char **pInputHeaders,
+                unsigned int uiNumInputHeaders,
+                const char **pInputHeadersNames, const char *pszOptions,
+                const char *pszOptionsEx,
+                const OCLFECompileVariant *pVariants,
+                unsigned int uiNumVariants, int *pResults,
+                IOCLFEBinaryResult **pBinaryResults) {
+  if (!pVariants || uiNumVariants == 0)
+    return CL_INVALID_VALUE;
+
+  // Lazy initialization
+  OpenCLClangInitialize();
+
+  std::vector<int> Results(uiNumVariants, CL_SUCCESS);
+  std::vector<IOCLFEBinaryResult *> BinaryResults(uiNumVariants, nullptr);
+  try {
+    // The options of the variants
+    std::vector<std::string> Options(uiNumVariants), OptionsEx(uiNumVariants);
+    for (unsigned int i = 0; i < uiNumVariants; ++i) {
+      Options[i] = pszOptions ? pszOptions : "";
+      if (pVariants[i].pszTriple && *pVariants[i].pszTriple)
+        Options[i] += std::string(" -triple ") + pVariants[i].pszTriple;
+      OptionsEx[i] = pszOptionsEx ? pszOptionsEx : "";
+      if (pVariants[i].uiFlags & VARIANT_FP64)
+        OptionsEx[i] += " -cl-ext=+cl_khr_fp64";
+    }
+
+    // The files are mapped once for all the variants: the source under the
+    // source name of each of them, and the PCMs any of them uses
+    CompileFiles Files;
+    std::vector<std::unique_ptr<CompileOptionsParser>> Parsers(uiNumVariants);
+    llvm::SmallVector<llvm::StringRef, 8> Modules;
+    bool KnownModules = true;
+    std::vector<Resource> ExternalPCMs;
+    std::string MappingError;
+    bool Mapped = true;
+    for (unsigned int i = 0; i < uiNumVariants; ++i) {
+      std::unique_ptr<CompileOptionsParser> Parser(
+          new CompileOptionsParser(pVariants[i].pszOpenCLVer));
+      if (Parser->processOptions(Options[i].c_str(), OptionsEx[i].c_str(),
+                                 pszProgramSource) != 0)
+        continue;
+      Files.MemFS->addFile(
+          Parser->getSourceName(), (time_t)0,
+          llvm::MemoryBuffer::getMemBuffer(llvm::StringRef(pszProgramSource),
+                                           Parser->getSourceName()));
+      llvm::SmallVector<llvm::StringRef, 4> VariantModules;
+      KnownModules &= GetSelectedModules(*Parser, VariantModules);
+      for (llvm::StringRef Module : VariantModules)
+        if (llvm::find(Modules, Module) == Modules.end())
+          Modules.push_back(Module);
+      if (Mapped)
+        Mapped = AddExternalPCM(*Parser, ExternalPCMs, MappingError);
+      Parsers[i] = std::move(Parser);
+    }
+    if (Mapped)
+      Mapped = AddCompileFiles(Files, KnownModules ? &Modules : nullptr,
+                               ExternalPCMs, pInputHeaders, uiNumInputHeaders,
+                               pInputHeadersNames);
+
+    auto CompileVariant = [&](unsigned int i) {
+      const char *Ver = pVariants[i].pszOpenCLVer;
+      try {
+        // Forward the request to the worker processes if they are running
+        if (CompileInWorker(pszProgramSource, pInputHeaders,
+                            uiNumInputHeaders, pInputHeadersNames, nullptr, 0,
+                            Options[i].c_str(), OptionsEx[i].c_str(), Ver,
+                            nullptr, &BinaryResults[i], Results[i]))
+          return;
+        CaptureCompile(pszProgramSource, pInputHeaders, uiNumInputHeaders,
+                       pInputHeadersNames, Options[i].c_str(),
+                       OptionsEx[i].c_str(), Ver);
+        if (!Parsers[i])
+          Results[i] = CL_INVALID_BUILD_OPTIONS;
+        else if (!Mapped)
+          Results[i] = FailMappingFiles(MappingError, &BinaryResults[i]);
+        else
+          Results[i] =
+              CompileWithFiles(*Parsers[i], Files, nullptr, &BinaryResults[i]);
+      } catch (std::bad_alloc &) {
+        BinaryResults[i] = nullptr;
+        Results[i] = CL_OUT_OF_HOST_MEMORY;
+      }
+    };
+
+    // The variants only wait for each other, the pool may run the ones of
+    // other calls too
+    llvm::ThreadPoolTaskGroup Group(GetCompilePool());
+    for (unsigned int i = 0; i < uiNumVariants; ++i)
+      Group.async(CompileVariant, i);
+    Group.wait();
+  } catch (std::bad_alloc &) {
+    for (auto *pResult : BinaryResults)
+      if (pResult)
+        pResult->Release();
+    std::fill(BinaryResults.begin(), BinaryResults.end(), nullptr);
+    std::fill(Results.begin(), Results.end(), CL_OUT_OF_HOST_MEMORY);
+  }
+
+  int Result = CL_SUCCESS;
+  for (unsigned int i = 0; i < uiNumVariants; ++i) {
+    if (Result == CL_SUCCESS)
+      Result = Results[i];
+    if (pResults)
+      pResults[i] = Results[i];
+    if (pBinaryResults)
+      pBinaryResults[i] = BinaryResults[i];
+    else if (BinaryResults[i])
+      BinaryResults[i]->Release();
+  }
+  return Result;
+}
+
+// Reads a byte of every page, so the resource is paged in ahead of time
+static void TouchResource(const Resource &R) {
+  volatile char Sink = 0;
+  for (size_t i = 0; i < R.m_size; i += 4096)
+    Sink += R.m_data[i];
+  (void)Sink;
+}
+
+extern "C" CC_DLL_EXPORT int OpenCLClangPreload(const char *pszOpenCLVer,
+                                                const char *pszTriple,
+                                                unsigned int uiFlags) {
+  // Lazy initialization
+  OpenCLClangInitialize();
+
+  try {
+    llvm::StringRef Ver(pszOpenCLVer ? pszOpenCLVer : "120");
+    std::string Options = llvm::StringSwitch<const char *>(Ver)
+                              .Case("100", "-cl-std=CL1.0")
+                              .Case("110", "-cl-std=CL1.1")
+                              .Case("120", "-cl-std=CL1.2")
+                              .Case("200", "-cl-std=CL2.0")
+                              .Case("300", "-cl-std=CL3.0")
+                              .Case("310", "-cl-std=CL3.1")
+                              .Default("");
+    if (pszTriple && *pszTriple)
+      Options += std::string(" -triple ") + pszTriple;
+    const char *OptionsEx =
+        (uiFlags & PRELOAD_FP64) ? "-cl-ext=+cl_khr_fp64" : "";
+
+    // The options parser selects the PCM a compile with these settings uses
+    CompileOptionsParser optionsParser(Ver.str().c_str());
+    if (optionsParser.processOptions(Options.c_str(), OptionsEx) != 0)
+      return CL_INVALID_BUILD_OPTIONS;
+
+    // Load the headers and that PCM into the cache, the other PCMs are not
+    // touched
+    llvm::SmallVector<llvm::StringRef, 4> Modules;
+    GetSelectedModules(optionsParser, Modules);
+    std::vector<Resource> ExternalPCMs, vHeaders;
+    std::string Error;
+    if (!AddExternalPCM(optionsParser, ExternalPCMs, Error) ||
+        !GetHeaders(vHeaders, &Modules, ExternalPCMs))
+      return CL_COMPILE_PROGRAM_FAILURE;
+    for (const auto &Header : vHeaders)
+      TouchResource(Header);
+
+    if (uiFlags & PRELOAD_NO_COMPILE)
+      return CL_SUCCESS;
+
+    // A tiny compile initializes the rest of the LLVM and clang state and
+    // deserializes the builtin declarations it uses from the PCM. It runs in
+    // this process even with the workers running, whose state it doesn't
+    // warm up.
+    IOCLFEBinaryResult *pResult = nullptr;
+    int Err = CompileImpl(
+        "__kernel void preload(__global int *p) { p[get_global_id(0)] = 0; }",
+        nullptr, 0, nullptr, nullptr, 0, Options.c_str(), OptionsEx,
+        Ver.str().c_str(), nullptr, &pResult, /*Internal=*/true);
+    if (pResult)
+      pResult->Release();
+    return Err;
+  } catch (std::bad_alloc &) {
+    return CL_OUT_OF_HOST_MEMORY;
+  }
+}
+
+// Bumped whenever the fingerprint is computed differently
+static const char FingerprintFormat[] = "1";
+
+// Appends the 128-bit hash and the size of the data to the fingerprint input
+static void AddFingerprintField(std::string &Fields, llvm::StringRef Data) {
+  llvm::XXH128_hash_t Hash =
+      llvm::xxh3_128bits(llvm::arrayRefFromStringRef(Data));
+  uint64_t Words[] = {Hash.low64, Hash.high64, Data.size()};
+  Fields.append(reinterpret_cast<const char *>(Words), sizeof(Words));
+}
+
+// Returns the hash of the library version and of the content of the resources:
+// the headers and the PCMs embedded in the library, and the PCMs of the
+// external PCM directory the compile selected. Each resource is hashed once,
+// an external PCM again after the file has changed. The embedded resources are
+// hashed as they are stored, so compressed ones don't all get decompressed for
+// this.
+static bool GetResourcesFingerprint(std::string &Result,
+                                    llvm::ArrayRef<Resource> ExternalPCMs) {
+  std::vector<Resource> vHeaders;
+  ResourceManager &RM = ResourceManager::instance();
+  for (int i = 0; i < RESOURCE_COUNT; ++i) {
+    ResourceIndex Index = static_cast<ResourceIndex>(i);
+    Resource R = RM.get_stored_resource(Index);
+    if (!R)
+      return false;
+    vHeaders.push_back(R);
+  }
+  vHeaders.insert(vHeaders.end(), ExternalPCMs.begin(), ExternalPCMs.end());
+
+  static std::mutex Lock;
+  // the hashes of the resources by name, along with the resource they were
+  // computed from, which keeps a mapped file referenced
+  static std::map<std::string, std::pair<Resource, std::string>> Hashes;
+
+  Result.clear();
+  AddFingerprintField(Result, FingerprintFormat);
+  AddFingerprintField(Result, OPENCL_CLANG_VERSION);
+  AddFingerprintField(Result, LLVM_VERSION_STRING);
+
+  std::lock_guard<std::mutex> Guard(Lock);
+  for (const auto &Header : vHeaders) {
+    auto &Entry = Hashes[Header.m_name];
+    if (Entry.first.m_data != Header.m_data ||
+        Entry.first.m_size != Header.m_size) {
+      Entry.second.clear();
+      AddFingerprintField(Entry.second, Header.m_name);
+      AddFingerprintField(Entry.second,
+                          llvm::StringRef(Header.m_data, Header.m_size));
+      Entry.first = Header;
+    }
+    Result += Entry.second;
+  }
+  return true;
+}
+
+extern "C" CC_DLL_EXPORT int ComputeCompileFingerprint(
+    const char *pszProgramSource, const char **pInputHeaders,
+    unsigned int uiNumInputHeaders, const char **pInputHeadersNames,
+    const char *pszOptions, const char *pszOptionsEx, const char *pszOpenCLVer,
+    unsigned char *pFingerprint) {
+  if (!pFingerprint ||
+      (uiNumInputHeaders && (!pInputHeaders || !pInputHeadersNames)))
+    return CL_INVALID_VALUE;
+
+  try {
+    // The deterministic source name keeps the generated source names of the
+    // compiles from being consumed, and the canonical options drop it anyway
+    std::string OptionsEx = pszOptionsEx ? pszOptionsEx : "";
+    OptionsEx += " -deterministic-source-name";
+    const char *Ver = pszOpenCLVer ? pszOpenCLVer : "120";
+    CompileOptionsParser optionsParser(Ver);
+    if (optionsParser.processOptions(pszOptions ? pszOptions : "",
+                                     OptionsEx.c_str()) != 0)
+      return CL_INVALID_BUILD_OPTIONS;
+
+    // The resources are those the compile would map
+    std::vector<Resource> ExternalPCMs;
+    std::string Error, Fields;
+    if (!AddExternalPCM(optionsParser, ExternalPCMs, Error) ||
+        !GetResourcesFingerprint(Fields, ExternalPCMs))
+      return CL_COMPILE_PROGRAM_FAILURE;
+
+    AddFingerprintField(Fields, Ver);
+    AddFingerprintField(Fields, optionsParser.getCanonicalOptions());
+    AddFingerprintField(Fields, pszProgramSource ? pszProgramSource : "");
+
+    // The headers are looked up by name, so their order doesn't matter
+    std::vector<unsigned int> Order(uiNumInputHeaders);
+    for (unsigned int i = 0; i < uiNumInputHeaders; ++i)
+      Order[i] = i;
+    std::stable_sort(Order.begin(), Order.end(),
+                     [&](unsigned int L, unsigned int R) {
+                       return strcmp(pInputHeadersNames[L],
+                                     pInputHeadersNames[R]) < 0;
+                     });
+    for (unsigned int i : Order) {
+      AddFingerprintField(Fields, pInputHeadersNames[i]);
+      AddFingerprintField(Fields, pInputHeaders[i]);
+    }
+
+    llvm::XXH128_hash_t Hash =
+        llvm::xxh3_128bits(llvm::arrayRefFromStringRef(Fields));
+    for (int i = 0; i < 8; ++i) {
+      pFingerprint[i] = static_cast<unsigned char>(Hash.low64 >> (8 * i));
+      pFingerprint[8 + i] = static_cast<unsigned char>(Hash.high64 >> (8 * i));
+    }
+    return CL_SUCCESS;
+  } catch (std::bad_alloc &) {
+    return CL_OUT_OF_HOST_MEMORY;
+  }
+}
@@ -43,6 +43,86 @@ enum IR_TYPE {
   IR_TYPE_COMPILED_OBJECT
 };
 
+//
+// Flags of OpenCLClangPreload
+//
+enum PRELOAD_FLAGS {
+  // preload the PCM used when cl_khr_fp64 is enabled
+  PRELOAD_FP64 = 1 << 0,
+  // only load the resources, skip the dummy compile
+  PRELOAD_NO_COMPILE = 1 << 1
+};
+
+//
+// Flags of OCLFECompileVariant
+//
+enum COMPILE_VARIANT_FLAGS {
+  // enable cl_khr_fp64
+  VARIANT_FP64 = 1 << 0
+};
+
+//
+// Variant of a program compiled by CompileVariants
+//
+struct OCLFECompileVariant {
+  // OpenCL version string - "120" for OpenCL 1.2, "200" for OpenCL 2.0, ...
+  const char *pszOpenCLVer;
+  // optional target triple, the one set by the options if NULL
+  const char *pszTriple;
+  // combination of COMPILE_VARIANT_FLAGS
+  unsigned int uiFlags;
+};
+
+//
+// Severity of a diagnostic
+//
+enum DIAG_SEVERITY {
+  DIAG_NOTE,
+  DIAG_REMARK,
+  DIAG_WARNING,
+  DIAG_ERROR,
+  DIAG_FATAL
+};
+
+//
+// Offset of a missing string in the diagnostic strings buffer
+//
+const unsigned int DIAG_NO_STRING = ~0u;
+
+//
+// Fix-it hint of a diagnostic: replaces the given range with the code
+// Lines and columns are 1-based, the end column is past the replaced text
+//
+struct OCLFEFixIt {
+  unsigned int uiLine;
+  unsigned int uiColumn;
+  unsigned int uiEndLine;
+  unsigned int uiEndColumn;
+  // offset of the code to insert in the diagnostic strings buffer
+  unsigned int uiCodeOffset;
+};
+
+//
+// Diagnostic reported during compilation
+// The strings are referred to by their offsets in the diagnostic strings
+// buffer, DIAG_NO_STRING if missing
+//
+struct OCLFEDiagnostic {
+  DIAG_SEVERITY severity;
+  // clang diagnostic ID
+  unsigned int uiID;
+  // file name, line and column of the location, 0 if there is no location
+  unsigned int uiFileOffset;
+  unsigned int uiLine;
+  unsigned int uiColumn;
+  unsigned int uiMessageOffset;
+  // text of the source line of the location
+  unsigned int uiSourceLineOffset;
+  // range of the fix-its of the diagnostic in the fix-its array
+  unsigned int uiFirstFixIt;
+  unsigned int uiNumFixIts;
+};
+
 //
 // Compilation results interface
 // Returned by Compile method
@@ -57,14 +137,79 @@ struct IOCLFEBinaryResult {
   // Returns the type of the resulted binary
   virtual IR_TYPE GetIRType() const = 0;
   // Returns the pointer to the compilation log string or NULL if not log was
-  // created
+  // created. The diagnostics are rendered to the log on the first call.
   virtual const char *GetErrorLog() const = 0;
-  // Releases the result object
+  // Releases the result object, or the caller's reference to it if it was
+  // retained with IOCLFEBinaryResult2::Retain
   virtual void Release() = 0;
 
 protected:
   virtual ~IOCLFEBinaryResult() {}
 };
+
+//
+// Extended compilation results interface
+// The results returned by Compile always implement it, so the
+// IOCLFEBinaryResult pointer could be safely static_cast'ed to it
+//
+struct IOCLFEBinaryResult2 : public IOCLFEBinaryResult {
+  // Returns the peak number of bytes held by the frontend during compilation
+  virtual size_t GetPeakAllocatedBytes() const = 0;
+  // Returns the number of the diagnostics reported during compilation
+  virtual unsigned int GetDiagnosticCount() const = 0;
+  // Returns the array of GetDiagnosticCount() diagnostics, in the order they
+  // were reported
+  virtual const OCLFEDiagnostic *GetDiagnostics() const = 0;
+  // Returns the fix-its referred to by the diagnostics
+  virtual const OCLFEFixIt *GetFixIts() const = 0;
+  // Returns the buffer of the null terminated strings referred to by the
+  // diagnostics and the fix-its
+  virtual const char *GetDiagnosticStrings() const = 0;
+  // Adds a reference to the result object, which is destroyed when Release
+  // is called once per reference, the one returned by Compile included. The
+  // results are immutable, so the holders could read them concurrently
+  // without copying the IR.
+  virtual void Retain() = 0;
+  // Returns the number of the outputs of the compile, the first of which is
+  // the one returned by GetIR. With -emit-bitcode-and-spirv in pszOptionsEx
+  // the LLVM bitcode is the first output and the SPIR-V is the second one.
+  virtual unsigned int GetOutputCount() const = 0;
+  // Returns the name of the output: "llvm-bc", "spirv" or "preprocessed"
+  virtual const char *GetOutputName(unsigned int uiIndex) const = 0;
+  // Returns the pointer to the output or NULL if it wasn't produced. The
+  // SPIR-V of -emit-bitcode-and-spirv is translated in the background after
+  // Compile returns, reading it or the log waits for the translation to end.
+  virtual const void *GetOutput(unsigned int uiIndex) const = 0;
+  // Returns the size in bytes of the output
+  virtual size_t GetOutputSize(unsigned int uiIndex) const = 0;
+  // Returns the number of the files the compile read: the source, the
+  // headers from the memory or the disk, and the module files. The headers
+  // built into a module file are covered by the hash of the module file.
+  // The files are only recorded with -record-dependencies in pszOptionsEx.
+  virtual unsigned int GetDependencyCount() const = 0;
+  // Returns the path of the file as the compile opened it
+  virtual const char *GetDependencyName(unsigned int uiIndex) const = 0;
+  // Returns the 64-bit XXH3 hash of the content the compile read from the
+  // file, 0 if it couldn't be hashed or the compile stopped early
+  virtual unsigned long long GetDependencyHash(unsigned int uiIndex) const = 0;
+
+protected:
+  virtual ~IOCLFEBinaryResult2() {}
+};
+
+//
+// Output buffer owned by the caller
+// Passed to CompileToBuffer, which writes the compiled IR directly to it
+//
+struct IOCLFEOutputBuffer {
+  // Resizes the buffer to at least uiSize bytes, keeping its contents.
+  // Returns the pointer to the buffer memory, which may have moved, or NULL
+  // on failure. The library only writes below the size it last asked for.
+  virtual void *Grow(size_t uiSize) = 0;
+
+protected:
+  virtual ~IOCLFEOutputBuffer() {}
+};
 }
 }
 }
@@ -103,6 +248,26 @@ extern "C" CC_DLL_EXPORT bool CheckCompileOptions(
 //    pBinaryResult - optional outbound pointer to the compilation results
 // Returns:
 //    Compilation Result as int:  0 - success, error otherwise.
+//    CL_OUT_OF_HOST_MEMORY is returned if the memory held by the frontend
+//    exceeds the budget set by -compile-memory-budget=<bytes> in pszOptionsEx.
+//    The compilation log is still returned in this case. The budget covers
+//    the AST, the preprocessor and the source manager, not the LLVM module
+//    generated from the AST.
+//    The log could be limited with -max-diagnostics=<N> and
+//    -max-log-bytes=<bytes> in pszOptionsEx. The warnings and notes past the
+//    limit are dropped, and a note at the end of the log tells how many.
+//    The compiler invocations built for the options are cached and reused by
+//    the compiles with the same options, -no-invocation-cache in
+//    pszOptionsEx disables that.
+//    -emit-bitcode-and-spirv in pszOptionsEx produces both the LLVM bitcode
+//    and the SPIR-V from a single frontend run, see
+//    IOCLFEBinaryResult2::GetOutput. The return value only accounts for the
+//    bitcode, a failed translation to SPIR-V leaves the SPIR-V output NULL
+//    and is reported in the log.
+//    -fsyntax-only in pszOptionsEx stops the compile after the semantic
+//    analysis, only the log and the diagnostics are returned. -E in
+//    pszOptionsEx returns the preprocessed source, not null terminated, as
+//    the "preprocessed" output instead of the IR. Both ignore -emit-spirv.
 //
 extern "C" CC_DLL_EXPORT int Compile(
     // A pointer to main program's source (null terminated string)
@@ -127,3 +292,215 @@ extern "C" CC_DLL_EXPORT int Compile(
     // optional outbound pointer to the compilation results
     Intel::OpenCL::ClangFE::IOCLFEBinaryResult **pBinaryResult);
 
+//
+// Compiles the given OpenCL program to the LLVM IR or SPIR-V written directly
+// to the caller's buffer, rather than to a buffer of the results the caller
+// would have to copy it from
+// Params:
+//    the same as of Compile
+//    pOutput - the buffer to write the compiled IR to
+// Returns:
+//    the same as Compile, CL_INVALID_VALUE if pOutput is NULL, and
+//    CL_OUT_OF_HOST_MEMORY if pOutput fails to grow.
+//    The size of the IR is returned by GetIRSize of the results, and their
+//    GetIR points to the memory of pOutput, so it's only valid while pOutput
+//    is. The buffer might be grown past the size of the IR, e.g. it's grown
+//    to the size of the LLVM IR up front when the IR is translated to SPIR-V.
+//    Only the first output of the compile is written to pOutput.
+//
+extern "C" CC_DLL_EXPORT int CompileToBuffer(
+    // A pointer to main program's source (null terminated string)
+    const char *pszProgramSource,
+    // array of additional input headers to be passed in memory (each null
+    // terminated)
+    const char **pInputHeaders,
+    // the number of input headers in pInputHeaders
+    unsigned int uiNumInputHeaders,
+    // array of input headers names corresponding to pInputHeaders
+    const char **pInputHeadersNames,
+    // optional pointer to the pch buffer
+    const char *pPCHBuffer,
+    // size of the pch buffer
+    size_t uiPCHBufferSize,
+    // OpenCL application supplied options
+    const char *pszOptions,
+    // optional extra options string usually supplied by runtime
+    const char *pszOptionsEx,
+    // OpenCL version string - "120" for OpenCL 1.2, "200" for OpenCL 2.0, ...
+    const char *pszOpenCLVer,
+    // the buffer to write the compiled IR to
+    Intel::OpenCL::ClangFE::IOCLFEOutputBuffer *pOutput,
+    // optional outbound pointer to the compilation results
+    Intel::OpenCL::ClangFE::IOCLFEBinaryResult **pBinaryResult);
+
+//
+// Compiles the given OpenCL program for several variants at once, each on a
+// thread of the pool of the library. The variants share the source, the input
+// headers and the headers and PCMs mapped for the compiles, which are set up
+// once rather than by every compile. A variant is compiled as Compile would
+// with "-triple <pszTriple>" appended to pszOptions and, with VARIANT_FP64,
+// "-cl-ext=+cl_khr_fp64" appended to pszOptionsEx.
+// Params:
+//    the same as of Compile, except for the version, which is given by the
+//    variants
+//    pVariants - array of the variants
+//    uiNumVariants - size of the pVariants array
+//    pResults - optional outbound array of uiNumVariants return values, the
+//    ones Compile returns for the variants
+//    pBinaryResults - optional outbound array of uiNumVariants pointers to
+//    the compilation results of the variants
+// Returns:
+//    0 if all the variants were compiled, the error of the first variant that
+//    failed otherwise, CL_INVALID_VALUE if there are no variants
+//
+extern "C" CC_DLL_EXPORT int CompileVariants(
+    // A pointer to main program's source (null terminated string)
+    const char *pszProgramSource,
+    // array of additional input headers to be passed in memory (each null
+    // terminated)
+    const char **pInputHeaders,
+    // the number of input headers in pInputHeaders
+    unsigned int uiNumInputHeaders,
+    // array of input headers names corresponding to pInputHeaders
+    const char **pInputHeadersNames,
+    // OpenCL application supplied options
+    const char *pszOptions,
+    // optional extra options string usually supplied by runtime
+    const char *pszOptionsEx,
+    // array of the variants to compile
+    const Intel::OpenCL::ClangFE::OCLFECompileVariant *pVariants,
+    // the number of the variants in pVariants
+    unsigned int uiNumVariants,
+    // optional outbound array of the return values of the variants
+    int *pResults,
+    // optional outbound array of the compilation results of the variants
+    Intel::OpenCL::ClangFE::IOCLFEBinaryResult **pBinaryResults);
+
+//
+// Host memory allocation callbacks, see SetHostAllocator
+//
+typedef void *(*OCLFE_ALLOC_FN)(size_t size, void *pUserData);
+typedef void *(*OCLFE_REALLOC_FN)(void *ptr, size_t size, void *pUserData);
+typedef void (*OCLFE_FREE_FN)(void *ptr, void *pUserData);
+
+//
+// Registers the host allocator for the memory owned by the library: the
+// buffers of the compilation results. The cached resources live as long as
+// the library and use the default allocator. The AST and the LLVM IR are
+// still allocated by clang and LLVM, which have no hooks for that.
+// Must be called before the first compilation: the allocator can't be
+// changed once the library has allocated any memory.
+// Params:
+//    pfnAlloc, pfnRealloc, pfnFree - the allocation callbacks, all of them
+//    or none of them must be set. Passing none restores the default malloc
+//    based allocator.
+//    pUserData - optional pointer passed to each of the callbacks
+// Returns:
+//    true if the allocator was registered, false otherwise
+//
+extern "C" CC_DLL_EXPORT bool SetHostAllocator(
+    // allocates the given number of bytes
+    OCLFE_ALLOC_FN pfnAlloc,
+    // resizes a block allocated by pfnAlloc/pfnRealloc, or allocates a new
+    // one if ptr is NULL
+    OCLFE_REALLOC_FN pfnRealloc,
+    // frees a block allocated by pfnAlloc/pfnRealloc
+    OCLFE_FREE_FN pfnFree,
+    // optional user data passed to the callbacks
+    void *pUserData);
+
+//
+// Warms up the library ahead of the first Compile, which otherwise pays for
+// loading the resources and initializing LLVM. Loads the resources, pages in
+// the PCM used with the given settings and runs a tiny dummy compile in the
+// calling process, also when the compiles are forwarded to the workers. Could
+// be called from a background thread at startup.
+// Params:
+//    pszOpenCLVer - OpenCL version of the device - "120" for OpenCL 1.2, ...
+//    pszTriple - optional target triple, the default spir triple if NULL
+//    uiFlags - combination of PRELOAD_FLAGS
+// Returns:
+//    0 on success, error otherwise
+//
+extern "C" CC_DLL_EXPORT int OpenCLClangPreload(
+    // OpenCL version string - "120" for OpenCL 1.2, "200" for OpenCL 2.0, ...
+    const char *pszOpenCLVer,
+    // optional target triple
+    const char *pszTriple,
+    // combination of PRELOAD_FLAGS
+    unsigned int uiFlags);
+
+//
+// Computes the fingerprint of a compile for the caches of the compiled
+// programs. The fingerprint is computed over the effective options in a
+// canonical form, so e.g. the order of the macro definitions or of the -cl-ext
+// entries doesn't change it, and over the source, the input headers, the
+// library version and the embedded headers and PCMs. It doesn't cover:
+//  - the files read from disk, through -I or -include, the caller has to
+//    check them, e.g. with the dependencies of the result;
+//  - the source name generated for each compile, which the binary holds
+//    unless -deterministic-source-name is passed via pszOptionsEx;
+//  - the log of a macro defined more than once, only the last definition of
+//    a macro is kept, so the redefinition warnings are not.
+// The compiles with equal fingerprints produce the same binary only within
+// those limits.
+// Params:
+//    the same as of Compile
+//    pFingerprint - outbound buffer of 16 bytes for the fingerprint
+// Returns:
+//    0 on success, CL_INVALID_BUILD_OPTIONS if the options are invalid,
+//    error otherwise
+//
+extern "C" CC_DLL_EXPORT int ComputeCompileFingerprint(
+    // A pointer to main program's source (null terminated string)
+    const char *pszProgramSource,
+    // array of additional input headers (each null terminated)
+    const char **pInputHeaders,
+    // the number of input headers in pInputHeaders
+    unsigned int uiNumInputHeaders,
+    // array of input headers names corresponding to pInputHeaders
+    const char **pInputHeadersNames,
+    // OpenCL application supplied options
+    const char *pszOptions,
+    // optional extra options string usually supplied by runtime
+    const char *pszOptionsEx,
+    // OpenCL version string - "120" for OpenCL 1.2, "200" for OpenCL 2.0, ...
+    const char *pszOpenCLVer,
+    // outbound buffer of 16 bytes
+    unsigned char *pFingerprint);
+
+//
+// Starts a pool of worker processes and makes Compile forward the requests to
+// them. The sources and the results are passed through shared memory. A crash
+// or a hang of a compile only takes its worker down, the worker is restarted
+// and the compile fails with CL_COMPILE_PROGRAM_FAILURE. Supported on Linux
+// only.
+// Params:
+//    pszWorkerPath - optional path to the opencl-clang-worker executable, it
+//    is searched in PATH if NULL
+//    uiNumWorkers - number of the worker processes
+//    uiTimeoutMs - time limit of a single compile in milliseconds, 0 for none
+// Returns:
+//    true if the workers were started, false otherwise
+//
+extern "C" CC_DLL_EXPORT bool StartCompileWorkers(
+    // optional path to the worker executable
+    const char *pszWorkerPath,
+    // the number of the worker processes
+    unsigned int uiNumWorkers,
+    // time limit of a single compile in milliseconds
+    unsigned int uiTimeoutMs);
+
+//
+// Stops the worker processes started with StartCompileWorkers, Compile runs
+// in-process again
+//
+extern "C" CC_DLL_EXPORT void StopCompileWorkers();
+
+//
+// Serves the compile requests received over the given socket until the client
+// closes it. This is the entry point of the opencl-clang-worker executable.
+// Returns:
+//    0 if the client closed the connection, non-zero on a protocol error
+//
+extern "C" CC_DLL_EXPORT int RunCompileWorker(int iSocket);
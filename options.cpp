@@ -98,8 +98,7 @@ OpenCLArgList *OpenCLOptTable::ParseArgs(const char *szOptions,
       break;
     }
 
-    pArgs->append(pArg.get());
-    m_synthesizedArgs.emplace_back(std::move(pArg));
+    pArgs->appendOwned(std::move(pArg));
   }
   return pArgs.release();
 }
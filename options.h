@@ -36,6 +36,14 @@ Copyright (c) Intel Corporation (2009-2017).
 
 #include <atomic>
 #include <list>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace llvm {
+class MemoryBuffer;
+}
 
 enum COMPILE_OPT_ID {
   OPT_COMPILE_INVALID = 0, // This is not an option ID.
@@ -80,6 +88,13 @@ public:
 
   std::string getFilteredArgs(int id) const;
 
+  // Appends the argument parsed from the strings of this list and takes its
+  // ownership
+  void appendOwned(std::unique_ptr<llvm::opt::Arg> pArg) {
+    append(pArg.get());
+    m_ownedArgs.push_back(std::move(pArg));
+  }
+
 public:
   /// MakeIndex - Get an index for the given string(s).
   unsigned MakeIndex(llvm::StringRef str) const;
@@ -106,11 +121,17 @@ private:
 
   /// The number of original input argument strings.
   unsigned m_uiOriginalArgsCount;
+
+  /// Arguments parsed from the strings of this list.
+  std::vector<std::unique_ptr<llvm::opt::Arg>> m_ownedArgs;
 };
 
 //
 // OpenCL specific OptTable
 //
+// The parsed arguments are owned by the returned list, so the table is not
+// modified by the parsing and may be shared by the threads.
+//
 class OpenCLOptTable : public llvm::opt::GenericOptTable {
 public:
   OpenCLOptTable(llvm::ArrayRef<Info> pOptionInfos)
@@ -118,16 +139,16 @@ public:
 
   OpenCLArgList *ParseArgs(const char *szOptions, unsigned &missingArgIndex,
                            unsigned &missingArgCount) const;
-
-private:
-  /// Synthesized arguments - owned to avoid memory leaks.
-  mutable std::vector<std::unique_ptr<llvm::opt::Arg>> m_synthesizedArgs;
 };
 
 // OpenCL OptTable for compile options
 class OpenCLCompileOptTable : public OpenCLOptTable {
 public:
   OpenCLCompileOptTable();
+
+  // Returns the table shared by all the compile options parsers, it is
+  // created on the first use
+  static const OpenCLCompileOptTable &get();
 };
 
 // OpenCL OptTable for link options
@@ -148,32 +169,77 @@ public:
 
   std::string processOptions(const OpenCLArgList &args,
                              const char *pszOptionsEx,
-                             ArgsVector &effectiveArgs);
+                             ArgsVector &effectiveArgs,
+                             llvm::StringRef source = llvm::StringRef());
+
+  // Returns the PCM of the external PCM directory the options selected, null
+  // if they selected an embedded one or none
+  std::shared_ptr<const llvm::MemoryBuffer> getExternalPCM() const {
+    return m_externalPCM;
+  }
+
+  // Returns the path the external PCM is mapped under
+  const std::string &getExternalPCMPath() const { return m_externalPCMPath; }
+
+  // Returns why the external PCM directory couldn't be searched, empty if it
+  // could
+  const std::string &getExternalPCMError() const { return m_externalPCMError; }
 
 private:
+  std::string getContentDerivedSourceName(const OpenCLArgList &args,
+                                          const ArgsVector &optionsEx,
+                                          llvm::StringRef source) const;
+
+
   std::string m_opencl_ver;
+  std::shared_ptr<const llvm::MemoryBuffer> m_externalPCM;
+  std::string m_externalPCMPath;
+  std::string m_externalPCMError;
   static std::atomic<int> s_progID;
 };
 
+///
+// Effective options that are set on the CompilerInvocation directly instead
+// of being parsed again by the cc1 options parser
+//
+struct CompileSettings {
+  // -D and -U in the command line order, true for -U
+  std::vector<std::pair<std::string, bool>> macros;
+  // -I
+  std::vector<std::string> includeDirs;
+  // -include
+  std::vector<std::string> includes;
+  // -fmodule-file=<file>
+  std::vector<std::string> moduleFiles;
+  // -W<value> without the prefix, in the command line order
+  std::vector<std::string> warnings;
+  // -w
+  bool ignoreWarnings = false;
+};
+
 ///
 // Options parser for the Compile function
 //
 class CompileOptionsParser {
 public:
   CompileOptionsParser(const char *pszOpenCLVersion)
-      : m_commonFilter(pszOpenCLVersion), m_emitSPIRV(false), m_optDisable(false) {}
+      : m_optTbl(OpenCLCompileOptTable::get()),
+        m_commonFilter(pszOpenCLVersion), m_emitSPIRV(false),
+        m_optDisable(false) {}
 
   //
   // Validates and prepares the effective options to pass to clang upon
-  // compilation
+  // compilation. The program source is only used to derive the source name
+  // when -deterministic-source-name is passed via pszOptionsEx.
   //
-  int processOptions(const char *pszOptions, const char *pszOptionsEx);
+  int processOptions(const char *pszOptions, const char *pszOptionsEx,
+                     const char *pszSource = nullptr);
 
   //
-  // Just validates the user supplied OpenCL compile options
+  // Just validates the user supplied OpenCL compile options. The unknown,
+  // input or incomplete options are returned in invalidOptions.
   //
-  bool checkOptions(const char *pszOptions, char *pszUnknownOptions,
-                    size_t uiUnknownOptionsSize);
+  bool checkOptions(const char *pszOptions, std::string &invalidOptions);
 
   //
   // Returns the calculated source name for the input source
@@ -190,10 +256,37 @@ public:
     return m_effectiveArgsRaw;
   }
 
+  //
+  // The effective options split into the ones set directly and the core ones
+  // left for the cc1 options parser: the language, target and codegen flags,
+  // the -Xclang pass-through and the input.
+  //
+  const CompileSettings &getSettings() const { return m_settings; }
+
+  llvm::ArrayRef<const char *> coreArgs() const { return m_coreArgsRaw; }
+
   std::string getEffectiveOptionsAsString() const;
 
+  //
+  // Returns the effective options in a canonical form, equal for the options
+  // producing the same invocation: the macro definitions are sorted by name,
+  // the -cl-ext options are merged into the resulting extension set and the
+  // generated source name is dropped. Must be called after processOptions.
+  //
+  std::string getCanonicalOptions() const;
+
   bool hasEmitSPIRV() const { return m_emitSPIRV; }
 
+  // Returns true if the LLVM IR is kept next to the SPIR-V, set by
+  // -emit-bitcode-and-spirv
+  bool hasEmitBitcodeAndSPIRV() const { return m_emitBitcodeAndSPIRV; }
+
+  // Returns true if the compile stops after Sema, set by -fsyntax-only
+  bool isSyntaxOnly() const { return m_syntaxOnly; }
+
+  // Returns true if the compile only preprocesses the source, set by -E
+  bool isPreprocessOnly() const { return m_preprocessOnly; }
+
   bool hasSPIRVExt() const { return m_hasSPIRVExt; }
 
   SPIRV::TranslatorOpts::ExtensionsStatusMap getSPIRVExtStatusMap() const {
@@ -202,16 +295,61 @@ public:
 
   bool hasOptDisable() const { return m_optDisable; }
 
+  // Returns the per-compile frontend memory budget in bytes, 0 if unlimited
+  size_t getMemoryBudget() const { return m_memoryBudget; }
+
+  // Returns the limit of the diagnostics in the log, 0 if unlimited
+  unsigned getMaxDiagnostics() const { return m_maxDiagnostics; }
+
+  // Returns the limit of the log size in bytes, 0 if unlimited
+  size_t getMaxLogBytes() const { return m_maxLogBytes; }
+
+  // Returns false if the invocation cache is disabled by -no-invocation-cache
+  bool useInvocationCache() const { return m_useInvocationCache; }
+
+  // Returns true if the files read by the compile are recorded on the
+  // result, set by -record-dependencies
+  bool recordDependencies() const { return m_recordDependencies; }
+
+  // Returns the PCM of the external PCM directory the compile loads, null if
+  // it loads an embedded one or none
+  std::shared_ptr<const llvm::MemoryBuffer> getExternalPCM() const {
+    return m_commonFilter.getExternalPCM();
+  }
+
+  // Returns the path the external PCM is mapped under
+  const std::string &getExternalPCMPath() const {
+    return m_commonFilter.getExternalPCMPath();
+  }
+
+  // Returns why the external PCM directory couldn't be searched, empty if it
+  // could
+  const std::string &getExternalPCMError() const {
+    return m_commonFilter.getExternalPCMError();
+  }
+
 private:
-  OpenCLCompileOptTable m_optTbl;
+  void splitSettings();
+
+  const OpenCLCompileOptTable &m_optTbl;
   EffectiveOptionsFilter m_commonFilter;
   ArgsVector m_effectiveArgs;
   llvm::SmallVector<const char *, 16> m_effectiveArgsRaw;
+  llvm::SmallVector<const char *, 16> m_coreArgsRaw;
+  CompileSettings m_settings;
   std::string m_sourceName;
   bool m_emitSPIRV;
+  bool m_emitBitcodeAndSPIRV = false;
+  bool m_syntaxOnly = false;
+  bool m_preprocessOnly = false;
   bool m_hasSPIRVExt = false;
   SPIRV::TranslatorOpts::ExtensionsStatusMap m_SPIRVExtStatusMap = {};
   bool m_optDisable;
+  size_t m_memoryBudget = 0;
+  unsigned m_maxDiagnostics = 0;
+  size_t m_maxLogBytes = 0;
+  bool m_useInvocationCache = true;
+  bool m_recordDependencies = false;
 };
 
 // Tokenize a string into tokens separated by any char in 'delims'.
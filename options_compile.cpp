@@ -16,17 +16,22 @@ Copyright (c) Intel Corporation (2009-2017).
 
 \*****************************************************************************/
 
+#include "external_pcm.h"
 #include "opencl_clang.h"
 #include "options.h"
 
 #include "llvm/ADT/SmallSet.h"
 #include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/MD5.h"
 #include "llvm/Support/ManagedStatic.h"
 #include "llvm/Support/Mutex.h"
 
 #include <algorithm>
+#include <list>
 #include <map>
+#include <mutex>
 #include <sstream>
+#include <unordered_map>
 
 using namespace llvm::opt;
 
@@ -56,6 +61,11 @@ static constexpr OptTable::Info ClangOptionsInfoTable[] = {
 OpenCLCompileOptTable::OpenCLCompileOptTable()
     : OpenCLOptTable(ClangOptionsInfoTable) {}
 
+const OpenCLCompileOptTable &OpenCLCompileOptTable::get() {
+  static const OpenCLCompileOptTable table;
+  return table;
+}
+
 std::atomic<int> EffectiveOptionsFilter::s_progID{1};
 
 // This code was adopted from the SPIRV-LLVM-Translator repository.
@@ -126,18 +136,63 @@ static int parseSPVExtOption(
   return 0;
 }
 
+///
+// Derives the default source name from the compilation inputs instead of the
+// process-wide counter, so that identical compiles get identical module
+// identifiers and debug info regardless of the order they were issued in.
+//
+std::string EffectiveOptionsFilter::getContentDerivedSourceName(
+    const OpenCLArgList &args, const ArgsVector &optionsEx,
+    llvm::StringRef source) const {
+  llvm::MD5 hash;
+  auto addField = [&hash](llvm::StringRef field) {
+    hash.update(field);
+    // separate the fields, so that e.g. "-DA" "B" and "-DAB" differ
+    hash.update(llvm::StringRef("\0", 1));
+  };
+
+  addField(m_opencl_ver);
+  for (unsigned i = 0, e = args.getNumInputArgStrings(); i != e; ++i)
+    addField(args.getArgString(i));
+  for (const auto &opt : optionsEx)
+    addField(opt);
+  addField(source);
+
+  llvm::MD5::MD5Result result;
+  hash.final(result);
+  return std::string(result.digest());
+}
+
 ///
 // Options filter that validates the opencl used options
 //
 std::string EffectiveOptionsFilter::processOptions(const OpenCLArgList &args,
                                                    const char *pszOptionsEx,
-                                                   ArgsVector &effectiveArgs) {
+                                                   ArgsVector &effectiveArgs,
+                                                   llvm::StringRef source) {
   // Reset args
   int iCLStdSet = 0;
   bool isCpp = false;
   bool fp64Enabled = false;
   std::string szTriple;
-  std::string sourceName(llvm::Twine(s_progID++).str());
+
+  // The extended options are tokenized up front, since they may ask for the
+  // source name to be derived from the inputs rather than from s_progID.
+  ArgsVector optionsEx;
+  std::back_insert_iterator<ArgsVector> itEx(std::back_inserter(optionsEx));
+  quoted_tokenize(itEx, pszOptionsEx, " \t", '"', '\x00');
+
+  bool deterministicName = false;
+  optionsEx.remove_if([&](const ArgsVector::value_type &a) {
+    if (a != "-deterministic-source-name")
+      return false;
+    deterministicName = true;
+    return true;
+  });
+
+  std::string sourceName =
+      deterministicName ? getContentDerivedSourceName(args, optionsEx, source)
+                        : llvm::Twine(s_progID++).str();
 
   for (OpenCLArgList::const_iterator it = args.begin(), ie = args.end();
        it != ie; ++it) {
@@ -317,8 +372,7 @@ std::string EffectiveOptionsFilter::processOptions(const OpenCLArgList &args,
   effectiveArgs.push_back("-Werror=implicit-function-declaration");
 
   // add the extended options verbatim
-  std::back_insert_iterator<ArgsVector> it(std::back_inserter(effectiveArgs));
-  quoted_tokenize(it, pszOptionsEx, " \t", '"', '\x00');
+  effectiveArgs.splice(effectiveArgs.end(), optionsEx);
 
   for (auto it = effectiveArgs.begin(), end = effectiveArgs.end(); it != end;
        ++it) {
@@ -369,6 +423,9 @@ std::string EffectiveOptionsFilter::processOptions(const OpenCLArgList &args,
       {"cl_intel_subgroups_short", true}};
 #endif
 
+  // the extensions the -cl-ext options leave supported, which an external PCM
+  // has to be built with
+  PCMSignature signature;
   auto parseClExt = [&](const std::string &clExtStr) {
     llvm::StringRef clExtRef(clExtStr);
     bool hasPrefix = clExtRef.consume_front("-cl-ext=");
@@ -387,8 +444,11 @@ std::string EffectiveOptionsFilter::processOptions(const OpenCLArgList &args,
       if (extName == "all") {
         for (auto &p : extMap)
           p.second = enabled;
+        signature.AllExtensions = enabled;
+        signature.Extensions.clear();
         continue;
       }
+      signature.Extensions[extName.str()] = enabled;
       auto it = extMap.find(extName.str());
       if (it != extMap.end())
         it->second = enabled;
@@ -409,49 +469,61 @@ std::string EffectiveOptionsFilter::processOptions(const OpenCLArgList &args,
       !std::any_of(extMap.begin(), extMap.end(),
                    [](const auto &p) { return p.second == false; });
 
+  // The PCM name is composed of the language version, the triple and the
+  // fp64 support, e.g. opencl-cpp-2021-spirv64-fp64.pcm. The spirv triples
+  // have to be checked before the spir ones, since they contain "spir".
+  llvm::StringRef pcmTriple;
+  if (szTriple.find("spirv64") != szTriple.npos)
+    pcmTriple = "spirv64";
+  else if (szTriple.find("spirv32") != szTriple.npos)
+    pcmTriple = "spirv32";
+  else if (szTriple.find("spir64") != szTriple.npos)
+    pcmTriple = "spir64";
+  else if (szTriple.find("spir") != szTriple.npos)
+    pcmTriple = "spir";
+
+  llvm::StringRef pcmVersion;
+  if (isCpp)
+    pcmVersion = iCLStdSet == 300 ? "cpp-2021" : "cpp-10";
+  else if (iCLStdSet <= 120)
+    pcmVersion = "c-12";
+  else if (iCLStdSet == 200)
+    pcmVersion = "c-20";
+  else if (iCLStdSet == 300)
+    pcmVersion = "c-30";
+  else if (iCLStdSet == 310)
+    pcmVersion = "c-31";
+
+  std::string pcmName;
+  m_externalPCM.reset();
+  m_externalPCMPath.clear();
+  m_externalPCMError.clear();
+  if (!pcmTriple.empty() && !pcmVersion.empty()) {
+    std::string pcmPrefix = ("opencl-" + pcmVersion + "-" + pcmTriple).str();
+    pcmName = pcmPrefix + (fp64Enabled ? "-fp64" : "") + ".pcm";
+
+    // An external PCM built for the extensions of the compile is used even
+    // for an extension set no embedded PCM is built with, the one named like
+    // the embedded PCM is tried first. It's loaded by its path.
+    signature.Triple = szTriple;
+    signature.CPlusPlus = isCpp;
+    if (isCpp)
+      signature.Version = iCLStdSet == 300 ? 202100 : 100;
+    else
+      signature.Version = iCLStdSet <= 120 ? 120 : iCLStdSet;
+    m_externalPCM =
+        FindExternalPCM(pcmPrefix, pcmName, signature, m_externalPCMPath,
+                        m_externalPCMError);
+    if (m_externalPCM) {
+      pcmName = m_externalPCMPath;
+      useModules = true;
+    }
+  }
+
   if (useModules) {
     effectiveArgs.push_back("-fmodules");
-    if (!fp64Enabled) {
-      if (szTriple.find("spir64") != szTriple.npos) {
-        if (iCLStdSet <= 120)
-          effectiveArgs.push_back("-fmodule-file=opencl-c-12-spir64.pcm");
-        else if (iCLStdSet == 200)
-          effectiveArgs.push_back("-fmodule-file=opencl-c-20-spir64.pcm");
-        else if (iCLStdSet == 300)
-          effectiveArgs.push_back("-fmodule-file=opencl-c-30-spir64.pcm");
-        else if (iCLStdSet == 310)
-          effectiveArgs.push_back("-fmodule-file=opencl-c-31-spir64.pcm");
-      } else if (szTriple.find("spir") != szTriple.npos) {
-        if (iCLStdSet <= 120)
-          effectiveArgs.push_back("-fmodule-file=opencl-c-12-spir.pcm");
-        else if (iCLStdSet == 200)
-          effectiveArgs.push_back("-fmodule-file=opencl-c-20-spir.pcm");
-        else if (iCLStdSet == 300)
-          effectiveArgs.push_back("-fmodule-file=opencl-c-30-spir.pcm");
-        else if (iCLStdSet == 310)
-          effectiveArgs.push_back("-fmodule-file=opencl-c-31-spir.pcm");
-      }
-    } else {
-      if (szTriple.find("spir64") != szTriple.npos) {
-        if (iCLStdSet <= 120)
-          effectiveArgs.push_back("-fmodule-file=opencl-c-12-spir64-fp64.pcm");
-        else if (iCLStdSet == 200)
-          effectiveArgs.push_back("-fmodule-file=opencl-c-20-spir64-fp64.pcm");
-        else if (iCLStdSet == 300)
-          effectiveArgs.push_back("-fmodule-file=opencl-c-30-spir64-fp64.pcm");
-        else if (iCLStdSet == 310)
-          effectiveArgs.push_back("-fmodule-file=opencl-c-31-spir64-fp64.pcm");
-      } else if (szTriple.find("spir") != szTriple.npos) {
-        if (iCLStdSet <= 120)
-          effectiveArgs.push_back("-fmodule-file=opencl-c-12-spir-fp64.pcm");
-        else if (iCLStdSet == 200)
-          effectiveArgs.push_back("-fmodule-file=opencl-c-20-spir-fp64.pcm");
-        else if (iCLStdSet == 300)
-          effectiveArgs.push_back("-fmodule-file=opencl-c-30-spir-fp64.pcm");
-        else if (iCLStdSet == 310)
-          effectiveArgs.push_back("-fmodule-file=opencl-c-31-spir-fp64.pcm");
-      }
-    }
+    if (!pcmName.empty())
+      effectiveArgs.push_back("-fmodule-file=" + pcmName);
   }
 
   // add source name to options as an input file
@@ -462,7 +534,8 @@ std::string EffectiveOptionsFilter::processOptions(const OpenCLArgList &args,
 }
 
 int CompileOptionsParser::processOptions(const char *pszOptions,
-                                         const char *pszOptionsEx) {
+                                         const char *pszOptionsEx,
+                                         const char *pszSource) {
   // parse options
   unsigned missingArgIndex, missingArgCount;
   std::unique_ptr<OpenCLArgList> pArgs(
@@ -475,8 +548,18 @@ int CompileOptionsParser::processOptions(const char *pszOptions,
     return -1;
 
   // post process logic
-  m_sourceName =
-      m_commonFilter.processOptions(*pArgs, pszOptionsEx, m_effectiveArgs);
+  m_sourceName = m_commonFilter.processOptions(
+      *pArgs, pszOptionsEx, m_effectiveArgs,
+      pszSource ? llvm::StringRef(pszSource) : llvm::StringRef());
+
+  // -fsyntax-only and -E in pszOptionsEx replace the default -emit-llvm-bc,
+  // no IR is produced
+  for (const auto &arg : m_effectiveArgs) {
+    if (arg == "-fsyntax-only")
+      m_syntaxOnly = true;
+    else if (arg == "-E")
+      m_preprocessOnly = true;
+  }
 
   // build the raw options array
   for (ArgsVector::iterator it = m_effectiveArgs.begin(),
@@ -488,9 +571,15 @@ int CompileOptionsParser::processOptions(const char *pszOptions,
     (void)arg.consume_front("-");
     if (arg == "cl-opt-disable") {
       m_optDisable = true;
+    } else if (arg == "emit-llvm-bc" && (m_syntaxOnly || m_preprocessOnly)) {
+      continue;
     } else if (arg == "emit-spirv") {
       m_emitSPIRV = true;
       continue;
+    } else if (arg == "emit-bitcode-and-spirv") {
+      m_emitSPIRV = true;
+      m_emitBitcodeAndSPIRV = true;
+      continue;
     } else if (arg.consume_front("spirv-ext=")) {
       m_hasSPIRVExt = true;
       // m_SPIRVExtStatusMap will be initialized and updated according to `arg`.
@@ -498,15 +587,82 @@ int CompileOptionsParser::processOptions(const char *pszOptions,
       if (0 != ret)
         return ret;
       continue;
+    } else if (arg.consume_front("compile-memory-budget=")) {
+      // the budget is given in bytes, 0 disables it
+      if (arg.getAsInteger(10, m_memoryBudget))
+        return -1;
+      continue;
+    } else if (arg.consume_front("max-diagnostics=")) {
+      // caps the diagnostics in the log, 0 means no limit
+      if (arg.getAsInteger(10, m_maxDiagnostics))
+        return -1;
+      continue;
+    } else if (arg.consume_front("max-log-bytes=")) {
+      if (arg.getAsInteger(10, m_maxLogBytes))
+        return -1;
+      continue;
+    } else if (arg == "no-invocation-cache") {
+      m_useInvocationCache = false;
+      continue;
+    } else if (arg == "record-dependencies") {
+      m_recordDependencies = true;
+      continue;
     }
     m_effectiveArgsRaw.push_back(it->c_str());
   }
+  // there is no IR to translate
+  if (m_syntaxOnly || m_preprocessOnly)
+    m_emitSPIRV = m_emitBitcodeAndSPIRV = false;
+  splitSettings();
   return 0;
 }
 
+void CompileOptionsParser::splitSettings() {
+  llvm::ArrayRef<const char *> args = m_effectiveArgsRaw;
+  for (size_t i = 0; i < args.size(); ++i) {
+    size_t first = i;
+    llvm::StringRef arg(args[i]);
+
+    // the value of -D, -U, -I and -include may be a separate argument or
+    // follow the option after a space
+    llvm::StringRef value;
+    if ((arg == "-D" || arg == "-U" || arg == "-I" || arg == "-include") &&
+        i + 1 < args.size()) {
+      value = args[++i];
+    } else if (arg.starts_with("-D") || arg.starts_with("-U") ||
+               arg.starts_with("-I")) {
+      value = arg.drop_front(2).ltrim();
+      arg = arg.take_front(2);
+    }
+
+    if (arg == "-Xclang" && i + 1 < args.size()) {
+      m_coreArgsRaw.push_back(args[i]);
+      m_coreArgsRaw.push_back(args[++i]);
+    } else if (arg == "-D" && !value.empty()) {
+      m_settings.macros.emplace_back(value.str(), false);
+    } else if (arg == "-U" && !value.empty()) {
+      m_settings.macros.emplace_back(value.str(), true);
+    } else if (arg == "-I" && !value.empty()) {
+      m_settings.includeDirs.push_back(value.str());
+    } else if (arg == "-include" && !value.empty()) {
+      m_settings.includes.push_back(value.str());
+    } else if (arg.consume_front("-fmodule-file=") && !arg.contains('=')) {
+      m_settings.moduleFiles.push_back(arg.str());
+    } else if (arg == "-w") {
+      m_settings.ignoreWarnings = true;
+    } else if (arg.starts_with("-W") && arg.size() > 2 &&
+               arg.find_first_of(" ,=") == llvm::StringRef::npos) {
+      // -W<name>=<value> options, like -Wundef-prefix=, aren't warning
+      // names and stay with the cc1 arguments
+      m_settings.warnings.push_back(arg.drop_front(2).str());
+    } else {
+      m_coreArgsRaw.append(args.begin() + first, args.begin() + i + 1);
+    }
+  }
+}
+
 bool CompileOptionsParser::checkOptions(const char *pszOptions,
-                                        char *pszUnknownOptions,
-                                        size_t uiUnknownOptionsSize) {
+                                        std::string &invalidOptions) {
   // Parse the arguments.
   unsigned missingArgIndex, missingArgCount;
   std::unique_ptr<OpenCLArgList> pArgs(
@@ -514,28 +670,17 @@ bool CompileOptionsParser::checkOptions(const char *pszOptions,
 
   // Check for missing argument error.
   if (missingArgCount) {
-    std::fill_n(pszUnknownOptions, uiUnknownOptionsSize, '\0');
-    std::string missingArg(pArgs->getArgString(missingArgIndex));
-    missingArg.copy(pszUnknownOptions, uiUnknownOptionsSize - 1);
+    invalidOptions = pArgs->getArgString(missingArgIndex);
     return false;
   }
 
-  std::string unknownOptions = pArgs->getFilteredArgs(OPT_COMPILE_UNKNOWN);
-  if (!unknownOptions.empty()) {
-    std::fill_n(pszUnknownOptions, uiUnknownOptionsSize, '\0');
-    unknownOptions.copy(pszUnknownOptions, uiUnknownOptionsSize - 1);
+  invalidOptions = pArgs->getFilteredArgs(OPT_COMPILE_UNKNOWN);
+  if (!invalidOptions.empty())
     return false;
-  }
 
   // we do not support input options
-  std::string inputOptions = pArgs->getFilteredArgs(OPT_COMPILE_INPUT);
-  if (!inputOptions.empty()) {
-    std::fill_n(pszUnknownOptions, uiUnknownOptionsSize, '\0');
-    inputOptions.copy(pszUnknownOptions, uiUnknownOptionsSize - 1);
-    return false;
-  }
-
-  return true;
+  invalidOptions = pArgs->getFilteredArgs(OPT_COMPILE_INPUT);
+  return invalidOptions.empty();
 }
 
 std::string CompileOptionsParser::getEffectiveOptionsAsString() const {
@@ -550,13 +695,175 @@ std::string CompileOptionsParser::getEffectiveOptionsAsString() const {
   return ss.str();
 }
 
+std::string CompileOptionsParser::getCanonicalOptions() const {
+  llvm::ArrayRef<const char *> args = m_effectiveArgsRaw;
+
+  // The source name goes last. It is only a part of the invocation if it was
+  // given by -s, the generated one just numbers the compiles.
+  if (!args.empty() &&
+      llvm::find(args, llvm::StringRef("-main-file-name")) == args.end())
+    args = args.drop_back();
+
+  // the last -D or -U of a macro wins, so only that one is kept
+  std::map<std::string, std::string> macros;
+  auto addMacro = [&macros](char kind, llvm::StringRef value) {
+    value = value.ltrim();
+    auto nameAndValue = value.split('=');
+    std::string definition(1, kind);
+    definition += value;
+    // -DA defines A as 1
+    if (kind == 'D' && !value.contains('='))
+      definition += "=1";
+    macros[nameAndValue.first.str()] = definition;
+  };
+
+  // -cl-ext options are applied in order, "all" resets the ones before it
+  int allExtensions = -1;
+  std::map<std::string, bool> extensions;
+  auto addExtensions = [&](llvm::StringRef value) {
+    llvm::SmallVector<llvm::StringRef, 32> parsedExt;
+    value.split(parsedExt, ',');
+    for (llvm::StringRef ext : parsedExt) {
+      if (ext.empty())
+        continue;
+      bool enabled = ext.front() != '-';
+      if (ext.front() == '+' || ext.front() == '-')
+        ext = ext.drop_front();
+      if (ext == "all") {
+        allExtensions = enabled;
+        extensions.clear();
+      } else {
+        extensions[ext.str()] = enabled;
+      }
+    }
+  };
+
+  std::stringstream ss;
+  for (size_t i = 0; i < args.size(); ++i) {
+    llvm::StringRef arg(args[i]);
+    if ((arg == "-D" || arg == "-U") && i + 1 < args.size()) {
+      addMacro(arg[1], args[++i]);
+    } else if (arg.starts_with("-D") || arg.starts_with("-U")) {
+      addMacro(arg[1], arg.drop_front(2));
+    } else if (arg.consume_front("-cl-ext=")) {
+      addExtensions(arg);
+    } else if (arg == "-Xclang" && i + 1 < args.size()) {
+      // the value is passed to clang as is, even if it is a macro
+      ss << arg.str() << ' ' << args[++i] << '\0';
+    } else {
+      ss << arg.str() << '\0';
+    }
+  }
+
+  for (const auto &macro : macros)
+    ss << '-' << macro.second << '\0';
+
+  if (allExtensions >= 0 || !extensions.empty()) {
+    ss << "-cl-ext=";
+    if (allExtensions >= 0)
+      ss << (allExtensions ? "+all," : "-all,");
+    for (const auto &ext : extensions)
+      // the ones set as after "all" anyway make no difference
+      if (ext.second != (allExtensions == 1) || allExtensions < 0)
+        ss << (ext.second ? '+' : '-') << ext.first << ',';
+    ss << '\0';
+  }
+
+  // the options consumed by the library rather than passed to clang
+  if (m_emitSPIRV)
+    ss << "-emit-spirv" << '\0';
+  if (m_emitBitcodeAndSPIRV)
+    ss << "-emit-bitcode-and-spirv" << '\0';
+  if (m_hasSPIRVExt) {
+    ss << "-spirv-ext=";
+    for (const auto &ext : m_SPIRVExtStatusMap)
+      if (ext.second)
+        ss << (*ext.second ? '+' : '-') << static_cast<unsigned>(ext.first)
+           << ',';
+    ss << '\0';
+  }
+  ss << "-compile-memory-budget=" << m_memoryBudget << '\0'
+     << "-max-diagnostics=" << m_maxDiagnostics << '\0'
+     << "-max-log-bytes=" << m_maxLogBytes << '\0';
+  return ss.str();
+}
+
+namespace {
+
+//
+// Verdicts of the recent CheckCompileOptions calls. The runtime validates the
+// options before every build, mostly with the same strings, so the verdicts
+// are kept for the most recently used option strings, the least recently used
+// one is evicted first.
+//
+class CheckOptionsCache {
+public:
+  bool lookup(const std::string &options, bool &valid,
+              std::string &invalidOptions) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    auto it = m_index.find(options);
+    if (it == m_index.end())
+      return false;
+    m_entries.splice(m_entries.begin(), m_entries, it->second);
+    valid = it->second->valid;
+    invalidOptions = it->second->invalidOptions;
+    return true;
+  }
+
+  void insert(const std::string &options, bool valid,
+              const std::string &invalidOptions) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (m_index.count(options))
+      return;
+    m_entries.push_front({options, valid, invalidOptions});
+    m_index[options] = m_entries.begin();
+    if (m_entries.size() > MaxEntries) {
+      m_index.erase(m_entries.back().options);
+      m_entries.pop_back();
+    }
+  }
+
+private:
+  static const size_t MaxEntries = 128;
+
+  struct Entry {
+    std::string options;
+    bool valid;
+    std::string invalidOptions;
+  };
+
+  std::mutex m_lock;
+  // the most recently used entry goes first
+  std::list<Entry> m_entries;
+  std::unordered_map<std::string, std::list<Entry>::iterator> m_index;
+};
+
+CheckOptionsCache &getCheckOptionsCache() {
+  static CheckOptionsCache cache;
+  return cache;
+}
+
+} // namespace
+
 extern "C" CC_DLL_EXPORT bool CheckCompileOptions(const char *pszOptions,
                                                   char *pszUnknownOptions,
                                                   size_t uiUnknownOptionsSize) {
   try {
-    CompileOptionsParser optionsParser("200");
-    return optionsParser.checkOptions(pszOptions, pszUnknownOptions,
-                                      uiUnknownOptionsSize);
+    std::string options = pszOptions ? pszOptions : "";
+    bool valid;
+    std::string invalidOptions;
+    CheckOptionsCache &cache = getCheckOptionsCache();
+    if (!cache.lookup(options, valid, invalidOptions)) {
+      CompileOptionsParser optionsParser("200");
+      valid = optionsParser.checkOptions(options.c_str(), invalidOptions);
+      cache.insert(options, valid, invalidOptions);
+    }
+
+    if (!valid && pszUnknownOptions && uiUnknownOptionsSize > 0) {
+      std::fill_n(pszUnknownOptions, uiUnknownOptionsSize, '\0');
+      invalidOptions.copy(pszUnknownOptions, uiUnknownOptionsSize - 1);
+    }
+    return valid;
   } catch (std::bad_alloc &) {
     if (pszUnknownOptions && uiUnknownOptionsSize > 0) {
       std::fill_n(pszUnknownOptions, uiUnknownOptionsSize, '\0');
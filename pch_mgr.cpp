@@ -17,18 +17,26 @@ Copyright (c) Intel Corporation (2009-2017).
 \*****************************************************************************/
 
 #include "pch_mgr.h"
+#include "cl_headers/resource.h"
 
+#include "llvm/ADT/StringExtras.h"
 #include "llvm/ADT/Twine.h"
+#include "llvm/Support/Compression.h"
+#include "llvm/Support/Error.h"
 
 #include <cstdlib>
+#include <cstring>
 #include <stdio.h>
 #include <assert.h>
-#include <fstream>
 #ifdef _WIN32
 #include <Windows.h>
 #else
 #include <dlfcn.h>
+#include <fcntl.h>
 #include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 struct auto_dlclose {
   auto_dlclose(void *module) : m_pModule(module) {}
@@ -61,49 +69,189 @@ ResourceManager ResourceManager::g_instance;
 
 void dummy() {}
 
+// The IDs (see cl_headers/resource.h) and the names of the resources
+static const struct {
+  const char *ID;
+  const char *Name;
+} ResourceTable[] = {
+#define RESOURCE(ID, NAME) {ID, NAME},
+#include "cl_headers/resource_list.def"
+#undef RESOURCE
+};
+
+const char *ResourceManager::get_resource_name(ResourceIndex index) {
+  return ResourceTable[index].Name;
+}
+
 // returns the pointer to the buffer loaded from the resource with the given id
-Resource ResourceManager::get_resource(const char *name, const char *id,
-                                       const char *type,
+Resource ResourceManager::get_resource(ResourceIndex index,
                                        bool requireNullTerminate) {
   llvm::sys::ScopedLock mutexGuard(m_lock);
 
-  auto res = m_buffers.find(id);
-  if (res == m_buffers.end()) {
+  if (!m_buffers[index].first) {
     // lazy load the resource if not found in the cache
-    if (!load_resource(id, type, requireNullTerminate)) {
+    if (!load_resource(index, requireNullTerminate)) {
       return Resource();
     }
   }
 
-  res = m_buffers.find(id);
-  assert(res != m_buffers.end());
+  const char *data = m_buffers[index].first;
+  size_t size = m_buffers[index].second;
+  return Resource(data, size, ResourceTable[index].Name);
+}
+
+llvm::ErrorOr<std::shared_ptr<const llvm::MemoryBuffer>>
+ResourceManager::get_file(const char *path, bool binary,
+                          bool requireNullTerminate) {
+  llvm::sys::fs::file_status status;
+  if (std::error_code ec = llvm::sys::fs::status(path, status))
+    return ec;
+  if (!llvm::sys::fs::is_regular_file(status))
+    return std::make_error_code(std::errc::invalid_argument);
+
+  llvm::sys::ScopedLock mutexGuard(m_lock);
 
-  const char *data = res->second.first;
-  size_t size = res->second.second;
-  return Resource(data, size, name);
+  MappedFile &file = m_files[path];
+  if (file.m_buffer && file.m_id == status.getUniqueID() &&
+      file.m_mtime == status.getLastModificationTime() &&
+      file.m_size == status.getSize() &&
+      (file.m_nullTerminated || !requireNullTerminate))
+    return file.m_buffer;
+
+  // the file is new or has changed, the old buffer is released once the
+  // last reference handed out for it goes away
+  auto buffer = map_file(path, binary, requireNullTerminate);
+  if (!buffer) {
+    m_files.erase(path);
+    return buffer.getError();
+  }
+
+  file.m_buffer = std::move(*buffer);
+  file.m_id = status.getUniqueID();
+  file.m_mtime = status.getLastModificationTime();
+  file.m_size = status.getSize();
+  file.m_nullTerminated = requireNullTerminate;
+  return file.m_buffer;
 }
 
-const char *ResourceManager::get_file(const char *path, bool binary,
-                                      bool requireNullTerminate,
-                                      size_t &out_size) {
+Resource ResourceManager::get_stored_resource(ResourceIndex index) {
   llvm::sys::ScopedLock mutexGuard(m_lock);
 
-  std::string key(path);
+  const char *res = nullptr;
+  size_t size = 0;
+  size_t uncompressed_size = 0;
+  if (!find_resource(index, res, size, uncompressed_size))
+    return Resource();
+  return Resource(res, size, ResourceTable[index].Name);
+}
 
-  if (m_buffers.find(key) == m_buffers.end()) {
-    // lazy load the resource if not found in the cache
-    load_file(path, binary, requireNullTerminate);
+bool ResourceManager::open_archive() {
+  // this function is called under lock
+  if (m_archiveOpened)
+    return m_archive != nullptr;
+  m_archiveOpened = true;
+
+  const char *path = getenv("CCLANG_RESOURCE_ARCHIVE");
+  if (path && *path) {
+    auto archiveFile = map_file(path, /*binary=*/true,
+                                /*requireNullTerminate=*/false);
+    if (archiveFile)
+      m_archiveFile = std::move(*archiveFile);
+    if (m_archiveFile && index_archive(m_archiveFile->getBufferStart(),
+                                       m_archiveFile->getBufferSize()) &&
+        verify_archive())
+      return true;
+    // an archive file that can't be used falls back to the embedded one
+    m_archiveFile.reset();
+    m_archive = nullptr;
+  }
+
+#ifndef _WIN32
+  const char *res = nullptr;
+  size_t size = 0;
+  if (GetResourceUnix("OPENCL_CLANG_ARCHIVE", "PCM", LIBOPENCL_CLANG_NAME,
+                      false, res, size) &&
+      index_archive(res, size))
+    return true;
+#endif
+  return false;
+}
+
+bool ResourceManager::index_archive(const char *data, size_t size) {
+  ResourceArchiveHeader header;
+  if (size < sizeof(header))
+    return false;
+  memcpy(&header, data, sizeof(header));
+  if (memcmp(header.magic, RESOURCE_ARCHIVE_MAGIC,
+             sizeof(RESOURCE_ARCHIVE_MAGIC)) ||
+      header.version != RESOURCE_ARCHIVE_VERSION ||
+      strncmp(header.producer, RESOURCE_ARCHIVE_PRODUCER,
+              sizeof(header.producer)) ||
+      header.size > size ||
+      header.count > (header.size - sizeof(header)) /
+                         sizeof(ResourceArchiveEntry))
+    return false;
+
+  const ResourceArchiveEntry *entries =
+      reinterpret_cast<const ResourceArchiveEntry *>(data + sizeof(header));
+  std::map<llvm::StringRef, const ResourceArchiveEntry *> byName;
+  for (uint32_t i = 0; i < header.count; ++i) {
+    const ResourceArchiveEntry &entry = entries[i];
+    // the payload is followed by its terminator
+    if (entry.offset > header.size || entry.size >= header.size - entry.offset ||
+        entry.nameOffset > header.size ||
+        entry.nameSize > header.size - entry.nameOffset)
+      return false;
+    byName[llvm::StringRef(data + entry.nameOffset, entry.nameSize)] = &entry;
+  }
+
+  for (int i = 0; i < RESOURCE_COUNT; ++i) {
+    auto it = byName.find(ResourceTable[i].Name);
+    m_entries[i] = it == byName.end() ? nullptr : it->second;
+  }
+  m_archive = data;
+  return true;
+}
+
+bool ResourceManager::verify_archive() const {
+  // the resources are looked up in one archive only, so it has to hold all
+  // of them
+  for (int i = 0; i < RESOURCE_COUNT; ++i) {
+    const ResourceArchiveEntry *entry = m_entries[i];
+    if (!entry ||
+        ResourceArchiveHash(
+            reinterpret_cast<const unsigned char *>(m_archive + entry->offset),
+            entry->size) != entry->hash)
+      return false;
+  }
+  return true;
+}
+
+bool ResourceManager::find_resource(ResourceIndex index, const char *&res,
+                                    size_t &size, size_t &uncompressed_size) {
+  // this function is called under lock
+  uncompressed_size = 0;
+  if (open_archive()) {
+    const ResourceArchiveEntry *entry = m_entries[index];
+    if (!entry)
+      return false;
+    res = m_archive + entry->offset;
+    size = entry->size;
+    uncompressed_size = entry->uncompressedSize;
+    return true;
   }
 
-  assert(m_buffers.find(key) != m_buffers.end());
-  out_size = m_buffers[key].second;
-  return m_buffers[key].first;
+#ifdef _WIN32
+  return GetResourceWin32(ResourceTable[index].ID, "PCM", res, size);
+#else
+  return false;
+#endif
 }
 
 const char* ResourceManager::realloc_buffer(const char *id,
                                             const char* buf, size_t size,
                                             bool requireNullTerminate) {
-  std::vector<char> &buffer = m_allocations[id];
+  auto &buffer = m_allocations[id];
 
   size_t alloc_size = requireNullTerminate ? size + 1 : size;
   buffer.resize(alloc_size);
@@ -201,46 +349,143 @@ bool ResourceManager::GetResourceUnix(const char *id, const char *pszType,
 }
 #endif // WIN32
 
-bool ResourceManager::load_resource(const char *id, const char *pszType,
+bool ResourceManager::load_resource(ResourceIndex index,
                                     bool requireNullTerminate) {
   // this function is called under lock
-  assert(m_buffers.find(id) == m_buffers.end());
+  assert(!m_buffers[index].first);
 
+  const char *id = ResourceTable[index].Name;
   const char *res = nullptr;
   size_t size = 0;
-#ifdef WIN32
-  bool ok = GetResourceWin32(id, pszType, res, size);
-#else
-  bool ok = GetResourceUnix(id, pszType, LIBOPENCL_CLANG_NAME,
-                            false, res, size);
-#endif
-
-  if (!ok) {
+  size_t uncompressed_size = 0;
+  if (!find_resource(index, res, size, uncompressed_size)) {
     return false;
   }
 
-  if (requireNullTerminate && res[size] != '\0') {
+  if (uncompressed_size) {
+    // decompress the resource once, all the compiles share the buffer
+    auto &buffer = m_allocations[id];
+    buffer.resize(uncompressed_size + 1);
+    size_t out_size = uncompressed_size;
+    if (llvm::Error err = llvm::compression::zstd::decompress(
+            llvm::arrayRefFromStringRef(llvm::StringRef(res, size)),
+            reinterpret_cast<uint8_t *>(buffer.data()), out_size)) {
+      llvm::consumeError(std::move(err));
+      m_allocations.erase(id);
+      return false;
+    }
+    assert(out_size == uncompressed_size);
+    buffer[uncompressed_size] = '\0';
+    res = buffer.data();
+    size = uncompressed_size;
+  } else if (requireNullTerminate && res[size] != '\0') {
     // reallocate the buffer to ensure the null termination
     res = realloc_buffer(id, res, size, requireNullTerminate);
   }
 
-  m_buffers[id] = std::pair<const char *, size_t>(res, size);
+  m_buffers[index] = std::pair<const char *, size_t>(res, size);
   return true;
 }
 
-// cache the content of the file to the internal buffers
-void ResourceManager::load_file(const char *path, bool binary,
-                                bool requireNullTerminate) {
-  std::string key(path);
-  std::ifstream fs(path, binary ? std::ios::binary : std::ios::in);
-  std::vector<char> &buffer = m_allocations[key];
+#ifdef _WIN32
+llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>>
+ResourceManager::map_file(const char *path, bool binary,
+                          bool requireNullTerminate) {
+  // a mapped file can't be written to on Windows
+  return llvm::MemoryBuffer::getFile(path, /*IsText=*/!binary,
+                                     requireNullTerminate,
+                                     /*IsVolatile=*/false);
+}
+#else // WIN32
+
+namespace {
+// A read-only mapping of a whole file. The tail of the last page past the end
+// of the file is zero filled, which terminates the data unless the size is a
+// page multiple. For those an anonymous zero page is reserved right after the
+// file pages, so the terminator doesn't cost a copy of the file.
+class MappedFileBuffer : public llvm::MemoryBuffer {
+public:
+  static std::unique_ptr<MappedFileBuffer> create(int fd, size_t size,
+                                                  bool requireNullTerminate,
+                                                  const char *path) {
+    size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    size_t mapSize = (size + pageSize - 1) / pageSize * pageSize;
+    if (requireNullTerminate && mapSize == size)
+      mapSize += pageSize;
+    if (mapSize == 0)
+      mapSize = pageSize;
+
+    // reserve the whole range first, then put the file over its beginning
+    void *base = mmap(nullptr, mapSize, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS,
+                      -1, 0);
+    if (base == MAP_FAILED)
+      return nullptr;
+    if (size && mmap(base, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) ==
+                    MAP_FAILED) {
+      munmap(base, mapSize);
+      return nullptr;
+    }
 
-  buffer.assign(std::istreambuf_iterator<char>(fs),
-                std::istreambuf_iterator<char>());
+    return std::unique_ptr<MappedFileBuffer>(new MappedFileBuffer(
+        (const char *)base, size, mapSize, requireNullTerminate, path));
+  }
 
-  if (requireNullTerminate && buffer.size() > 0 && buffer.back() != '\0') {
-    buffer.push_back('\0');
+  ~MappedFileBuffer() override {
+    munmap(const_cast<char *>(getBufferStart()), m_mapSize);
   }
-  m_buffers[key] =
-      std::pair<const char *, size_t>(buffer.data(), buffer.size());
+
+  llvm::StringRef getBufferIdentifier() const override { return m_path; }
+
+  BufferKind getBufferKind() const override { return MemoryBuffer_MMap; }
+
+private:
+  MappedFileBuffer(const char *base, size_t size, size_t mapSize,
+                   bool requireNullTerminate, const char *path)
+      : m_mapSize(mapSize), m_path(path) {
+    init(base, base + size, requireNullTerminate);
+  }
+
+  size_t m_mapSize;
+  std::string m_path;
+};
+} // namespace
+
+bool ResourceManager::read_files() {
+  static const bool readFiles = [] {
+    const char *env = getenv("CCLANG_NO_MMAP");
+    return env && *env && strcmp(env, "0") != 0;
+  }();
+  return readFiles;
 }
+
+llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>>
+ResourceManager::map_file(const char *path, bool /*binary*/,
+                          bool requireNullTerminate) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return std::error_code(errno, std::generic_category());
+
+  // the size is taken from the descriptor, so it matches what gets mapped
+  // even if the file was replaced after the status check
+  struct stat st;
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer =
+      std::make_error_code(std::errc::io_error);
+  if (fstat(fd, &st) != 0) {
+    buffer = std::error_code(errno, std::generic_category());
+  } else if (read_files()) {
+    // a mapped file that is truncated or rewritten in place (e.g. by cp)
+    // faults the compiles on its pages, the deployments that update the
+    // files that way have them read into memory instead
+    buffer = llvm::MemoryBuffer::getOpenFile(
+        fd, path, (uint64_t)st.st_size, requireNullTerminate,
+        /*IsVolatile=*/true);
+  } else if (auto mapped = MappedFileBuffer::create(
+                 fd, (size_t)st.st_size, requireNullTerminate, path)) {
+    buffer = std::move(mapped);
+  } else {
+    buffer = std::error_code(errno, std::generic_category());
+  }
+  close(fd);
+  return buffer;
+}
+#endif // WIN32
@@ -16,11 +16,17 @@ Copyright (c) Intel Corporation (2009-2017).
 
 \*****************************************************************************/
 
+#include "resource_archive.h"
+
+#include "llvm/Support/ErrorOr.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Mutex.h"
 
 #include <map>
 #include <list>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -29,6 +35,8 @@ struct Resource
   const char* m_data;
   size_t      m_size;
   std::string m_name;
+  // keeps the file the data is mapped from alive, null for the resources
+  std::shared_ptr<const llvm::MemoryBuffer> m_file;
 
   Resource() {
     m_data = nullptr;
@@ -39,32 +47,89 @@ struct Resource
   Resource(const char* data, size_t size, const std::string& name):
     m_data(data), m_size(size), m_name(name) {}
 
+  Resource(std::shared_ptr<const llvm::MemoryBuffer> file,
+           const std::string& name):
+    m_data(file->getBufferStart()), m_size(file->getBufferSize()),
+    m_name(name), m_file(std::move(file)) {}
+
   bool operator!() {
     return m_data == nullptr;
   }
 };
 
 
+// The resources embedded in the library
+enum ResourceIndex {
+#define RESOURCE(ID, NAME) RESOURCE_##ID,
+#include "cl_headers/resource_list.def"
+#undef RESOURCE
+  RESOURCE_COUNT
+};
+
 // Singleton class for resource management
 // Its main purpose is to cache the buffers loaded from the resources
-// but it could be easily extended to support file based buffers as well
+// and the files mapped into memory
 class ResourceManager {
 public:
   static ResourceManager &instance() { return g_instance; }
 
-  Resource get_resource(const char *name, const char *id,
-                        const char *type, bool requireNullTerminate);
+  static const char *get_resource_name(ResourceIndex index);
 
-  const char *get_file(const char *path, bool binary, bool requireNullTerminate,
-                       size_t &out_size);
+  Resource get_resource(ResourceIndex index, bool requireNullTerminate);
+
+  // Returns the resource as it is stored in the library, i.e. compressed if
+  // the library was built with the compressed resources, without caching it
+  Resource get_stored_resource(ResourceIndex index);
+
+  // Returns the contents of the file, shared by all the callers until the
+  // file changes. The file is checked on every call and loaded again once its
+  // size, modification time or inode differ from the loaded one; the buffers
+  // handed out before stay valid while referenced.
+  // The file is mapped, it has to be replaced (e.g. renamed over) rather than
+  // rewritten in place, or the pages of the old contents go away under the
+  // mapping. With CCLANG_NO_MMAP set the files are read into memory instead.
+  // Returns the error if the file doesn't exist, isn't a regular file or
+  // can't be read.
+  llvm::ErrorOr<std::shared_ptr<const llvm::MemoryBuffer>>
+  get_file(const char *path, bool binary, bool requireNullTerminate);
 
 private:
   ResourceManager() {}
 
-  bool load_resource(const char *id, const char *pszType,
-                     bool requireNullTerminate);
+  bool load_resource(ResourceIndex index, bool requireNullTerminate);
+
+  // Finds the resource as it is stored, with the uncompressed size if it is
+  // stored compressed and 0 otherwise
+  bool find_resource(ResourceIndex index, const char *&res, size_t &size,
+                     size_t &uncompressed_size);
 
-  void load_file(const char *path, bool binary, bool requireNullTerminate);
+  // Opens the resource archive on the first call, see m_archive
+  bool open_archive();
+
+  // Checks the header and the table of the archive, and looks the resources
+  // up in the table
+  bool index_archive(const char *data, size_t size);
+
+  // Checks that the indexed archive holds all the resources, and their
+  // payloads against their hashes
+  bool verify_archive() const;
+
+  struct MappedFile {
+    std::shared_ptr<const llvm::MemoryBuffer> m_buffer;
+    llvm::sys::fs::UniqueID m_id;
+    llvm::sys::TimePoint<> m_mtime;
+    uint64_t m_size = 0;
+    bool m_nullTerminated = false;
+  };
+
+  static llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>>
+  map_file(const char *path, bool binary, bool requireNullTerminate);
+
+#ifndef _WIN32
+  // True if the files are read into memory rather than mapped, as
+  // CCLANG_NO_MMAP asks
+  static bool read_files();
+#endif
 
   const char* realloc_buffer(const char *id, const char* buf, size_t size,
                              bool requireNullTerminate);
@@ -83,9 +148,24 @@ private:
 private:
   static ResourceManager g_instance;
   llvm::sys::Mutex m_lock;
-  // map that caches the pointers to the loaded buffers and their sizes
+  // the archive the resources are taken from: the file named by the
+  // CCLANG_RESOURCE_ARCHIVE environment variable, or the one embedded in the
+  // library. The file is verified as a whole when it is opened, and not used
+  // if any of its payloads is missing or corrupt. Without an archive the
+  // resources are looked up one by one (Windows).
+  bool m_archiveOpened = false;
+  std::unique_ptr<llvm::MemoryBuffer> m_archiveFile;
+  const char *m_archive = nullptr;
+  // the entries of the resources in the archive, null for the missing ones
+  const ResourceArchiveEntry *m_entries[RESOURCE_COUNT] = {};
+  // caches the pointers to the loaded buffers and their sizes
   // those buffers could be either the pointer to the loaded
   // resource or to the cached buffers (stored in the m_allocations var below)
-  std::map<std::string, std::pair<const char *, size_t>> m_buffers;
+  std::pair<const char *, size_t> m_buffers[RESOURCE_COUNT] = {};
+  // the cached buffers, those of the compressed resources hold them
+  // decompressed. They live as long as the library and are freed at exit, when
+  // the host allocator callbacks may be gone, so they use the default one.
   std::map<std::string, std::vector<char>> m_allocations;
+  // the files mapped by get_file, along with the status they were mapped with
+  std::map<std::string, MappedFile> m_files;
 };
@@ -0,0 +1,69 @@
+/*****************************************************************************\
+
+Copyright (c) Intel Corporation (2009-2017).
+
+    INTEL MAKES NO WARRANTY OF ANY KIND REGARDING THE CODE.  THIS CODE IS
+    LICENSED ON AN "AS IS" BASIS AND INTEL WILL NOT PROVIDE ANY SUPPORT,
+    ASSISTANCE, INSTALLATION, TRAINING OR OTHER SERVICES.  INTEL DOES NOT
+    PROVIDE ANY UPDATES, ENHANCEMENTS OR EXTENSIONS.  INTEL SPECIFICALLY
+    DISCLAIMS ANY WARRANTY OF MERCHANTABILITY, NONINFRINGEMENT, FITNESS FOR ANY
+    PARTICULAR PURPOSE, OR ANY OTHER WARRANTY.  Intel disclaims all liability,
+    including liability for infringement of any proprietary rights, relating to
+    use of the code. No license, express or implied, by estoppel or otherwise,
+    to any intellectual property rights is granted herein.
+
+
+  \file resource_archive.h
+
+  \brief Layout of the archive the embedded resources are packed into
+
+\*****************************************************************************/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// The archive starts with the header, followed by the entry table and the
+// names of the entries. The payloads come after that, each one starting at a
+// page boundary and followed by a '\0', so a mapped payload can be used as a
+// null terminated buffer without a copy. All the offsets are from the start
+// of the archive. A payload stored zstd-compressed has a non-zero
+// uncompressed size. The producer names the library and the LLVM versions the
+// archive was built for, the PCMs can't be used with another clang.
+//
+#define RESOURCE_ARCHIVE_MAGIC "OCLRES1"
+#define RESOURCE_ARCHIVE_VERSION 2
+#define RESOURCE_ARCHIVE_ALIGNMENT 4096
+#define RESOURCE_ARCHIVE_PRODUCER_SIZE 32
+
+struct ResourceArchiveHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t count;
+  // the size of the whole archive
+  uint64_t size;
+  // the RESOURCE_ARCHIVE_PRODUCER of the build, '\0' padded
+  char producer[RESOURCE_ARCHIVE_PRODUCER_SIZE];
+};
+
+struct ResourceArchiveEntry {
+  uint64_t offset;
+  uint64_t size;
+  uint64_t uncompressedSize;
+  // FNV-1a hash of the stored payload
+  uint64_t hash;
+  uint32_t nameOffset;
+  uint32_t nameSize;
+};
+
+static inline uint64_t ResourceArchiveHash(const unsigned char *data,
+                                           size_t size) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= data[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
@@ -0,0 +1,16 @@
+// RUN: %occ-cli %s %cfg_path --cl-device=%cl_device --output=%t.bc
+// RUN: %occ-cli %s --cl-options-ex=-emit-spirv %cfg_path --cl-device=%cl_device --output=%t.spv
+// RUN: %occ-cli %s --cl-options-ex=-emit-bitcode-and-spirv --outputs=%t.both %cfg_path --cl-device=%cl_device | FileCheck %s
+// RUN: cmp %t.bc %t.both.llvm-bc
+// RUN: cmp %t.spv %t.both.spirv
+// RUN: %occ-cli %s --workers=1 --cl-options-ex=-emit-bitcode-and-spirv --outputs=%t.worker %cfg_path --cl-device=%cl_device | FileCheck %s
+// RUN: cmp %t.bc %t.worker.llvm-bc
+// RUN: cmp %t.spv %t.worker.spirv
+
+// -emit-bitcode-and-spirv produces the same bitcode and SPIR-V as the two
+// separate compiles from a single frontend run.
+
+// CHECK: Output llvm-bc saved to
+// CHECK: Output spirv saved to
+
+__kernel void test(__global int *out) { out[get_global_id(0)] = 5; }
@@ -0,0 +1,27 @@
+// RUN: rm -f %t.cap
+// RUN: env CCLANG_CAPTURE_FILE=%t.cap %occ-cli %s %cfg_path --cl-device=%cl_device --output=%t.bc
+// RUN: env CCLANG_CAPTURE_FILE=%t.cap not %occ-cli %s --cl-options="-DBROKEN" %cfg_path --cl-device=%cl_device --output=%t.bc
+// RUN: %occ-cli --method=replay --verbose %t.cap | FileCheck %s
+// RUN: %occ-cli --method=replay --repeat=3 %t.cap | FileCheck %s --check-prefix=REPEAT
+// RUN: rm -f %t.workers.cap
+// RUN: env CCLANG_CAPTURE_FILE=%t.workers.cap %occ-cli %s --workers=1 --preload %cfg_path --cl-device=%cl_device --output=%t.bc
+// RUN: %occ-cli --method=replay %t.workers.cap | FileCheck %s --check-prefix=WORKERS
+
+// The compiles run with CCLANG_CAPTURE_FILE are appended to the capture log,
+// and the replay runs them again with the same inputs. The preload compiles
+// of the library, in the client and in every worker started, are not.
+
+// CHECK: #0 status 0 {{[0-9]+}} us
+// CHECK-NEXT: #1 status -15 {{[0-9]+}} us
+// CHECK-NEXT: Replayed 2 compiles in {{[0-9]+}} us, 1 failed
+
+// REPEAT: Replayed 6 compiles in {{[0-9]+}} us, 3 failed
+// REPEAT-NEXT: Compile time: avg {{[0-9]+}} us
+
+// WORKERS: Replayed 1 compiles in {{[0-9]+}} us, 0 failed
+
+#ifdef BROKEN
+#error broken
+#endif
+
+__kernel void test(__global int *out) { out[get_global_id(0)] = 4; }
@@ -0,0 +1,18 @@
+// RUN: rm -rf %t.dir && mkdir -p %t.dir
+// RUN: echo "#define VALUE 1" > %t.dir/dep.h
+// RUN: %occ-cli %s --cl-options="-I %t.dir" --print-dependencies %cfg_path --cl-device=%cl_device --output=%t.bc > %t.first
+// RUN: FileCheck %s < %t.first
+// RUN: %occ-cli %s --workers=1 --cl-options="-I %t.dir" --print-dependencies %cfg_path --cl-device=%cl_device --output=%t.bc | grep dep.h > %t.worker
+// RUN: grep dep.h %t.first | cmp - %t.worker
+// RUN: echo "#define VALUE 2" > %t.dir/dep.h
+// RUN: %occ-cli %s --cl-options="-I %t.dir" --print-dependencies %cfg_path --cl-device=%cl_device --output=%t.bc | grep dep.h > %t.second
+// RUN: not cmp %t.worker %t.second
+
+// The compile records every file it reads along with the hash of its
+// content, the hash changes with the content of the header.
+
+// CHECK: Dependency: {{[0-9a-f]{16}}} {{.*}}dep.h
+
+#include "dep.h"
+
+__kernel void test(__global int *out) { out[get_global_id(0)] = VALUE; }
@@ -0,0 +1,14 @@
+// RUN: %occ-cli %s --print-fingerprint --cl-options="-DA -DB=2" %cfg_path --cl-device=%cl_device | grep Fingerprint > %t.1
+// RUN: %occ-cli %s --print-fingerprint --cl-options="-DB=2   -DA=1" %cfg_path --cl-device=%cl_device | grep Fingerprint > %t.2
+// RUN: diff %t.1 %t.2
+// RUN: %occ-cli %s --print-fingerprint --cl-options="-DA -DB=3" %cfg_path --cl-device=%cl_device | grep Fingerprint > %t.3
+// RUN: not diff %t.1 %t.3
+// RUN: %occ-cli %s --print-fingerprint --cl-options="-DA -DB=2" --cl-options-ex="-cl-ext=+cl_khr_subgroups,-cl_khr_fp16,-cl_khr_icd" %cfg_path --cl-device=%cl_device | grep Fingerprint > %t.4
+// RUN: %occ-cli %s --print-fingerprint --cl-options="-DA -DB=2" --cl-options-ex="-cl-ext=-cl_khr_fp16,-cl_khr_subgroups -cl-ext=+cl_khr_subgroups,-cl_khr_icd,-cl_khr_local_int32_base_atomics -cl-ext=+cl_khr_local_int32_base_atomics" %cfg_path --cl-device=%cl_device | grep Fingerprint > %t.5
+// RUN: diff %t.4 %t.5
+// RUN: not diff %t.1 %t.4
+
+// The fingerprint doesn't depend on the order of the macro definitions and
+// of the -cl-ext entries, but does on their values.
+
+__kernel void test(__global int *out) { out[get_global_id(0)] = B; }
@@ -0,0 +1,26 @@
+// RUN: not %occ-cli %s --cl-options-ex=-compile-memory-budget=4096 %cfg_path --cl-device=%cl_device 2>&1 | FileCheck %s
+// RUN: %occ-cli %s --cl-options-ex=-compile-memory-budget=0 --verbose %cfg_path --cl-device=%cl_device | FileCheck %s --check-prefix=PEAK
+// RUN: not %occ-cli %s --cl-options-ex=-compile-memory-budget=lots %cfg_path --cl-device=%cl_device 2>&1 | FileCheck %s --check-prefix=INVALID
+
+// A compile that goes over the frontend memory budget is aborted with
+// CL_OUT_OF_HOST_MEMORY, while the log still tells which budget was hit.
+// The budget is checked while the table is parsed, and the compile stops
+// there without follow-up errors.
+
+// CHECK: fatal error: compile memory budget of 4096 bytes exceeded ({{[0-9]+}} bytes in use)
+// CHECK-NOT: error:
+// CHECK: err: -6
+
+// PEAK: Peak frontend memory: {{[1-9][0-9]*}} bytes
+
+// INVALID: err: -43
+
+#define X1(x) x, x, x, x, x, x, x, x
+#define X2(x) X1(x), X1(x), X1(x), X1(x), X1(x), X1(x), X1(x), X1(x)
+#define X3(x) X2(x), X2(x), X2(x), X2(x), X2(x), X2(x), X2(x), X2(x)
+
+__constant int table[] = {X3(1), X3(2), X3(3), X3(4)};
+
+__kernel void test(__global int *out) {
+  out[get_global_id(0)] = table[get_global_id(0) % 2048];
+}
@@ -0,0 +1,20 @@
+// RUN: %occ-cli %s --variants=120,300:spirv64-unknown-unknown:fp64,200:spir64-unknown-unknown %cfg_path --cl-device=%cl_device --output=%t | FileCheck %s
+// RUN: llvm-dis %t.0 -o - | FileCheck %s --check-prefix=V0
+// RUN: llvm-dis %t.1 -o - | FileCheck %s --check-prefix=V1
+// RUN: llvm-dis %t.2 -o - | FileCheck %s --check-prefix=V2
+
+// CompileVariants compiles the source for each of the variants, with the
+// version, the triple and the fp64 support of the variant.
+
+// CHECK: Variant #0 successfully compiled
+// CHECK: Variant #1 successfully compiled
+// CHECK: Variant #2 successfully compiled
+
+// V0: target triple = "{{spir(64)?}}-unknown-unknown"
+// V0: store i32 120
+// V1: target triple = "spirv64-unknown-unknown"
+// V1: store i32 300
+// V2: target triple = "spir64-unknown-unknown"
+// V2: store i32 200
+
+__kernel void test(__global int *out) { out[0] = __OPENCL_VERSION__; }
@@ -0,0 +1,23 @@
+// REQUIRES: system-linux
+// RUN: %occ-cli %s --workers=2 --repeat=4 %cfg_path --cl-device=%cl_device --output=%t.bc
+// RUN: llvm-dis %t.bc -o - | FileCheck %s
+// RUN: rm -f %t.cap
+// RUN: env CCLANG_CAPTURE_FILE=%t.cap not %occ-cli %s --workers=1 --cl-options=-DCRASH %cfg_path --cl-device=%cl_device 2>&1 | FileCheck %s --check-prefix=CRASH
+// RUN: grep -a -c "__debug crash" %t.cap | FileCheck %s --check-prefix=ONCE
+
+// The compiles are forwarded to the opencl-clang-worker processes, and a
+// crashing compile is reported instead of taking the client down. It is not
+// sent to a fresh worker again, the workers capture it once.
+
+// CHECK: define {{.*}}spir_kernel void @test
+
+// CRASH: error: compile worker terminated by signal
+// CRASH: err: -15
+
+// ONCE: {{^}}1{{$}}
+
+#ifdef CRASH
+#pragma clang __debug crash
+#endif
+
+__kernel void test(__global int *out) { out[get_global_id(0)] = 2; }
@@ -0,0 +1,13 @@
+// RUN: %occ-cli %s --cl-options="-g" --cl-options-ex=-deterministic-source-name --repeat=8 %cfg_path --cl-device=%cl_device --output=%t1.bc
+// RUN: %occ-cli %s --cl-options="-g" --cl-options-ex=-deterministic-source-name %cfg_path --cl-device=%cl_device --output=%t2.bc
+// RUN: cmp %t1.bc %t2.bc
+// RUN: llvm-dis %t1.bc -o - | FileCheck %s
+
+// Byte-identical inputs must produce byte-identical outputs, regardless of
+// how many compiles were issued before them in the same process. The source
+// name is derived from the inputs instead of the process-wide counter.
+
+// CHECK: source_filename = "[[NAME:[0-9a-f]{32}]]"
+// CHECK: !DIFile(filename: "[[NAME]]"
+
+__kernel void test(__global int *out) { out[get_global_id(0)] = 42; }
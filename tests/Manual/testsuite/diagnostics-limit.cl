@@ -0,0 +1,28 @@
+// RUN: %occ-cli %s --print-diagnostics --cl-options-ex=-max-diagnostics=3 %cfg_path --cl-device=%cl_device | FileCheck %s
+// RUN: %occ-cli %s --print-diagnostics --cl-options-ex=-max-log-bytes=1 %cfg_path --cl-device=%cl_device | FileCheck %s --check-prefix=BYTES
+// RUN: not %occ-cli %s --print-diagnostics --cl-options=-DERRORS --cl-options-ex=-max-log-bytes=1 %cfg_path --cl-device=%cl_device | FileCheck %s --check-prefix=ERRORS
+// RUN: not %occ-cli %s --cl-options-ex=-max-diagnostics=many %cfg_path --cl-device=%cl_device 2>&1 | FileCheck %s --check-prefix=INVALID
+
+// The warnings past the limit are dropped and counted in a summary note.
+// Past the byte limit the errors after the first one are dropped too.
+
+// CHECK-COUNT-3: diagnostic: warning {{.*}}: expression result unused
+// CHECK-NEXT: diagnostic: note 0: 7 diagnostics were dropped, the log is limited to 3 diagnostics
+// CHECK-NOT: diagnostic:
+
+// BYTES: diagnostic: warning {{.*}}: expression result unused
+// BYTES-NEXT: diagnostic: note 0: 9 diagnostics were dropped, the log is limited to 1 bytes
+
+// ERRORS: diagnostic: warning {{.*}}: expression result unused
+// ERRORS-NEXT: diagnostic: error {{.*}}: use of undeclared identifier 'a'
+// ERRORS-NEXT: diagnostic: note 0: 11 diagnostics were dropped, the log is limited to 1 bytes
+
+// INVALID: err: -43
+
+__kernel void test(__global int *out) {
+  1; 2; 3; 4; 5; 6; 7; 8; 9; 10;
+  out[0] = 0;
+#ifdef ERRORS
+  out[1] = a + b + c;
+#endif
+}
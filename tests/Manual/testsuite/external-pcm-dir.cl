@@ -0,0 +1,48 @@
+// RUN: %occ-cli %s --cl-options="-triple spir64-unknown-unknown -cl-std=CL1.2" --cl-options-ex="-cl-ext=-all,+cl_khr_fp16" --cl-device=%cl_device %cfg_path --output=%t.none.bc --print-dependencies | FileCheck %s --check-prefix=CHECK-NONE
+// RUN: rm -rf %t.pcm && mkdir -p %t.pcm
+// RUN: echo "not a module" > %t.pcm/opencl-c-12-spir64.pcm
+// RUN: env CCLANG_PCM_DIR=%t.pcm %occ-cli %s --cl-options="-triple spir64-unknown-unknown -cl-std=CL1.2" --cl-options-ex="-cl-ext=-all,+cl_khr_fp16" --cl-device=%cl_device %cfg_path --output=%t.garbage.bc --print-dependencies | FileCheck %s --check-prefix=CHECK-NONE
+// RUN: cmp %t.none.bc %t.garbage.bc
+// RUN: env CCLANG_PCM_DIR=%t.missing %occ-cli %s --cl-options="-triple spir64-unknown-unknown -cl-std=CL1.2" --cl-options-ex="-cl-ext=-all,+cl_khr_fp16" --cl-device=%cl_device %cfg_path --output=%t.missing.bc --print-dependencies | FileCheck %s --check-prefix=CHECK-NONE
+// RUN: rm -rf %t.unreadable && mkdir -p %t.unreadable/opencl-c-12-spir64.pcm
+// RUN: env CCLANG_PCM_DIR=%t.unreadable not %occ-cli %s --cl-options="-triple spir64-unknown-unknown -cl-std=CL1.2" --cl-options-ex="-cl-ext=-all,+cl_khr_fp16" --cl-device=%cl_device %cfg_path --output=%t.unreadable.bc 2>&1 | FileCheck %s --check-prefix=CHECK-UNREADABLE
+
+// RUN: rm -rf %t.src && mkdir -p %t.src
+// RUN: cp %cl_headers/opencl-c.h %cl_headers/opencl-c-base.h %cl_headers/module.modulemap %t.src
+// RUN: cd %t.src && %clang_cc1 -x cl -I. -O0 -triple spir64-unknown-unknown -cl-std=CL1.2 -cl-ext=-all,+cl_khr_fp16 -fmodules -fmodule-name=cl12spir64 -fmodule-map-file-home-is-cwd -emit-module module.modulemap -fno-validate-pch -o %t.fp16.pcm
+// RUN: cd %t.src && %clang_cc1 -x cl -I. -O0 -triple spir64-unknown-unknown -cl-std=CL1.2 -cl-ext=-all -fmodules -fmodule-name=cl12spir64 -fmodule-map-file-home-is-cwd -emit-module module.modulemap -fno-validate-pch -o %t.nofp16.pcm
+
+// RUN: rm %t.pcm/opencl-c-12-spir64.pcm
+// RUN: cp %t.nofp16.pcm %t.pcm/opencl-c-12-spir64-nofp16.pcm
+// RUN: env CCLANG_PCM_DIR=%t.pcm %occ-cli %s --cl-options="-triple spir64-unknown-unknown -cl-std=CL1.2" --cl-options-ex="-cl-ext=-all,+cl_khr_fp16" --cl-device=%cl_device %cfg_path --output=%t.nofp16.bc --print-dependencies | FileCheck %s --check-prefix=CHECK-NONE
+// RUN: cp %t.fp16.pcm %t.pcm/opencl-c-12-spir64-fp16.pcm
+// RUN: env CCLANG_PCM_DIR=%t.pcm %occ-cli %s --cl-options="-triple spir64-unknown-unknown -cl-std=CL1.2" --cl-options-ex="-cl-ext=-all,+cl_khr_fp16" --cl-device=%cl_device %cfg_path --output=%t.fp16.bc --print-dependencies | FileCheck %s
+// RUN: env CCLANG_PCM_DIR=%t.pcm %occ-cli %s --cl-options="-triple spir64-unknown-unknown -cl-std=CL1.2" --cl-options-ex="-cl-ext=-all,+cl_khr_fp16" --cl-device=%cl_device %cfg_path --output=%t.mapped.bc --print-mapped-files | FileCheck %s --check-prefix=CHECK-MAPPED
+// RUN: env CCLANG_PCM_DIR=%t.pcm CCLANG_NO_MMAP=1 %occ-cli %s --cl-options="-triple spir64-unknown-unknown -cl-std=CL1.2" --cl-options-ex="-cl-ext=-all,+cl_khr_fp16" --cl-device=%cl_device %cfg_path --output=%t.read.bc --print-mapped-files | FileCheck %s --check-prefix=CHECK-READ
+// RUN: cmp %t.mapped.bc %t.read.bc
+
+// RUN: rm -rf %t.other && mkdir -p %t.other
+// RUN: cp %t.fp16.pcm %t.other/opencl-c-20-spir64-fp16.pcm
+// RUN: cp %t.fp16.pcm %t.other/opencl-c-12-spir-fp16.pcm
+// RUN: env CCLANG_PCM_DIR=%t.other %occ-cli %s --cl-options="-triple spir64-unknown-unknown -cl-std=CL2.0" --cl-options-ex="-cl-ext=-all,+cl_khr_fp16" --cl-device=%cl_device %cfg_path --output=%t.version.bc --print-dependencies | FileCheck %s --check-prefix=CHECK-NONE
+// RUN: env CCLANG_PCM_DIR=%t.other %occ-cli %s --cl-options="-triple spir-unknown-unknown -cl-std=CL1.2" --cl-options-ex="-cl-ext=-all,+cl_khr_fp16" --cl-device=%cl_device %cfg_path --output=%t.triple.bc --print-dependencies | FileCheck %s --check-prefix=CHECK-NONE
+
+// The compiles here support cl_khr_fp16 only, which no embedded PCM is built
+// for, so they parse the headers. A PCM of the external PCM directory named for
+// their language version and triple is loaded instead, if it was built by this
+// clang for the triple, the version and the extensions the -cl-ext options
+// leave supported; its name suffix doesn't matter. A file that isn't such a
+// PCM is ignored, as is a missing directory, while a file that is there but
+// can't be read fails the compile. The file loaded is mapped, or read into
+// memory with CCLANG_NO_MMAP set.
+
+// CHECK-NONE-NOT: Dependency: {{.*}}.pcm
+
+// CHECK: Dependency: {{[0-9a-f]{16}}} {{.*}}opencl-c-12-spir64-fp16.pcm
+
+// CHECK-UNREADABLE: error: can't read the PCM '{{.*}}opencl-c-12-spir64.pcm'
+
+// CHECK-MAPPED: Mapped: {{.*}}.pcm/opencl-c-12-spir64-fp16.pcm
+// CHECK-READ-NOT: Mapped: {{.*}}.pcm/opencl-c-12-spir64
+
+__kernel void test(__global int *out) { out[get_global_id(0)] = 1; }
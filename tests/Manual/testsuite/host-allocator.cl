@@ -0,0 +1,11 @@
+// RUN: %occ-cli %s --use-host-allocator %cfg_path --cl-device=%cl_device --output=%t.bc | FileCheck %s
+// RUN: llvm-dis %t.bc -o - | FileCheck %s --check-prefix=IR
+
+// The result buffers are allocated through the callbacks registered with
+// SetHostAllocator.
+
+// CHECK: Host allocations: {{[1-9][0-9]*}}
+
+// IR: define {{.*}}spir_kernel void @test
+
+__kernel void test(__global int *out) { out[get_global_id(0)] = 1; }
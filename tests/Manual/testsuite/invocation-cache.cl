@@ -0,0 +1,15 @@
+// RUN: %occ-cli %s --cl-options="-s test.cl -DVALUE=4" --cl-options-ex=-no-invocation-cache %cfg_path --cl-device=%cl_device --output=%t.fresh.bc
+// RUN: %occ-cli %s --bench=3 --cl-options="-s test.cl -DVALUE=4" %cfg_path --cl-device=%cl_device --output=%t.cached.bc | FileCheck %s
+// RUN: cmp %t.fresh.bc %t.cached.bc
+// RUN: %occ-cli %s --bench=2 --cl-options="-s other.cl -DVALUE=4" %cfg_path --cl-device=%cl_device --output=%t.other.bc
+// RUN: llvm-dis %t.other.bc -o - | FileCheck %s --check-prefix=OTHER
+
+// The compiles with the same options reuse the cached invocation, which gives
+// the same binary as a fresh one, with the source name of the compile.
+
+// CHECK: Average compile time: {{[0-9]+}} us
+
+// OTHER: source_filename = "other.cl"
+// OTHER: store i32 4
+
+__kernel void test(__global int *out) { out[get_global_id(0)] = VALUE; }
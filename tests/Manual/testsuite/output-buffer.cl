@@ -0,0 +1,21 @@
+// RUN: %occ-cli %s %cfg_path --cl-device=%cl_device --output=%t.bc
+// RUN: %occ-cli %s --use-output-buffer %cfg_path --cl-device=%cl_device --output=%t.buffer.bc | FileCheck %s
+// RUN: cmp %t.bc %t.buffer.bc
+// RUN: %occ-cli %s --cl-options-ex=-emit-spirv %cfg_path --cl-device=%cl_device --output=%t.spv
+// RUN: %occ-cli %s --cl-options-ex=-emit-spirv --use-output-buffer %cfg_path --cl-device=%cl_device --output=%t.buffer.spv | FileCheck %s
+// RUN: cmp %t.spv %t.buffer.spv
+// RUN: %occ-cli %s --workers=1 --use-output-buffer %cfg_path --cl-device=%cl_device --output=%t.worker.bc | FileCheck %s
+// RUN: cmp %t.bc %t.worker.bc
+// RUN: not %occ-cli %s --output-buffer-limit=64 %cfg_path --cl-device=%cl_device --output=%t.full.bc 2>&1 | FileCheck %s --check-prefix=CHECK-FULL
+// RUN: not %occ-cli %s --cl-options-ex=-emit-spirv --output-buffer-limit=64 %cfg_path --cl-device=%cl_device --output=%t.full.spv 2>&1 | FileCheck %s --check-prefix=CHECK-FULL
+
+// CompileToBuffer writes the LLVM IR or the SPIR-V to the caller's buffer, in
+// process and when the compile is forwarded to a worker alike, and produces
+// the same binary as Compile. A buffer that fails to grow fails the compile
+// with CL_OUT_OF_HOST_MEMORY rather than returning a truncated binary.
+
+// CHECK: Output buffer grows: {{[1-9][0-9]*}}
+// CHECK-FULL: error: out of host memory
+// CHECK-FULL: err: -6
+
+__kernel void test(__global int *out) { out[get_global_id(0)] = 3; }
@@ -0,0 +1,34 @@
+// RUN: %occ-cli %s --cl-options="-triple spirv32-unknown-unknown -cl-std=CL2.0" --cl-device=%cl_device %cfg_path --output=%t.spirv32.bc --print-dependencies | FileCheck %s --check-prefix=PCM-SPIRV32
+// RUN: llvm-dis %t.spirv32.bc -o - | FileCheck %s --check-prefixes=CHECK,SPIRV32
+// RUN: %occ-cli %s --cl-options="-triple spirv64-unknown-unknown -cl-std=CL3.0" --use-double --cl-device=%cl_device %cfg_path --output=%t.spirv64.bc --print-dependencies | FileCheck %s --check-prefix=PCM-SPIRV64
+// RUN: llvm-dis %t.spirv64.bc -o - | FileCheck %s --check-prefixes=CHECK,SPIRV64
+// RUN: %occ-cli %s --cl-options="-triple spir64-unknown-unknown -cl-std=CLC++1.0" --cl-device=%cl_device %cfg_path --output=%t.cpp10.bc --print-dependencies | FileCheck %s --check-prefix=PCM-CPP10
+// RUN: llvm-dis %t.cpp10.bc -o - | FileCheck %s --check-prefixes=CHECK,CPP
+// RUN: %occ-cli %s --cl-options="-triple spirv64-unknown-unknown -cl-std=CLC++2021" --use-double --cl-device=%cl_device %cfg_path --output=%t.cpp2021.bc --print-dependencies | FileCheck %s --check-prefix=PCM-CPP2021
+// RUN: llvm-dis %t.cpp2021.bc -o - | FileCheck %s --check-prefixes=CHECK,CPP
+
+// The spirv triples and C++ for OpenCL get PCMs of their own, so the builtins
+// are declared for the right pointer size and language. The module loaded
+// tells that the compile got the PCM of its variant rather than another one
+// or the full headers.
+
+// PCM-SPIRV32: Dependency: {{[0-9a-f]+}} {{.*}}opencl-c-20-spirv32{{(-fp64)?}}.pcm
+// PCM-SPIRV64: Dependency: {{[0-9a-f]+}} {{.*}}opencl-c-30-spirv64-fp64.pcm
+// PCM-CPP10: Dependency: {{[0-9a-f]+}} {{.*}}opencl-cpp-10-spir64{{(-fp64)?}}.pcm
+// PCM-CPP2021: Dependency: {{[0-9a-f]+}} {{.*}}opencl-cpp-2021-spirv64-fp64.pcm
+
+// SPIRV32: target triple = "spirv32-unknown-unknown"
+// SPIRV64: target triple = "spirv64-unknown-unknown"
+// CPP: define {{.*}}@_Z6squareIiET_S0_
+// CHECK: define {{.*}}spir_kernel void @test
+
+#ifdef __OPENCL_CPP_VERSION__
+template <typename T> T square(T x) { return x * x; }
+#else
+int square(int x) { return x * x; }
+#endif
+
+__kernel void test(__global int *out) {
+  size_t gid = get_global_id(0);
+  out[gid] = square((int)gid);
+}
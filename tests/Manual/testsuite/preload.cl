@@ -0,0 +1,14 @@
+// RUN: %occ-cli %s --preload --verbose %cfg_path --cl-device=%cl_device --output=%t.bc | FileCheck %s --check-prefix=TIME
+// RUN: llvm-dis %t.bc -o - | FileCheck %s
+// RUN: %occ-cli %s --preload --use-double %cfg_path --cl-device=%cl_device --output=%t.fp64.bc
+// RUN: llvm-dis %t.fp64.bc -o - | FileCheck %s
+
+// OpenCLClangPreload warms the library up, and the compile after it produces
+// the same module as a cold one.
+
+// TIME: Preload time: {{[0-9]+}} us
+// TIME: successfully compiled
+
+// CHECK: define {{.*}}spir_kernel void @test
+
+__kernel void test(__global int *out) { out[get_global_id(0)] = 4; }
@@ -0,0 +1,31 @@
+// RUN: %occ-cli %s --cl-device=%cl_device %cfg_path --output=%t.embedded.bc
+// RUN: echo "not an archive" > %t.bin
+// RUN: env CCLANG_RESOURCE_ARCHIVE=%t.bin %occ-cli %s --cl-device=%cl_device %cfg_path --output=%t.invalid.bc
+// RUN: cmp %t.embedded.bc %t.invalid.bc
+// RUN: env CCLANG_RESOURCE_ARCHIVE=%t.missing %occ-cli %s --cl-device=%cl_device %cfg_path --output=%t.missing.bc
+// RUN: cmp %t.embedded.bc %t.missing.bc
+
+// RUN: env CCLANG_RESOURCE_ARCHIVE=%cl_headers/opencl-clang-resources.bin %occ-cli %s --cl-device=%cl_device %cfg_path --output=%t.file.bc --print-mapped-files | FileCheck %s --check-prefix=CHECK-FILE
+// RUN: cmp %t.embedded.bc %t.file.bc
+
+// RUN: cp %cl_headers/opencl-clang-resources.bin %t.corrupt.bin
+// RUN: %python -c "import sys; f = open(sys.argv[1], 'r+b'); f.seek(-2, 2); b = f.read(1); f.seek(-2, 2); f.write(bytes([b[0] ^ 1]))" %t.corrupt.bin
+// RUN: env CCLANG_RESOURCE_ARCHIVE=%t.corrupt.bin %occ-cli %s --cl-device=%cl_device %cfg_path --output=%t.corrupt.bc --print-mapped-files | FileCheck %s --check-prefix=CHECK-CORRUPT
+// RUN: cmp %t.embedded.bc %t.corrupt.bc
+
+// RUN: cp %cl_headers/opencl-clang-resources.bin %t.producer.bin
+// RUN: %python -c "import sys; f = open(sys.argv[1], 'r+b'); f.seek(24); f.write(b'0.0/LLVM-0.0.0'.ljust(32, b'\0'))" %t.producer.bin
+// RUN: env CCLANG_RESOURCE_ARCHIVE=%t.producer.bin %occ-cli %s --cl-device=%cl_device %cfg_path --output=%t.producer.bc --print-mapped-files | FileCheck %s --check-prefix=CHECK-PRODUCER
+// RUN: cmp %t.embedded.bc %t.producer.bc
+
+// A resource archive file that can't be read is ignored, and the resources
+// are taken from the archive embedded in the library. The archive file of the
+// build is used instead of the embedded one. One with a payload that doesn't
+// match its hash, or built for another library or LLVM version, is dropped as
+// a whole and the compile falls back to the embedded archive.
+
+// CHECK-FILE: Mapped: {{.*}}opencl-clang-resources.bin
+// CHECK-CORRUPT-NOT: Mapped: {{.*}}corrupt.bin
+// CHECK-PRODUCER-NOT: Mapped: {{.*}}producer.bin
+
+__kernel void test(__global int *out) { out[get_global_id(0)] = 2; }
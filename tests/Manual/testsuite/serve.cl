@@ -0,0 +1,17 @@
+// RUN: echo '{"id": 1, "file": "%s", "output": "%t.bc"}' > %t.jobs
+// RUN: echo '{"id": "broken", "source": "__kernel void broken( {}"}' >> %t.jobs
+// RUN: echo 'not json' >> %t.jobs
+// RUN: echo '{"id": abc, "file": "%s"}' >> %t.jobs
+// RUN: %occ-cli --method=serve %cfg_path --cl-device=%cl_device < %t.jobs 2>/dev/null | FileCheck %s
+// RUN: llvm-dis %t.bc -o - | FileCheck %s --check-prefix=IR
+
+// Every job read from stdin gets one result line, in the order received.
+
+// CHECK: {"id":1,"status":0,"compile_us":{{[0-9]+}},"ir_size":{{[1-9][0-9]*}},"log":
+// CHECK-NEXT: {"id":"broken","status":-15,"compile_us":{{[0-9]+}},"ir_size":0,"log":"{{.*}}error:
+// CHECK-NEXT: {"id":null,"status":-1,"error":"expected '{' at offset 0"}
+// CHECK-NEXT: {"id":null,"status":-1,"error":"unsupported value of 'id' at offset {{[0-9]+}}"}
+
+// IR: define {{.*}}spir_kernel void @test
+
+__kernel void test(__global int *out) { out[get_global_id(0)] = 3; }
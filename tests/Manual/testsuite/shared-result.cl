@@ -0,0 +1,12 @@
+// RUN: %occ-cli %s --share-result=4 %cfg_path --cl-device=%cl_device --output=%t.bc | FileCheck %s
+// RUN: llvm-dis %t.bc -o - | FileCheck %s --check-prefix=IR
+// RUN: %occ-cli %s --workers=1 --share-result=4 %cfg_path --cl-device=%cl_device | FileCheck %s
+
+// A result retained with Retain is held by each consumer until it releases
+// its reference, and the IR is read by all of them without copying.
+
+// CHECK: Result shared by 4 consumers
+
+// IR: define {{.*}}spir_kernel void @test
+
+__kernel void test(__global int *out) { out[get_global_id(0)] = 4; }
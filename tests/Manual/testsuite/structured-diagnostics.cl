@@ -0,0 +1,19 @@
+// RUN: not %occ-cli %s --print-diagnostics %cfg_path --cl-device=%cl_device 2>&1 | FileCheck %s
+// RUN: not %occ-cli %s %cfg_path --cl-device=%cl_device 2>&1 | FileCheck %s --check-prefix=LOG
+
+// The diagnostics are available as structs, and the text log rendered from
+// them keeps the clang format. The compile runs with -fno-caret-diagnostics,
+// so the log has no source line and caret.
+
+// CHECK: diagnostic: error {{[0-9]+}} {{.*}}:[[@LINE+9]]:13: expected ';' at end of declaration
+// CHECK-NEXT: fix-it: [[@LINE+8]]:13-[[@LINE+8]]:13 ";"
+
+// LOG: :[[@LINE+6]]:13: error: expected ';' at end of declaration
+// LOG-NOT: int x = 10
+// LOG-NOT: {{^ *\^$}}
+// LOG: err: -15
+
+__kernel void test(__global int *out) {
+  int x = 10
+  out[0] = x;
+}
@@ -0,0 +1,20 @@
+// RUN: %occ-cli %s --syntax-only %cfg_path --cl-device=%cl_device | FileCheck %s
+// RUN: not %occ-cli %s --syntax-only --cl-options=-DBROKEN %cfg_path --cl-device=%cl_device 2>&1 | FileCheck %s --check-prefix=CHECK-ERR
+// RUN: %occ-cli %s --cl-options-ex=-E %cfg_path --cl-device=%cl_device --output=%t.i
+// RUN: FileCheck %s --check-prefix=CHECK-E < %t.i
+
+// -fsyntax-only in pszOptionsEx stops after Sema and returns the diagnostics
+// only, -E returns the preprocessed source instead of the IR.
+
+// CHECK: successfully compiled
+// CHECK-ERR: use of undeclared identifier 'undeclared'
+// CHECK-E: out[get_global_id(0)] = 42;
+
+#define VALUE 42
+
+__kernel void test(__global int *out) {
+  out[get_global_id(0)] = VALUE;
+#ifdef BROKEN
+  out[0] = undeclared;
+#endif
+}
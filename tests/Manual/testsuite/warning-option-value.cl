@@ -0,0 +1,11 @@
+// RUN: %occ-cli %s --print-diagnostics --cl-options-ex=-Wundef-prefix=FOO %cfg_path --cl-device=%cl_device | FileCheck %s
+
+// The warning options with a value go to clang as they are, rather than
+// being taken as warning names.
+
+// CHECK: diagnostic: warning {{.*}}: 'FOO_ENABLED' is not defined, evaluates to 0
+
+#if FOO_ENABLED
+#endif
+
+__kernel void test(__global int *out) { out[get_global_id(0)] = 1; }
@@ -33,6 +33,7 @@ config.substitutions.extend(
         ("%occ-cli", occ_cli),
         ("%cfg_path", "--config-path=" + cfg_path),
         ("%cl_device", cl_device),
+        ("%cl_headers", config.opencl_clang_headers_dir),
     ]
 )
 
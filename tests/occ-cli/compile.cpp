@@ -22,16 +22,323 @@ to any intellectual property rights is granted herein.
 #include "main.h"
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
 #include <memory>
+#include <set>
 #include <string>
+#include <thread>
 #include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 using namespace std;
 using namespace Intel::OpenCL::ClangFE;
 
 void printCompileUsage(const string&);
 
+// Host allocator callbacks counting the allocations made by the library
+static atomic<unsigned> hostAllocations{0};
+
+static void *countingAlloc(size_t size, void *) {
+  ++hostAllocations;
+  return malloc(size);
+}
+
+static void *countingRealloc(void *ptr, size_t size, void *) {
+  ++hostAllocations;
+  return realloc(ptr, size);
+}
+
+static void countingFree(void *ptr, void *) { free(ptr); }
+
+// Output buffer of CompileToBuffer counting the times it's grown. It fails to
+// grow past the limit.
+class VectorOutputBuffer : public IOCLFEOutputBuffer {
+public:
+  void *Grow(size_t uiSize) override {
+    if (uiSize > m_limit)
+      return nullptr;
+    ++m_grows;
+    m_data.resize(uiSize);
+    return m_data.data();
+  }
+
+  unsigned getGrowCount() const { return m_grows; }
+
+  void setLimit(size_t limit) { m_limit = limit; }
+
+private:
+  vector<char> m_data;
+  unsigned m_grows = 0;
+  size_t m_limit = SIZE_MAX;
+};
+
+// Counts the instructions retired by the calling thread in user space, if the
+// perf events are available
+class InstructionCounter {
+public:
+  InstructionCounter() {
+#ifdef __linux__
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    m_fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+  }
+
+  ~InstructionCounter() {
+#ifdef __linux__
+    if (m_fd >= 0)
+      close(m_fd);
+#endif
+  }
+
+  void start() {
+#ifdef __linux__
+    if (m_fd >= 0) {
+      ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+      ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+  }
+
+  // Returns false if the counter is not available
+  bool stop(unsigned long long &count) {
+#ifdef __linux__
+    if (m_fd >= 0) {
+      ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+      return read(m_fd, &count, sizeof(count)) == sizeof(count);
+    }
+#endif
+    return false;
+  }
+
+private:
+  int m_fd = -1;
+};
+
+// Prints the structured diagnostics of the compile
+static void printDiagnostics(const IOCLFEBinaryResult2 *pResult) {
+  static const char *severities[] = {"note", "remark", "warning", "error",
+                                     "fatal"};
+  const char *strings = pResult->GetDiagnosticStrings();
+  const OCLFEDiagnostic *diags = pResult->GetDiagnostics();
+  const OCLFEFixIt *fixIts = pResult->GetFixIts();
+  for (unsigned i = 0; i < pResult->GetDiagnosticCount(); ++i) {
+    const OCLFEDiagnostic &diag = diags[i];
+    cout << "diagnostic: " << severities[diag.severity] << " " << diag.uiID;
+    if (diag.uiFileOffset != DIAG_NO_STRING)
+      cout << " " << strings + diag.uiFileOffset << ":" << diag.uiLine << ":"
+           << diag.uiColumn;
+    cout << ": " << strings + diag.uiMessageOffset << endl;
+    for (unsigned j = 0; j < diag.uiNumFixIts; ++j) {
+      const OCLFEFixIt &fixIt = fixIts[diag.uiFirstFixIt + j];
+      cout << "fix-it: " << fixIt.uiLine << ":" << fixIt.uiColumn << "-"
+           << fixIt.uiEndLine << ":" << fixIt.uiEndColumn << " \""
+           << strings + fixIt.uiCodeOffset << "\"" << endl;
+    }
+  }
+}
+
+// Compiles the same program from several threads at once and checks that
+// every compile produced exactly the same binary.
+static int checkRepeatedCompiles(unsigned repeat, const string &source,
+                                 const string &options,
+                                 const string &optionsEx,
+                                 const string &version) {
+  vector<string> outputs(repeat);
+  vector<int> errors(repeat, 0);
+  vector<thread> threads;
+  for (unsigned i = 0; i < repeat; ++i) {
+    threads.emplace_back([&, i]() {
+      IOCLFEBinaryResult *pResult = nullptr;
+      errors[i] = Compile(source.c_str(), NULL, 0, NULL, NULL, 0,
+                          options.c_str(), optionsEx.c_str(), version.c_str(),
+                          &pResult);
+      if (pResult) {
+        outputs[i].assign(static_cast<const char *>(pResult->GetIR()),
+                          pResult->GetIRSize());
+        pResult->Release();
+      }
+    });
+  }
+  for (auto &t : threads)
+    t.join();
+
+  for (unsigned i = 0; i < repeat; ++i) {
+    if (errors[i] != 0) {
+      cerr << "ERROR: repeated compile #" << i << " failed, err: " << errors[i]
+           << endl;
+      return errors[i];
+    }
+    if (outputs[i] != outputs[0]) {
+      cerr << "ERROR: repeated compile #" << i
+           << " produced a different binary" << endl;
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Hands the result to several threads, each holding its own reference, and
+// checks that they all read the same IR
+static int checkSharedResult(IOCLFEBinaryResult *pResult, unsigned consumers) {
+  IOCLFEBinaryResult2 *pShared = static_cast<IOCLFEBinaryResult2 *>(pResult);
+  const string expected(static_cast<const char *>(pShared->GetIR()),
+                        pShared->GetIRSize());
+  atomic<unsigned> mismatches{0};
+  vector<thread> threads;
+  for (unsigned i = 0; i < consumers; ++i) {
+    pShared->Retain();
+    threads.emplace_back([&, pShared]() {
+      if (string(static_cast<const char *>(pShared->GetIR()),
+                 pShared->GetIRSize()) != expected)
+        ++mismatches;
+      pShared->Release();
+    });
+  }
+  for (auto &t : threads)
+    t.join();
+
+  if (mismatches != 0) {
+    cerr << "ERROR: " << mismatches.load()
+         << " consumers of the shared result read a different binary" << endl;
+    return -1;
+  }
+  cout << "Result shared by " << consumers << " consumers" << endl;
+  return 0;
+}
+
+// Prints the files read by the compile along with the hashes of their content
+static void printDependencies(const IOCLFEBinaryResult2 *pResult) {
+  static const char digits[] = "0123456789abcdef";
+  for (unsigned i = 0; i < pResult->GetDependencyCount(); ++i) {
+    unsigned long long hash = pResult->GetDependencyHash(i);
+    cout << "Dependency: ";
+    for (int shift = 60; shift >= 0; shift -= 4)
+      cout << digits[(hash >> shift) & 0xf];
+    cout << ' ' << pResult->GetDependencyName(i) << endl;
+  }
+}
+
+// Prints the files mapped into the process, the ones the library keeps mapped
+// after the compile among them
+static void printMappedFiles() {
+  ifstream maps("/proc/self/maps");
+  set<string> printed;
+  string line;
+  while (getline(maps, line)) {
+    size_t pos = line.find('/');
+    if (pos != string::npos && printed.insert(line.substr(pos)).second)
+      cout << "Mapped: " << line.substr(pos) << endl;
+  }
+}
+
+// Saves every output of the compile to <prefix>.<output name>
+static int saveOutputs(const IOCLFEBinaryResult2 *pResult,
+                       const string &prefix) {
+  for (unsigned i = 0; i < pResult->GetOutputCount(); ++i) {
+    const char *name = pResult->GetOutputName(i);
+    if (!pResult->GetOutput(i)) {
+      cerr << "ERROR: Output " << name << " wasn't produced" << endl;
+      return -1;
+    }
+    string file = prefix + '.' + name;
+    FILE *pFile = fopen(file.c_str(), "wb");
+    if (!pFile) {
+      cerr << "Can't open " << file << ".\n";
+      return -1;
+    }
+    fwrite(pResult->GetOutput(i), sizeof(char), pResult->GetOutputSize(i),
+           pFile);
+    fclose(pFile);
+    cout << "Output " << name << " saved to : " << file << endl;
+  }
+  return 0;
+}
+
+// Compiles the variants given as <version>[:<triple>[:fp64]],... with
+// CompileVariants, and saves the IR of each to <ir_file>.<index>
+static int compileVariants(const string &variants, const string &source,
+                           const string &options, const string &optionsEx,
+                           const string &ir_file) {
+  vector<string> fields;
+  vector<OCLFECompileVariant> descs;
+  size_t start = 0;
+  while (start <= variants.size()) {
+    size_t end = variants.find(',', start);
+    if (end == string::npos)
+      end = variants.size();
+    string variant = variants.substr(start, end - start);
+    start = end + 1;
+
+    size_t colon = variant.find(':');
+    OCLFECompileVariant desc = {nullptr, nullptr, 0};
+    fields.push_back(variant.substr(0, colon));
+    if (colon != string::npos) {
+      string rest = variant.substr(colon + 1);
+      colon = rest.find(':');
+      fields.push_back(rest.substr(0, colon));
+      if (colon != string::npos && rest.substr(colon + 1) == "fp64")
+        desc.uiFlags |= VARIANT_FP64;
+    } else {
+      fields.push_back("");
+    }
+    descs.push_back(desc);
+  }
+  // the fields don't move once all of them are added
+  for (size_t i = 0; i < descs.size(); ++i) {
+    descs[i].pszOpenCLVer = fields[2 * i].c_str();
+    descs[i].pszTriple = fields[2 * i + 1].c_str();
+  }
+
+  vector<int> errors(descs.size());
+  vector<IOCLFEBinaryResult *> results(descs.size());
+  int err = CompileVariants(source.c_str(), NULL, 0, NULL, options.c_str(),
+                            optionsEx.c_str(), descs.data(),
+                            static_cast<unsigned>(descs.size()), errors.data(),
+                            results.data());
+  for (size_t i = 0; i < descs.size(); ++i) {
+    if (errors[i] != 0) {
+      cerr << "ERROR: Failed to compile variant #" << i << ":" << endl;
+      if (results[i])
+        cerr << results[i]->GetErrorLog() << endl;
+      cerr << "err: " << errors[i] << endl;
+    } else {
+      cout << "Variant #" << i << " successfully compiled" << endl;
+      if (!ir_file.empty()) {
+        string file = ir_file + '.' + to_string(i);
+        FILE *pFile = fopen(file.c_str(), "wb");
+        if (!pFile) {
+          cerr << "Can't open " << file << ".\n";
+          return -1;
+        }
+        fwrite(results[i]->GetIR(), sizeof(char), results[i]->GetIRSize(),
+               pFile);
+        fclose(pFile);
+      }
+    }
+    if (results[i])
+      results[i]->Release();
+  }
+  return err;
+}
+
 int compile(const vector<string> &args) {
   if (args.size() <= 1) {
     cerr << "At least kernel name should be specified!" << endl;
@@ -46,14 +353,30 @@ int compile(const vector<string> &args) {
   string cl_device = "";
   string cfg_path = "";
   string ir_file = "";
+  string outputs_prefix = "";
+  string variants = "";
   string cl_file_path;
 
   int verbose = 0;
+  unsigned repeat = 1;
+  unsigned workers = 0;
+  unsigned bench = 0;
+  unsigned shareResult = 0;
 
   bool half = false;
   bool doubles = false;
   bool subgroups = false;
   bool channels = false;
+  bool hostAllocator = false;
+  bool outputBuffer = false;
+  size_t outputBufferLimit = SIZE_MAX;
+  bool preload = false;
+  bool diagnostics = false;
+  bool perfCounters = false;
+  bool fingerprint = false;
+  bool syntaxOnly = false;
+  bool dependencies = false;
+  bool mappedFiles = false;
 
   for (const auto &arg : args) {
     // searching --help parameter
@@ -107,6 +430,119 @@ int compile(const vector<string> &args) {
       continue;
     }
 
+    // searching --repeat parameter
+    arg_name = "--repeat=";
+    if (arg.find(arg_name) != string::npos) {
+      repeat = stoul(arg.substr(arg_name.size()));
+      continue;
+    }
+
+    // searching --workers parameter
+    arg_name = "--workers=";
+    if (arg.find(arg_name) != string::npos) {
+      workers = stoul(arg.substr(arg_name.size()));
+      continue;
+    }
+
+    // searching --preload option
+    arg_name = "--preload";
+    if (arg.find(arg_name) != string::npos) {
+      preload = true;
+      continue;
+    }
+
+    // searching --print-diagnostics option
+    arg_name = "--print-diagnostics";
+    if (arg.find(arg_name) != string::npos) {
+      diagnostics = true;
+      continue;
+    }
+
+    // searching --use-host-allocator option
+    arg_name = "--use-host-allocator";
+    if (arg.find(arg_name) != string::npos) {
+      hostAllocator = true;
+      continue;
+    }
+
+    // searching --use-output-buffer option
+    arg_name = "--use-output-buffer";
+    if (arg.find(arg_name) != string::npos) {
+      outputBuffer = true;
+      continue;
+    }
+
+    // searching --output-buffer-limit parameter
+    arg_name = "--output-buffer-limit=";
+    if (arg.find(arg_name) != string::npos) {
+      outputBuffer = true;
+      outputBufferLimit = stoull(arg.substr(arg_name.size()));
+      continue;
+    }
+
+    // searching --variants parameter
+    arg_name = "--variants=";
+    if (arg.find(arg_name) != string::npos) {
+      variants = string(arg.c_str() + arg_name.size());
+      continue;
+    }
+
+    // searching --outputs parameter
+    arg_name = "--outputs=";
+    if (arg.find(arg_name) != string::npos) {
+      outputs_prefix = string(arg.c_str() + arg_name.size());
+      continue;
+    }
+
+    // searching --share-result option
+    arg_name = "--share-result=";
+    if (arg.find(arg_name) != string::npos) {
+      shareResult = atoi(arg.c_str() + arg_name.size());
+      continue;
+    }
+
+    // searching --bench option
+    arg_name = "--bench=";
+    if (arg.find(arg_name) != string::npos) {
+      bench = atoi(arg.c_str() + arg_name.size());
+      continue;
+    }
+
+    // searching --print-fingerprint option
+    arg_name = "--print-fingerprint";
+    if (arg.find(arg_name) != string::npos) {
+      fingerprint = true;
+      continue;
+    }
+
+    // searching --perf-counters option
+    arg_name = "--perf-counters";
+    if (arg.find(arg_name) != string::npos) {
+      perfCounters = true;
+      continue;
+    }
+
+    // searching --print-dependencies option
+    arg_name = "--print-dependencies";
+    if (arg.find(arg_name) != string::npos) {
+      dependencies = true;
+      continue;
+    }
+
+    // searching --print-mapped-files option
+    arg_name = "--print-mapped-files";
+    if (arg.find(arg_name) != string::npos) {
+      mappedFiles = true;
+      continue;
+    }
+
+    // searching --syntax-only option
+    arg_name = "--syntax-only";
+    if (arg.find(arg_name) != string::npos) {
+      syntaxOnly = true;
+      continue;
+    }
+
     // searching --use-half option
     arg_name = "--use-half";
     if (arg.find(arg_name) != string::npos) {
@@ -197,6 +633,12 @@ int compile(const vector<string> &args) {
   if (device_extensions != "-cl-ext=") {
     cl_optionsEx += ' ' + device_extensions;
   }
+  if (syntaxOnly) {
+    cl_optionsEx += " -fsyntax-only";
+  }
+  if (dependencies) {
+    cl_optionsEx += " -record-dependencies";
+  }
 
   if (cl_version.empty()) {
     cl_version = ini.GetSecondKeyVal(cl_device, "pszOpenCLVer");
@@ -212,10 +654,119 @@ int compile(const vector<string> &args) {
          << string(30, '-') << endl;
   }
 
+  if (hostAllocator &&
+      !SetHostAllocator(countingAlloc, countingRealloc, countingFree, NULL)) {
+    cerr << "ERROR: Failed to set the host allocator" << endl;
+    return -1;
+  }
+
+  if (workers > 0 && !StartCompileWorkers(NULL, workers, 0)) {
+    cerr << "ERROR: Failed to start the compile workers" << endl;
+    return -1;
+  }
+
+  if (preload) {
+    auto start = chrono::steady_clock::now();
+    int err = OpenCLClangPreload(cl_version.c_str(), NULL,
+                                 doubles ? PRELOAD_FP64 : 0);
+    if (err != 0) {
+      cerr << "ERROR: Failed to preload, err: " << err << endl;
+      return err;
+    }
+    if (verbose != 0) {
+      cout << "Preload time: "
+           << chrono::duration_cast<chrono::microseconds>(
+                  chrono::steady_clock::now() - start)
+                  .count()
+           << " us" << endl;
+    }
+  }
+
+  if (fingerprint) {
+    unsigned char hash[16];
+    int err = ComputeCompileFingerprint(cl_program_source.c_str(), NULL, 0,
+                                        NULL, cl_options.c_str(),
+                                        cl_optionsEx.c_str(),
+                                        cl_version.c_str(), hash);
+    if (err != 0) {
+      cerr << "ERROR: Failed to compute the fingerprint, err: " << err << endl;
+      return err;
+    }
+    static const char digits[] = "0123456789abcdef";
+    cout << "Fingerprint: ";
+    for (unsigned char byte : hash)
+      cout << digits[byte >> 4] << digits[byte & 0xf];
+    cout << endl;
+  }
+
+  if (bench > 0) {
+    auto start = chrono::steady_clock::now();
+    for (unsigned i = 0; i < bench; ++i) {
+      IOCLFEBinaryResult *pResult = nullptr;
+      int err = Compile(cl_program_source.c_str(), NULL, 0, NULL, NULL, 0,
+                        cl_options.c_str(), cl_optionsEx.c_str(),
+                        cl_version.c_str(), &pResult);
+      if (pResult)
+        pResult->Release();
+      if (err != 0) {
+        cerr << "ERROR: bench compile #" << i << " failed, err: " << err
+             << endl;
+        return err;
+      }
+    }
+    cout << "Average compile time: "
+         << chrono::duration_cast<chrono::microseconds>(
+                chrono::steady_clock::now() - start)
+                    .count() /
+                bench
+         << " us" << endl;
+  }
+
+  if (repeat > 1) {
+    int err = checkRepeatedCompiles(repeat, cl_program_source, cl_options,
+                                    cl_optionsEx, cl_version);
+    if (err != 0)
+      return err;
+  }
+
+  if (!variants.empty()) {
+    return compileVariants(variants, cl_program_source, cl_options,
+                           cl_optionsEx, ir_file);
+  }
+
   // optional outbound pointer to the compilation results
   unique_ptr<IOCLFEBinaryResult *> pBinaryResult(new IOCLFEBinaryResult *);
-  int err = Compile(cl_program_source.c_str(), NULL, 0, NULL, NULL, 0, cl_options.c_str(),
-    cl_optionsEx.c_str(), cl_version.c_str(), pBinaryResult.get());
+  // the IR is written to it with --use-output-buffer
+  VectorOutputBuffer output;
+  output.setLimit(outputBufferLimit);
+  InstructionCounter instructions;
+  auto start = chrono::steady_clock::now();
+  instructions.start();
+  int err = outputBuffer
+                ? CompileToBuffer(cl_program_source.c_str(), NULL, 0, NULL,
+                                  NULL, 0, cl_options.c_str(),
+                                  cl_optionsEx.c_str(), cl_version.c_str(),
+                                  &output, pBinaryResult.get())
+                : Compile(cl_program_source.c_str(), NULL, 0, NULL, NULL, 0,
+                          cl_options.c_str(), cl_optionsEx.c_str(),
+                          cl_version.c_str(), pBinaryResult.get());
+  unsigned long long instructionCount = 0;
+  bool counted = instructions.stop(instructionCount);
+  auto compileTime = chrono::duration_cast<chrono::microseconds>(
+                         chrono::steady_clock::now() - start)
+                         .count();
+
+  if (perfCounters) {
+    cout << "Compile time: " << compileTime << " us" << endl;
+    if (counted)
+      cout << "Instructions: " << instructionCount << endl;
+    else
+      cout << "Instructions: unavailable" << endl;
+  }
+
+  if (diagnostics && *pBinaryResult) {
+    printDiagnostics(static_cast<IOCLFEBinaryResult2 *>(*pBinaryResult));
+  }
 
   if (err != 0) {
     if (verbose == 0) {
@@ -233,7 +784,8 @@ int compile(const vector<string> &args) {
     return err;
   }
 
-  if ((*pBinaryResult)->GetIRSize() == 0) {
+  // -fsyntax-only produces no IR
+  if (!syntaxOnly && (*pBinaryResult)->GetIRSize() == 0) {
     cerr << (*pBinaryResult)->GetErrorLog() << endl;
     cerr << static_cast<unsigned int>((*pBinaryResult)->GetIRSize()) << endl;
     return -1;
@@ -241,6 +793,42 @@ int compile(const vector<string> &args) {
 
   cout << "Kernel " << cl_file_path << " successfully compiled" << endl;
 
+  if (verbose != 0) {
+    cout << "Peak frontend memory: "
+         << static_cast<IOCLFEBinaryResult2 *>(*pBinaryResult)
+                ->GetPeakAllocatedBytes()
+         << " bytes" << endl;
+  }
+
+  if (hostAllocator) {
+    cout << "Host allocations: " << hostAllocations.load() << endl;
+  }
+
+  if (outputBuffer) {
+    cout << "Output buffer grows: " << output.getGrowCount() << endl;
+  }
+
+  if (dependencies) {
+    printDependencies(static_cast<IOCLFEBinaryResult2 *>(*pBinaryResult));
+  }
+
+  if (mappedFiles) {
+    printMappedFiles();
+  }
+
+  if (!outputs_prefix.empty()) {
+    int err = saveOutputs(
+        static_cast<IOCLFEBinaryResult2 *>(*pBinaryResult), outputs_prefix);
+    if (err != 0)
+      return err;
+  }
+
+  if (shareResult > 0) {
+    int err = checkSharedResult(*pBinaryResult, shareResult);
+    if (err != 0)
+      return err;
+  }
+
   if (ir_file == "-") {
     fwrite((*pBinaryResult)->GetIR(), sizeof(char),
            (*pBinaryResult)->GetIRSize(), stdout);
@@ -307,6 +895,54 @@ void printCompileUsage(const string &executable) {
       << endl
       << " --cl-version=<cl_version>   - OpenCL version string - '120' for "
          "OpenCL 1.2, '200' for OpenCL 2.0, ..."
+      << endl
+      << " --repeat=<N>                - Compile the kernel N times "
+         "concurrently and check that the outputs are identical"
+      << endl
+      << " --workers=<N>               - Compile in N worker processes "
+         "instead of in-process"
+      << endl
+      << " --preload                   - Warm up the library with "
+         "OpenCLClangPreload before the compile"
+      << endl
+      << " --print-diagnostics         - Print the structured diagnostics "
+         "of the compile"
+      << endl
+      << " --use-host-allocator        - Allocate the library memory through "
+         "the host allocator callbacks"
+      << endl
+      << " --use-output-buffer         - Compile to a buffer of occ-cli "
+         "with CompileToBuffer"
+      << endl
+      << " --output-buffer-limit=<N>   - Compile to a buffer of occ-cli "
+         "that fails to grow past N bytes"
+      << endl
+      << " --variants=<variants>       - Compile the variants given as "
+         "<version>[:<triple>[:fp64]],... at once, saving the IR of each to "
+         "<file_name>.<index>"
+      << endl
+      << " --outputs=<prefix>          - Save every output of the compile to "
+         "<prefix>.<output name>"
+      << endl
+      << " --share-result=<N>          - Retain the result for N threads "
+         "reading it concurrently"
+      << endl
+      << " --bench=<N>                 - Compile the kernel N times in a row "
+         "and print the average time"
+      << endl
+      << " --print-fingerprint         - Print the fingerprint of the compile"
+      << endl
+      << " --print-dependencies        - Print the files read by the "
+         "compile and the hashes of their content"
+      << endl
+      << " --print-mapped-files        - Print the files mapped into the "
+         "process after the compile"
+      << endl
+      << " --syntax-only               - Only check the syntax and the "
+         "semantics of the kernel, no IR is produced"
+      << endl
+      << " --perf-counters             - Print the time and the instructions "
+         "retired of the compile"
       << endl;
 
   cout << " misc:" << endl
@@ -52,6 +52,10 @@ int main(int argc, char *argv[]) {
     int retvalue = 0;
     if (method == "compile") {
       retvalue = compile(args);
+    } else if (method == "serve") {
+      retvalue = serve(args);
+    } else if (method == "replay") {
+      retvalue = replay(args);
     } else if (method == "checkcompileoptions") {
       retvalue = checkCompileOptions(args);
     } else {
@@ -75,6 +79,8 @@ void printUsage(const string &executable) {
   cout << "\t CheckLinkOptions" << endl;
   cout << "\t Compile" << endl;
   cout << "\t Link" << endl;
+  cout << "\t Serve" << endl;
+  cout << "\t Replay" << endl;
   cout << "\t GetKernelArgInfo" << endl;
   cout << endl;
   cout << "For details type: " << endl;
@@ -25,5 +25,7 @@ to any intellectual property rights is granted herein.
 int checkCompileOptions(const std::vector<std::string>& args);
 int checkLinkOptions(const std::vector<std::string>& args);
 int compile(const std::vector<std::string>& args);
+int serve(const std::vector<std::string>& args);
+int replay(const std::vector<std::string>& args);
 
 #endif // _MAIN_
@@ -0,0 +1,258 @@
+/*****************************************************************************\
+
+Copyright(c) Intel Corporation(2009 - 2016).
+
+INTEL MAKES NO WARRANTY OF ANY KIND REGARDING THE CODE.THIS CODE IS
+LICENSED ON AN "AS IS" BASIS AND INTEL WILL NOT PROVIDE ANY SUPPORT,
+ASSISTANCE, INSTALLATION, TRAINING OR OTHER SERVICES.INTEL DOES NOT
+PROVIDE ANY UPDATES, ENHANCEMENTS OR EXTENSIONS.INTEL SPECIFICALLY
+DISCLAIMS ANY WARRANTY OF MERCHANTABILITY, NONINFRINGEMENT, FITNESS FOR ANY
+PARTICULAR PURPOSE, OR ANY OTHER WARRANTY.Intel disclaims all liability,
+including liability for infringement of any proprietary rights, relating to
+use of the code.No license, express or implied, by estoppel or otherwise,
+to any intellectual property rights is granted herein.
+
+\file replay.cpp
+
+\*****************************************************************************/
+
+#include "main.h"
+
+#include "opencl_clang.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace Intel::OpenCL::ClangFE;
+
+void printReplayUsage(const string &);
+
+namespace {
+
+//
+// Compile inputs read from a capture log, see compile_capture.h for the
+// format of the log.
+//
+struct CapturedCompile {
+  uint64_t timestamp;
+  string version, options, optionsEx, source;
+  bool hasVersion, hasOptions, hasOptionsEx, hasSource;
+  vector<string> headers;
+  vector<string> headerNames;
+};
+
+class CaptureReader {
+public:
+  CaptureReader(const char *data, size_t size)
+      : m_data(data), m_size(size), m_pos(0) {}
+
+  bool readU32(uint32_t &value) {
+    if (m_size - m_pos < 4)
+      return false;
+    value = 0;
+    for (int i = 0; i < 4; ++i)
+      value |= uint32_t(uint8_t(m_data[m_pos++])) << (8 * i);
+    return true;
+  }
+
+  bool readU64(uint64_t &value) {
+    if (m_size - m_pos < 8)
+      return false;
+    value = 0;
+    for (int i = 0; i < 8; ++i)
+      value |= uint64_t(uint8_t(m_data[m_pos++])) << (8 * i);
+    return true;
+  }
+
+  bool readString(string &value, bool &present) {
+    uint32_t len;
+    if (!readU32(len))
+      return false;
+    present = len != 0xFFFFFFFF;
+    value.clear();
+    if (!present)
+      return true;
+    if (m_size - m_pos < len)
+      return false;
+    value.assign(m_data + m_pos, len);
+    m_pos += len;
+    return true;
+  }
+
+  bool readRecord(CapturedCompile &compile) {
+    uint32_t numHeaders;
+    bool present;
+    if (!readU64(compile.timestamp) ||
+        !readString(compile.version, compile.hasVersion) ||
+        !readString(compile.options, compile.hasOptions) ||
+        !readString(compile.optionsEx, compile.hasOptionsEx) ||
+        !readString(compile.source, compile.hasSource) ||
+        !readU32(numHeaders))
+      return false;
+    compile.headers.resize(numHeaders);
+    compile.headerNames.resize(numHeaders);
+    for (uint32_t i = 0; i < numHeaders; ++i)
+      if (!readString(compile.headerNames[i], present) ||
+          !readString(compile.headers[i], present))
+        return false;
+    return m_pos == m_size;
+  }
+
+private:
+  const char *m_data;
+  size_t m_size;
+  size_t m_pos;
+};
+
+bool readCaptureLog(const string &path, vector<CapturedCompile> &compiles) {
+  ifstream file(path, ios::binary);
+  if (!file.is_open()) {
+    cerr << "Can't open the capture log " << path << endl;
+    return false;
+  }
+  string content((istreambuf_iterator<char>(file)),
+                 istreambuf_iterator<char>());
+
+  const string magic = "OCLCAP1\n";
+  if (content.compare(0, magic.size(), magic) != 0) {
+    cerr << path << " is not a capture log" << endl;
+    return false;
+  }
+
+  size_t pos = magic.size();
+  while (pos < content.size()) {
+    uint32_t size;
+    CaptureReader sizeReader(content.data() + pos, content.size() - pos);
+    if (!sizeReader.readU32(size) || content.size() - pos - 4 < size) {
+      // a process killed while writing leaves a partial record at the end
+      cerr << "Truncated record at offset " << pos << " is skipped" << endl;
+      break;
+    }
+    CapturedCompile compile;
+    CaptureReader reader(content.data() + pos + 4, size);
+    if (!reader.readRecord(compile)) {
+      cerr << "Malformed record at offset " << pos << endl;
+      return false;
+    }
+    compiles.push_back(std::move(compile));
+    pos += 4 + size;
+  }
+  return true;
+}
+
+int replayCompile(const CapturedCompile &compile) {
+  vector<const char *> headers, headerNames;
+  for (size_t i = 0; i < compile.headers.size(); ++i) {
+    headers.push_back(compile.headers[i].c_str());
+    headerNames.push_back(compile.headerNames[i].c_str());
+  }
+
+  IOCLFEBinaryResult *result = nullptr;
+  int ret = Compile(compile.hasSource ? compile.source.c_str() : nullptr,
+                    headers.data(), static_cast<unsigned>(headers.size()),
+                    headerNames.data(), nullptr, 0,
+                    compile.hasOptions ? compile.options.c_str() : nullptr,
+                    compile.hasOptionsEx ? compile.optionsEx.c_str() : nullptr,
+                    compile.hasVersion ? compile.version.c_str() : nullptr,
+                    &result);
+  if (result)
+    result->Release();
+  return ret;
+}
+
+} // namespace
+
+int replay(const vector<string> &args) {
+  string log_path;
+  unsigned repeat = 1;
+  bool verbose = false;
+
+  for (size_t i = 1; i < args.size(); ++i) {
+    const string &arg = args[i];
+    if (arg == "--help") {
+      printReplayUsage(args[0]);
+      return 0;
+    }
+
+    string arg_name = "--method=";
+    if (arg.find(arg_name) == 0)
+      continue;
+
+    arg_name = "--repeat=";
+    if (arg.find(arg_name) == 0) {
+      repeat = max(1, atoi(arg.substr(arg_name.size()).c_str()));
+      continue;
+    }
+
+    if (arg == "--verbose") {
+      verbose = true;
+      continue;
+    }
+
+    log_path = arg;
+  }
+
+  if (log_path.empty()) {
+    printReplayUsage(args[0]);
+    return -1;
+  }
+
+  vector<CapturedCompile> compiles;
+  if (!readCaptureLog(log_path, compiles))
+    return -1;
+
+  size_t failed = 0;
+  long long total = 0, minTime = -1, maxTime = 0;
+  for (unsigned iter = 0; iter < repeat; ++iter) {
+    for (size_t i = 0; i < compiles.size(); ++i) {
+      auto start = chrono::steady_clock::now();
+      int ret = replayCompile(compiles[i]);
+      long long time = chrono::duration_cast<chrono::microseconds>(
+                           chrono::steady_clock::now() - start)
+                           .count();
+      if (ret != 0)
+        ++failed;
+      total += time;
+      minTime = minTime < 0 ? time : min(minTime, time);
+      maxTime = max(maxTime, time);
+      if (verbose)
+        cout << "#" << i << " status " << ret << " " << time << " us" << endl;
+    }
+  }
+
+  size_t count = compiles.size() * repeat;
+  cout << "Replayed " << count << " compiles in " << total << " us, "
+       << failed << " failed" << endl;
+  if (count)
+    cout << "Compile time: avg " << total / (long long)count << " us, min "
+         << minTime << " us, max " << maxTime << " us" << endl;
+  return 0;
+}
+
+void printReplayUsage(const string &executable) {
+  cout << "OVERVIEW: Re-run the compiles recorded to a capture log with the "
+          "CCLANG_CAPTURE_FILE environment variable"
+       << endl
+       << endl;
+
+  cout << "USAGE: " << executable
+       << " --method=replay [--repeat=<count>] [--verbose] <capture log>"
+       << endl
+       << endl;
+
+  cout << "OPTIONS:" << endl
+       << " --repeat=<count>            - Replay the log the given number of "
+          "times"
+       << endl
+       << " --verbose                   - Print the status and the time of "
+          "every compile"
+       << endl;
+}
@@ -0,0 +1,541 @@
+/*****************************************************************************\
+
+Copyright(c) Intel Corporation(2009 - 2016).
+
+INTEL MAKES NO WARRANTY OF ANY KIND REGARDING THE CODE.THIS CODE IS
+LICENSED ON AN "AS IS" BASIS AND INTEL WILL NOT PROVIDE ANY SUPPORT,
+ASSISTANCE, INSTALLATION, TRAINING OR OTHER SERVICES.INTEL DOES NOT
+PROVIDE ANY UPDATES, ENHANCEMENTS OR EXTENSIONS.INTEL SPECIFICALLY
+DISCLAIMS ANY WARRANTY OF MERCHANTABILITY, NONINFRINGEMENT, FITNESS FOR ANY
+PARTICULAR PURPOSE, OR ANY OTHER WARRANTY.Intel disclaims all liability,
+including liability for infringement of any proprietary rights, relating to
+use of the code.No license, express or implied, by estoppel or otherwise,
+to any intellectual property rights is granted herein.
+
+\file serve.cpp
+
+\*****************************************************************************/
+
+#include "IniFiles.h"
+#include "common.h"
+#include "main.h"
+
+#include "opencl_clang.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+using namespace Intel::OpenCL::ClangFE;
+
+void printServeUsage(const string &);
+
+namespace {
+
+// Compile settings taken from the config file once at startup
+struct ServeConfig {
+  string options;
+  string optionsEx;
+  string version;
+};
+
+//
+// Value of a field of a flat JSON object. Strings are unescaped, numbers and
+// literals are kept as written.
+//
+struct JsonValue {
+  string text;
+  bool isString;
+};
+
+typedef map<string, JsonValue> JsonObject;
+
+class JsonParser {
+public:
+  explicit JsonParser(const string &text) : m_text(text), m_pos(0) {}
+
+  // Parses a single object whose values are strings, numbers or literals
+  bool parseObject(JsonObject &object, string &error) {
+    skipSpaces();
+    if (!consume('{'))
+      return fail(error, "expected '{'");
+    skipSpaces();
+    if (consume('}'))
+      return finish(error);
+    for (;;) {
+      string key;
+      skipSpaces();
+      if (!parseString(key))
+        return fail(error, "expected a string key");
+      skipSpaces();
+      if (!consume(':'))
+        return fail(error, "expected ':'");
+      skipSpaces();
+      JsonValue value;
+      if (!parseValue(value))
+        return fail(error, "unsupported value of '" + key + "'");
+      object[key] = value;
+      skipSpaces();
+      if (consume('}'))
+        return finish(error);
+      if (!consume(','))
+        return fail(error, "expected ',' or '}'");
+    }
+  }
+
+private:
+  bool finish(string &error) {
+    skipSpaces();
+    return m_pos == m_text.size() || fail(error, "trailing characters");
+  }
+
+  bool fail(string &error, const string &what) {
+    error = what + " at offset " + to_string(m_pos);
+    return false;
+  }
+
+  void skipSpaces() {
+    while (m_pos < m_text.size() &&
+           (m_text[m_pos] == ' ' || m_text[m_pos] == '\t' ||
+            m_text[m_pos] == '\r' || m_text[m_pos] == '\n'))
+      ++m_pos;
+  }
+
+  bool consume(char c) {
+    if (m_pos < m_text.size() && m_text[m_pos] == c) {
+      ++m_pos;
+      return true;
+    }
+    return false;
+  }
+
+  bool parseValue(JsonValue &value) {
+    if (m_pos < m_text.size() && m_text[m_pos] == '"') {
+      value.isString = true;
+      return parseString(value.text);
+    }
+    size_t start = m_pos;
+    while (m_pos < m_text.size() &&
+           (isalnum(static_cast<unsigned char>(m_text[m_pos])) ||
+            m_text[m_pos] == '-' || m_text[m_pos] == '+' ||
+            m_text[m_pos] == '.'))
+      ++m_pos;
+    value.isString = false;
+    value.text = m_text.substr(start, m_pos - start);
+    // the literals are echoed back as written, so they must be valid JSON
+    return value.text == "true" || value.text == "false" ||
+           value.text == "null" || isNumber(value.text);
+  }
+
+  // Checks the JSON number grammar, an optional minus, the integer part
+  // without leading zeros, and the optional fraction and exponent
+  static bool isNumber(const string &text) {
+    size_t i = 0;
+    auto digits = [&]() {
+      size_t begin = i;
+      while (i < text.size() && isdigit(static_cast<unsigned char>(text[i])))
+        ++i;
+      return i > begin;
+    };
+    if (i < text.size() && text[i] == '-')
+      ++i;
+    if (i < text.size() && text[i] == '0')
+      ++i;
+    else if (!digits())
+      return false;
+    if (i < text.size() && text[i] == '.') {
+      ++i;
+      if (!digits())
+        return false;
+    }
+    if (i < text.size() && (text[i] == 'e' || text[i] == 'E')) {
+      ++i;
+      if (i < text.size() && (text[i] == '+' || text[i] == '-'))
+        ++i;
+      if (!digits())
+        return false;
+    }
+    return i == text.size();
+  }
+
+  bool parseHex4(unsigned &code) {
+    if (m_text.size() - m_pos < 4)
+      return false;
+    code = 0;
+    for (int i = 0; i < 4; ++i) {
+      char c = m_text[m_pos++];
+      code <<= 4;
+      if (c >= '0' && c <= '9')
+        code |= c - '0';
+      else if (c >= 'a' && c <= 'f')
+        code |= c - 'a' + 10;
+      else if (c >= 'A' && c <= 'F')
+        code |= c - 'A' + 10;
+      else
+        return false;
+    }
+    return true;
+  }
+
+  static void appendUTF8(string &out, unsigned code) {
+    if (code < 0x80) {
+      out += static_cast<char>(code);
+    } else if (code < 0x800) {
+      out += static_cast<char>(0xC0 | (code >> 6));
+      out += static_cast<char>(0x80 | (code & 0x3F));
+    } else if (code < 0x10000) {
+      out += static_cast<char>(0xE0 | (code >> 12));
+      out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+      out += static_cast<char>(0x80 | (code & 0x3F));
+    } else {
+      out += static_cast<char>(0xF0 | (code >> 18));
+      out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+      out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+      out += static_cast<char>(0x80 | (code & 0x3F));
+    }
+  }
+
+  bool parseString(string &out) {
+    if (!consume('"'))
+      return false;
+    while (m_pos < m_text.size()) {
+      char c = m_text[m_pos++];
+      if (c == '"')
+        return true;
+      if (c != '\\') {
+        out += c;
+        continue;
+      }
+      if (m_pos == m_text.size())
+        return false;
+      switch (m_text[m_pos++]) {
+      case '"': out += '"'; break;
+      case '\\': out += '\\'; break;
+      case '/': out += '/'; break;
+      case 'b': out += '\b'; break;
+      case 'f': out += '\f'; break;
+      case 'n': out += '\n'; break;
+      case 'r': out += '\r'; break;
+      case 't': out += '\t'; break;
+      case 'u': {
+        unsigned code;
+        if (!parseHex4(code))
+          return false;
+        // surrogate pair
+        if (code >= 0xD800 && code < 0xDC00) {
+          unsigned low;
+          if (!consume('\\') || !consume('u') || !parseHex4(low) ||
+              low < 0xDC00 || low >= 0xE000)
+            return false;
+          code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+        }
+        appendUTF8(out, code);
+        break;
+      }
+      default:
+        return false;
+      }
+    }
+    return false;
+  }
+
+  const string &m_text;
+  size_t m_pos;
+};
+
+string escapeJson(const string &str) {
+  string out;
+  out.reserve(str.size() + 2);
+  out += '"';
+  for (char c : str) {
+    switch (c) {
+    case '"': out += "\\\""; break;
+    case '\\': out += "\\\\"; break;
+    case '\n': out += "\\n"; break;
+    case '\r': out += "\\r"; break;
+    case '\t': out += "\\t"; break;
+    default:
+      if (static_cast<unsigned char>(c) < 0x20) {
+        char buf[8];
+        snprintf(buf, sizeof(buf), "\\u%04x", c);
+        out += buf;
+      } else {
+        out += c;
+      }
+    }
+  }
+  out += '"';
+  return out;
+}
+
+string getField(const JsonObject &job, const string &name) {
+  auto it = job.find(name);
+  return it == job.end() ? string() : it->second.text;
+}
+
+//
+// Runs a single compile job and returns the JSON line describing its result.
+// Job fields:
+//    id - a string, a number, true, false or null, echoed back as is
+//    source - the program source, or file - path to the program source
+//    options, options_ex, version - added to the config file settings
+//    output - optional path to save the IR to
+//
+string runJob(const string &line, const ServeConfig &config) {
+  JsonObject job;
+  string error;
+  JsonParser parser(line);
+  if (!parser.parseObject(job, error))
+    return "{\"id\":null,\"status\":-1,\"error\":" + escapeJson(error) + "}";
+
+  string id = "null";
+  auto idIt = job.find("id");
+  if (idIt != job.end())
+    id = idIt->second.isString ? escapeJson(idIt->second.text)
+                               : idIt->second.text;
+
+  string source = getField(job, "source");
+  string file = getField(job, "file");
+  if (!file.empty())
+    source = readFile(file);
+  if (source.empty())
+    return "{\"id\":" + id + ",\"status\":-1,\"error\":" +
+           escapeJson(file.empty() ? "no source" : "failed to read " + file) +
+           "}";
+
+  string options = getField(job, "options") + ' ' + config.options;
+  string optionsEx = config.optionsEx + ' ' + getField(job, "options_ex");
+  string version = getField(job, "version");
+  if (version.empty())
+    version = config.version;
+
+  IOCLFEBinaryResult *pResult = nullptr;
+  auto start = chrono::steady_clock::now();
+  int err = Compile(source.c_str(), NULL, 0, NULL, NULL, 0, options.c_str(),
+                    optionsEx.c_str(), version.c_str(), &pResult);
+  auto compileTime = chrono::duration_cast<chrono::microseconds>(
+      chrono::steady_clock::now() - start);
+
+  ostringstream response;
+  response << "{\"id\":" << id << ",\"status\":" << err
+           << ",\"compile_us\":" << compileTime.count();
+  if (pResult) {
+    response << ",\"ir_size\":" << pResult->GetIRSize() << ",\"log\":"
+             << escapeJson(pResult->GetErrorLog() ? pResult->GetErrorLog()
+                                                  : "");
+
+    string output = getField(job, "output");
+    if (err == 0 && !output.empty()) {
+      FILE *pFile = fopen(output.c_str(), "wb");
+      if (!pFile) {
+        response << ",\"error\":" << escapeJson("can't open " + output);
+      } else {
+        fwrite(pResult->GetIR(), sizeof(char), pResult->GetIRSize(), pFile);
+        fclose(pFile);
+      }
+    }
+    pResult->Release();
+  }
+  response << "}";
+  return response.str();
+}
+
+#ifndef _WIN32
+bool sendAll(int fd, const string &data) {
+  size_t sent = 0;
+  while (sent < data.size()) {
+    ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+    if (n <= 0)
+      return false;
+    sent += n;
+  }
+  return true;
+}
+
+// Serves the jobs of a single connection in order
+void serveConnection(int fd, const ServeConfig &config) {
+  string pending;
+  char buf[4096];
+  for (;;) {
+    ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    if (n <= 0)
+      break;
+    pending.append(buf, n);
+    size_t eol;
+    while ((eol = pending.find('\n')) != string::npos) {
+      string line = pending.substr(0, eol);
+      pending.erase(0, eol + 1);
+      if (line.find_first_not_of(" \t\r") == string::npos)
+        continue;
+      if (!sendAll(fd, runJob(line, config) + "\n")) {
+        close(fd);
+        return;
+      }
+    }
+  }
+  close(fd);
+}
+
+int serveSocket(const string &path, const ServeConfig &config) {
+  sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    cerr << "Socket path is too long: " << path << endl;
+    return -1;
+  }
+  path.copy(addr.sun_path, path.size());
+
+  int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listener < 0) {
+    cerr << "Failed to create a socket" << endl;
+    return -1;
+  }
+  unlink(path.c_str());
+  if (bind(listener, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+      listen(listener, SOMAXCONN) != 0) {
+    cerr << "Failed to listen on " << path << endl;
+    close(listener);
+    return -1;
+  }
+
+  // Every client gets its own thread, its jobs run in the order received
+  for (;;) {
+    int fd = accept(listener, nullptr, nullptr);
+    if (fd < 0) {
+      // a signal or a client gone before being accepted
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      // out of descriptors or memory: wait for the connections being served
+      // to release some rather than spin
+      if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS ||
+          errno == ENOMEM) {
+        this_thread::sleep_for(chrono::milliseconds(100));
+        continue;
+      }
+      cerr << "Failed to accept a connection on " << path << ": "
+           << strerror(errno) << endl;
+      close(listener);
+      return -1;
+    }
+    thread(serveConnection, fd, cref(config)).detach();
+  }
+}
+#endif
+
+} // namespace
+
+int serve(const vector<string> &args) {
+  string cfg_path;
+  string cl_device;
+  string socket_path;
+
+  for (const auto &arg : args) {
+    if (arg == "--help") {
+      printServeUsage(args[0]);
+      return 0;
+    }
+
+    string arg_name = "--config-path=";
+    if (arg.find(arg_name) == 0) {
+      cfg_path = arg.substr(arg_name.size());
+      continue;
+    }
+
+    arg_name = "--cl-device=";
+    if (arg.find(arg_name) == 0) {
+      cl_device = arg.substr(arg_name.size());
+      transform(cl_device.begin(), cl_device.end(), cl_device.begin(),
+                ::toupper);
+      continue;
+    }
+
+    arg_name = "--socket=";
+    if (arg.find(arg_name) == 0) {
+      socket_path = arg.substr(arg_name.size());
+      continue;
+    }
+  }
+
+  // stdout carries the results only, so the config file messages go to stderr
+  streambuf *coutBuf = cout.rdbuf(cerr.rdbuf());
+  IniFile ini(cfg_path + "/ConfExt.ini");
+  bool opened = ini.Open();
+  ServeConfig config;
+  if (opened) {
+    config.options = ini.GetSecondKeyVal(cl_device, "pszOptions");
+    config.optionsEx = ini.GetSecondKeyVal(cl_device, "pszOptionsEx");
+    config.version = ini.GetSecondKeyVal(cl_device, "pszOpenCLVer");
+  }
+  cout.rdbuf(coutBuf);
+  if (!opened) {
+    return -1;
+  }
+
+  if (!socket_path.empty()) {
+#ifndef _WIN32
+    return serveSocket(socket_path, config);
+#else
+    cerr << "--socket is not supported on Windows" << endl;
+    return -1;
+#endif
+  }
+
+  string line;
+  while (getline(cin, line)) {
+    if (line.find_first_not_of(" \t\r") == string::npos)
+      continue;
+    // flush every response, so the client can stream the jobs
+    cout << runJob(line, config) << endl;
+  }
+  return 0;
+}
+
+void printServeUsage(const string &executable) {
+  cout << "OVERVIEW: Compile the jobs read as newline-delimited JSON in a "
+          "resident process"
+       << endl
+       << endl;
+
+  cout << "USAGE: " << executable
+       << " --method=serve --cl-device=<device_name> --config-path=<path> "
+          "[--socket=<path>]"
+       << endl
+       << endl;
+
+  cout << "OPTIONS:" << endl
+       << " --cl-device=<device_name>   - Specify device name from config file"
+       << endl
+       << " --config-path=<path>        - Path to config file" << endl
+       << " --socket=<path>             - Listen on the Unix socket instead of "
+          "reading stdin"
+       << endl
+       << endl;
+
+  cout << "JOB:" << endl
+       << "{\"id\": <string | number | true | false | null>, \"source\": <program> | \"file\": <path>, "
+          "\"options\": <options>, \"options_ex\": <options>, \"version\": "
+          "<version>, \"output\": <path>}"
+       << endl
+       << endl;
+
+  cout << "RESULT:" << endl
+       << "{\"id\": <id>, \"status\": <err>, \"compile_us\": <time>, "
+          "\"ir_size\": <size>, \"log\": <log>}"
+       << endl;
+}
@@ -0,0 +1,92 @@
+#!/usr/bin/env python3
+"""
+Compares two builds of the library, one with OPENCL_CLANG_COMPRESS_RESOURCES
+and one without: the library size, the library load time, the first compile
+latency and the peak resident memory of a process doing one compile.
+"""
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+import tempfile
+import time
+
+KERNEL = "__kernel void k(__global int *p) { p[get_global_id(0)] = 0; }\n"
+
+
+def library_path(occ_cli):
+    """Returns the opencl-clang library occ-cli is linked with."""
+    output = subprocess.run(
+        ["ldd", occ_cli], stdout=subprocess.PIPE, check=True, text=True
+    ).stdout
+    match = re.search(r"(\S*opencl-clang\S*\.so\S*) => (\S+)", output)
+    return match.group(2) if match else None
+
+
+def load_time_us(occ_cli):
+    """Wall time of occ-cli printing its usage, i.e. loading the library."""
+    start = time.perf_counter()
+    subprocess.run([occ_cli], stdout=subprocess.DEVNULL, check=True)
+    return int((time.perf_counter() - start) * 1e6)
+
+
+def first_compile(args, occ_cli, kernel):
+    """Returns the compile time in us and the peak RSS in KB of one compile."""
+    command = [
+        occ_cli,
+        kernel,
+        "--perf-counters",
+        "--config-path=" + args.config_path,
+        "--cl-device=" + args.device,
+        "--output=" + os.devnull,
+    ]
+    process = subprocess.Popen(command, stdout=subprocess.PIPE, text=True)
+    output = process.stdout.read()
+    _, status, usage = os.wait4(process.pid, 0)
+    if os.waitstatus_to_exitcode(status) != 0:
+        sys.exit("compile failed: " + " ".join(command))
+    match = re.search(r"^Compile time: (\d+) us", output, re.M)
+    return int(match.group(1)), usage.ru_maxrss
+
+
+def measure(args, occ_cli, kernel):
+    loads = [load_time_us(occ_cli) for _ in range(args.runs)]
+    compiles = [first_compile(args, occ_cli, kernel) for _ in range(args.runs)]
+    library = library_path(occ_cli)
+    return {
+        "library size (KB)": os.path.getsize(library) // 1024 if library else 0,
+        "load time (us)": min(loads),
+        "first compile (us)": min(c[0] for c in compiles),
+        "peak RSS (KB)": min(c[1] for c in compiles),
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--occ-cli", required=True,
+                        help="occ-cli of the build with the raw resources")
+    parser.add_argument("--compressed-occ-cli", required=True,
+                        help="occ-cli of the build with the compressed resources")
+    parser.add_argument("--config-path", required=True, help="ConfExt.ini dir")
+    parser.add_argument("--device", default="DEFAULT", help="device section")
+    parser.add_argument("--runs", type=int, default=5,
+                        help="runs per measurement, the minimum is reported")
+    args = parser.parse_args()
+
+    with tempfile.TemporaryDirectory() as tmp:
+        kernel = os.path.join(tmp, "bench.cl")
+        with open(kernel, "w") as f:
+            f.write(KERNEL)
+        raw = measure(args, args.occ_cli, kernel)
+        compressed = measure(args, args.compressed_occ_cli, kernel)
+
+    print("%-20s %12s %12s" % ("", "raw", "compressed"))
+    for name in raw:
+        print("%-20s %12d %12d" % (name, raw[name], compressed[name]))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,61 @@
+#!/usr/bin/env python3
+"""
+Measures the per-compile time saved by the invocation cache: compiles a tiny
+kernel with many options in a row, with and without -no-invocation-cache.
+"""
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+KERNEL = "__kernel void k(__global int *p) { p[0] = OPT_0; }\n"
+
+
+def average_time(args, kernel, options, options_ex):
+    command = [
+        args.occ_cli,
+        kernel,
+        "--bench=%d" % args.count,
+        "--cl-options=" + options,
+        "--config-path=" + args.config_path,
+        "--cl-device=" + args.device,
+    ]
+    if options_ex:
+        command.append("--cl-options-ex=" + options_ex)
+    output = subprocess.run(
+        command, stdout=subprocess.PIPE, check=True, text=True
+    ).stdout
+    match = re.search(r"^Average compile time: (\d+) us", output, re.M)
+    return int(match.group(1))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--occ-cli", required=True, help="path to occ-cli")
+    parser.add_argument("--config-path", required=True, help="ConfExt.ini dir")
+    parser.add_argument("--device", default="DEFAULT", help="device section")
+    parser.add_argument("--count", type=int, default=200, help="compiles")
+    parser.add_argument("--defines", type=int, default=50, help="-D options")
+    args = parser.parse_args()
+
+    options = " ".join("-DOPT_%d=%d" % (i, i) for i in range(args.defines))
+    options += " -cl-fast-relaxed-math -cl-mad-enable -Werror"
+
+    with tempfile.TemporaryDirectory() as tmp:
+        kernel = os.path.join(tmp, "bench.cl")
+        with open(kernel, "w") as f:
+            f.write(KERNEL)
+        uncached = average_time(args, kernel, options, "-no-invocation-cache")
+        cached = average_time(args, kernel, options, "")
+
+    print("Without the invocation cache: %d us per compile" % uncached)
+    print("With the invocation cache: %d us per compile" % cached)
+    print("Saved: %d us per compile" % (uncached - cached))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,224 @@
+#!/usr/bin/env python3
+"""
+Compiles a fixed set of kernels with occ-cli, records the compile time, the
+instructions retired and the peak RSS of every kernel and compares them
+against the checked-in baseline.
+"""
+
+import argparse
+import json
+import os
+import re
+import shlex
+import subprocess
+import sys
+
+METRICS = ["time_us", "instructions", "peak_rss_kb"]
+
+DEFAULT_TOLERANCE = {"time_us": 0.25, "instructions": 0.03, "peak_rss_kb": 0.10}
+
+
+def read_kernels(path):
+    with open(path) as f:
+        lines = [line.strip() for line in f]
+    return [line for line in lines if line and not line.startswith("#")]
+
+
+def kernel_command(args, tests_dir, kernel):
+    """Builds the occ-cli command from the first RUN line of the kernel."""
+    path = os.path.join(tests_dir, kernel)
+    with open(path, errors="replace") as f:
+        for line in f:
+            match = re.search(r"RUN:\s*(.*)", line)
+            if match:
+                run = match.group(1)
+                break
+        else:
+            raise RuntimeError("%s has no RUN line" % kernel)
+
+    # only the occ-cli invocation is timed, redirections and pipes are dropped
+    run = re.split(r"\s+(?:\||2>&1)", run)[0]
+    for pattern, value in [
+        ("%occ-cli", args.occ_cli),
+        ("%cfg_path", "--config-path=" + args.config_path),
+        ("%cl_device", args.device),
+        ("%cwd", os.getcwd()),
+        ("%S", os.path.dirname(path)),
+        ("%s", path),
+    ]:
+        run = run.replace(pattern, value)
+    return shlex.split(run) + ["--perf-counters"]
+
+
+def run_once(command):
+    """Returns the metrics of one compile, or None if the compile failed."""
+    process = subprocess.Popen(
+        command, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, text=True
+    )
+    peak_rss_kb = None
+    if hasattr(os, "wait4"):
+        output = process.stdout.read()
+        _, status, usage = os.wait4(process.pid, 0)
+        process.returncode = os.waitstatus_to_exitcode(status)
+        # ru_maxrss is in kilobytes on Linux and in bytes on macOS
+        peak_rss_kb = usage.ru_maxrss
+        if sys.platform == "darwin":
+            peak_rss_kb //= 1024
+    else:
+        output, _ = process.communicate()
+
+    if process.returncode != 0:
+        sys.stderr.write(output)
+        return None
+
+    time_us = re.search(r"^Compile time: (\d+) us", output, re.M)
+    instructions = re.search(r"^Instructions: (\d+)", output, re.M)
+    return {
+        "time_us": int(time_us.group(1)) if time_us else None,
+        "instructions": int(instructions.group(1)) if instructions else None,
+        "peak_rss_kb": peak_rss_kb,
+    }
+
+
+def measure(command, runs):
+    """Takes the minimum of every metric over the runs to filter out noise."""
+    results = []
+    for _ in range(runs):
+        metrics = run_once(command)
+        if metrics is None:
+            return None
+        results.append(metrics)
+    measured = {}
+    for metric in METRICS:
+        values = [r[metric] for r in results if r[metric] is not None]
+        measured[metric] = min(values) if values else None
+    return measured
+
+
+def compare(results, baseline, tolerance):
+    """Returns the regressions and the metrics missing from the baseline, and
+    prints the changes past the tolerance."""
+    regressions = []
+    missing = []
+    for kernel, metrics in sorted(results.items()):
+        expected = baseline.get("kernels", {}).get(kernel, {})
+        for metric in METRICS:
+            value = metrics.get(metric)
+            reference = expected.get(metric)
+            # the metrics not measured on this machine are not compared
+            if value is None:
+                continue
+            # a metric measured here but not in the baseline can't regress,
+            # which mustn't pass silently
+            if not reference:
+                print("MISSING BASELINE: %s %s: %d" % (kernel, metric, value))
+                missing.append("%s %s" % (kernel, metric))
+                continue
+            change = (value - reference) / reference
+            line = "%s %s: %d -> %d (%+.1f%%)" % (
+                kernel,
+                metric,
+                reference,
+                value,
+                change * 100,
+            )
+            if change > tolerance[metric]:
+                print("REGRESSION: " + line)
+                regressions.append(line)
+            elif change < -tolerance[metric]:
+                print("IMPROVEMENT: " + line)
+    return regressions, missing
+
+
+def main():
+    tests_dir = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+    perf_dir = os.path.join(tests_dir, "perf")
+
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--occ-cli", required=True, help="path to occ-cli")
+    parser.add_argument("--config-path", required=True, help="ConfExt.ini dir")
+    parser.add_argument("--device", default="DEFAULT", help="device section")
+    parser.add_argument(
+        "--kernels", default=os.path.join(perf_dir, "kernels.txt")
+    )
+    parser.add_argument(
+        "--baseline", default=os.path.join(perf_dir, "baseline.json")
+    )
+    parser.add_argument("--output", help="write the results to this file")
+    parser.add_argument("--runs", type=int, default=3, help="runs per kernel")
+    parser.add_argument(
+        "--tolerance",
+        type=float,
+        help="relative tolerance of all the metrics, overrides the baseline",
+    )
+    parser.add_argument(
+        "--update-baseline",
+        action="store_true",
+        help="store the results as the new baseline",
+    )
+    args = parser.parse_args()
+
+    results = {}
+    failures = []
+    for kernel in read_kernels(args.kernels):
+        metrics = measure(kernel_command(args, tests_dir, kernel), args.runs)
+        if metrics is None:
+            print("FAILED: %s" % kernel)
+            failures.append(kernel)
+            continue
+        results[kernel] = metrics
+        print(
+            "%s: %s"
+            % (kernel, ", ".join("%s=%s" % (m, metrics[m]) for m in METRICS))
+        )
+
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump({"device": args.device, "kernels": results}, f, indent=2)
+
+    with open(args.baseline) as f:
+        baseline = json.load(f)
+
+    if args.update_baseline:
+        baseline["kernels"] = results
+        with open(args.baseline, "w") as f:
+            json.dump(baseline, f, indent=2, sort_keys=True)
+            f.write("\n")
+        print("Baseline %s updated" % args.baseline)
+        return 1 if failures else 0
+
+    # a baseline without any number hasn't been recorded yet, there is
+    # nothing to compare against
+    if not any(
+        value is not None
+        for metrics in baseline.get("kernels", {}).values()
+        for value in metrics.values()
+    ):
+        print(
+            "SKIPPED: %s holds no recorded metrics, record them on the "
+            "reference machine with update-opencl-clang-perf-baseline"
+            % args.baseline
+        )
+        return 1 if failures else 0
+
+    tolerance = dict(DEFAULT_TOLERANCE)
+    tolerance.update(baseline.get("tolerance", {}))
+    if args.tolerance is not None:
+        tolerance = dict.fromkeys(METRICS, args.tolerance)
+
+    regressions, missing = compare(results, baseline, tolerance)
+    print(
+        "%d kernels measured, %d failed, %d regressions, "
+        "%d metrics missing from the baseline"
+        % (len(results), len(failures), len(regressions), len(missing))
+    )
+    if missing:
+        print(
+            "ERROR: %s lacks the metrics above, record them on the reference "
+            "machine with update-opencl-clang-perf-baseline" % args.baseline
+        )
+    return 1 if failures or regressions or missing else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
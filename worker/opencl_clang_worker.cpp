@@ -0,0 +1,55 @@
+/*****************************************************************************\
+
+Copyright (c) Intel Corporation (2009-2017).
+
+    INTEL MAKES NO WARRANTY OF ANY KIND REGARDING THE CODE.  THIS CODE IS
+    LICENSED ON AN "AS IS" BASIS AND INTEL WILL NOT PROVIDE ANY SUPPORT,
+    ASSISTANCE, INSTALLATION, TRAINING OR OTHER SERVICES.  INTEL DOES NOT
+    PROVIDE ANY UPDATES, ENHANCEMENTS OR EXTENSIONS.  INTEL SPECIFICALLY
+    DISCLAIMS ANY WARRANTY OF MERCHANTABILITY, NONINFRINGEMENT, FITNESS FOR ANY
+    PARTICULAR PURPOSE, OR ANY OTHER WARRANTY.  Intel disclaims all liability,
+    including liability for infringement of any proprietary rights, relating to
+    use of the code. No license, express or implied, by estoppel or otherwise,
+    to any intellectual property rights is granted herein.
+
+  \file opencl_clang_worker.cpp
+
+  \brief Worker process serving the compile requests forwarded by the library
+
+\*****************************************************************************/
+
+#include "opencl_clang.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <thread>
+
+int main(int argc, char **argv) {
+  int fd = -1;
+  for (int i = 1; i < argc; ++i) {
+    if (strncmp(argv[i], "--fd=", 5) == 0)
+      fd = atoi(argv[i] + 5);
+  }
+  if (fd < 0) {
+    fprintf(stderr, "Usage: %s --fd=<socket>\n", argv[0]);
+    return 1;
+  }
+
+  // Don't outlive the client if it dies while a compile is running. The
+  // client's end of the socket is closed when it dies, which hangs up ours,
+  // also if it died before we got here. PR_SET_PDEATHSIG isn't used, it
+  // fires when the client thread that spawned us exits.
+  std::thread([fd]() {
+    pollfd pfd = {fd, 0, 0};
+    while (poll(&pfd, 1, -1) < 0 && errno == EINTR)
+      ;
+    _exit(0);
+  }).detach();
+
+  return RunCompileWorker(fd);
+}